@@ -0,0 +1,47 @@
+/**
+ * Static RAM arena for the large buffers of the pipeline.
+ *
+ * The pipeline runs in stages that never overlap: capture, decode to a frame
+ * file, transmit. Each stage takes its buffers with arena_alloc() as it
+ * starts and gives all of them back with the next arena_begin(), so camera
+ * chunks, decoder lines and transmit bands share the same bytes. What every
+ * stage takes is known at build time (the *_BYTES of each module), the arena
+ * is sized for the largest stage, and the build fails if that does not fit
+ * ARENA_LIMIT.
+ *
+ * The beacon (-DBEACON) captures and decodes the next frame while the
+ * current one is sent: arena_hold() keeps the transmit buffers at the bottom
+ * and those stages take theirs above them, which their plan includes. A fast
+ * boot (-DFAST_BOOT) holds the line ring the same way while it captures the
+ * first picture.
+ *
+ * arena_plan() prints what each stage takes as planned; the native build
+ * does that alone with --arena-plan. arena_report() prints the planned and
+ * actual peak of each stage and, on the Due, how much of the RAM between the
+ * heap and the stack was never touched since arena_paint_stack().
+**/
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <Arduino.h>
+
+#define ARENA_LIMIT (72 * 1024L)    // Of the 96 KB, the rest is other statics, heap and stack
+#define ARENA_ALIGN 4
+
+// Pipeline stages
+#define ARENA_CAPTURE 0
+#define ARENA_DECODE 1
+#define ARENA_TRANSMIT 2
+#define ARENA_STAGES 3
+
+void arena_paint_stack();
+void arena_begin(uint8_t stage);
+void arena_hold();
+void arena_release();
+void* arena_alloc(uint32_t bytes);
+uint32_t arena_allocs();
+void arena_plan();
+void arena_report();
+
+#endif
@@ -0,0 +1,55 @@
+/**
+ * Pipeline benchmark for the native build (-DBENCH, env native_bench).
+ *
+ * Instead of taking a picture, setup() runs every stage over the fixed JPEG
+ * corpus in bench/ (run with --sd bench):
+ *  - decode: each JPEG to a frame file, in host ns and simulated ns per
+ *    source pixel, JPEG MB per host second, and the arena and heap
+ *    allocations of one frame
+ *  - overlay: header and footer text composited into white line groups, host
+ *    ns per overlay pixel
+ *  - freq: scottie_freq() and the double precision tuning word, against the
+ *    dds_lut lookup the transmitter does, host ns per pixel
+ *  - transmit: one frame file sent, simulated ns of the transmit interrupt
+ *    per pixel and of the SD group read per line, and its allocations
+ * Every host timing is the fastest of BENCH_RUNS.
+ *
+ * Host time depends on the machine, so each host timing is also given as
+ * host_rel, over a reference timed alongside it in the same run: a decode
+ * over the host reference decoder (sim_jpeg.h) decoding the same JPEG, the
+ * overlay and freq loops over the ns per byte of a fixed FNV-1a loop. The
+ * decoder library charges no simulated time of its own; the scaler charges
+ * sim_cost.jpeg_mcu_px or jpeg_mcu_dc for each MCU it reads, so sim_ns_px
+ * does not depend on the library linked.
+ *
+ * Every figure is printed as a "bench,stage,case,metric,value,baseline,result"
+ * line and compared with BENCH_BASELINE on the card (bench/BASELINE.CSV in
+ * the tree); the run fails (exit 1) on a regression: host_rel figures beyond
+ * BENCH_REL_SLACK, simulated ones beyond BENCH_SIM_SLACK, any allocation
+ * more. A missing baseline, or one of those figures missing from it, fails
+ * too. Absolute host figures are not in the baseline and only printed; one
+ * is checked, against BENCH_HOST_SLACK, if a line for it was added by hand.
+ * Build with -DBENCH_RECORD (env native_bench_record) to write a new one,
+ * with the decoder library the native env links.
+**/
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <Arduino.h>
+
+#define BENCH_BASELINE "BASELINE.CSV"
+#define BENCH_FRAME "BENCH.BIN"     // Frame file written and sent, removed after
+#define BENCH_RUNS 20               // Timings of each, the fastest counts
+#define BENCH_OVERLAY_RUNS 200      // Passes over the overlay groups a timing
+#define BENCH_FREQ_RUNS 2000        // Passes over the 256 colour values a timing
+#define BENCH_HOST_SLACK 2.0        // Host timings vary with the machine load
+#define BENCH_SIM_SLACK 1.02        // Simulated ones only with the code
+#define BENCH_REL_SLACK 2.0         // Host ones over their reference, run to run
+#define BENCH_CAL_BYTES 4096        // Calibration loop buffer
+#define BENCH_CAL_PASSES 128        // Passes over it a timing
+#define BENCH_RESULTS 32
+
+void bench_run();
+
+#endif
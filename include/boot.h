@@ -0,0 +1,28 @@
+/**
+ * Boot phase timing.
+ *
+ * setup() marks the end of every boot phase with boot_mark() (micros() since
+ * reset), and the transmitter marks when the first tone of the first frame
+ * goes out. boot_report() prints each phase with its end time and length
+ * once that frame is over, when printing no longer competes with the line
+ * queue, then boot to first tone, the latency a power-cycled transmitter
+ * pays every time.
+ *
+ * With -DFAST_BOOT the frame starts as soon as the DDS is up and the SD card
+ * and the camera come up, and the picture is taken, while the header and
+ * the overlay lines are on the air; the marks then come after the first
+ * tone.
+**/
+
+#ifndef BOOT_H
+#define BOOT_H
+
+#include <Arduino.h>
+
+#define BOOT_MARKS 12
+
+void boot_mark(const char* phase);
+void boot_first_tone(unsigned long us);
+void boot_report();
+
+#endif
@@ -0,0 +1,65 @@
+/**
+ * VC0706 capture engine on Serial1.
+ *
+ * Speaks the camera protocol directly instead of going through
+ * Adafruit_VC0706, whose readPicture() blocks for every 32 byte chunk:
+ *
+ * - cam_begin() finds the camera at its power-on rate and moves the link to
+ *   the fastest rate it acks and then answers at, and sets CAM_SIZE once,
+ *   reading it back to check, unless the camera already reports it. Called
+ *   again after the camera stopped answering, it tries the faster rates too.
+ * - cam_capture() reads the frame in chunks of up to CAM_CHUNK_MAX bytes,
+ *   double buffered. The next chunk is requested as soon as one is in, and
+ *   the one just received is written to SD (sd_writer.h) a sector at a time
+ *   while the next comes in over the wire, draining the UART in between. A
+ *   chunk that comes back short or damaged is asked for again at half the
+ *   size, and the smaller size is kept for the rest of that capture; the
+ *   next one starts at CAM_CHUNK_MAX again.
+ * - The exposure settle time runs from the size change, so SD setup and file
+ *   naming overlap it rather than adding to it. Without a size change it
+ *   runs from power on.
+ *
+ * cam_capture() does the whole capture. The beacon runs the same steps one
+ * chunk at a time between its other work: cam_capture_start() once
+ * cam_ready(), cam_capture_step() until it returns false, then
+ * cam_capture_finish(). A fast boot brings the camera up the same way, one
+ * command at a time while the first frame is on the air: it polls
+ * cam_answers() while the camera boots, then calls cam_begin_start(),
+ * cam_begin_step() until it returns false, and cam_begin_finish().
+**/
+
+#ifndef CAM_CAPTURE_H
+#define CAM_CAPTURE_H
+
+#include <Arduino.h>
+
+#define CAM_BAUD 38400            // Camera rate after power on
+#define CAM_CHUNK_MAX 2048        // Largest READ_FBUF chunk tried
+#define CAM_CHUNK_MIN 32          // Give up below this
+#define CAM_BUFFER_BYTES (2 * CAM_CHUNK_MAX)   // Arena taken by a capture
+#define CAM_TIMEOUT_MS 200        // Reply latency allowed on top of the wire time
+#define CAM_SETTLE_MS 3000        // Exposure settle after the size change
+#define CAM_BOOT_MS 5000          // Power on to first answer, given up after (FAST_BOOT)
+
+#define VC0706_640x480 0x00
+#define VC0706_320x240 0x11
+#define VC0706_160x120 0x22
+
+// Picture size, any size is scaled to the frame on decode (jpeg_scale.h)
+#ifndef CAM_SIZE
+#define CAM_SIZE VC0706_320x240
+#endif
+
+bool cam_answers();
+bool cam_begin();
+void cam_begin_start();
+bool cam_begin_step();
+bool cam_begin_finish();
+bool cam_capture(const char* filename);
+bool cam_ready();
+bool cam_capture_start(const char* filename);
+bool cam_capture_step();
+bool cam_capture_finish();
+uint32_t cam_capture_bytes();
+
+#endif
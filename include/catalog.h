@@ -0,0 +1,61 @@
+/**
+ * Image catalog: every capture on the SD card and what became of it.
+ *
+ * Captures are numbered in sequence and named after their number
+ * (IMG00042.JPG), so a new name takes no directory probes. CATALOG_FILE holds
+ * one record per capture in a ring of CATALOG_ENTRIES behind a small header:
+ * capture n is recorded at n % CATALOG_ENTRIES, so a lookup or an update is a
+ * seek and one 16 byte read or write on the file, which stays open. A new
+ * capture takes the place of the one CATALOG_ENTRIES before it, and that
+ * JPEG is deleted. The frame file of a capture belongs to the frame cache
+ * (frame_cache.h), which retires it on its own.
+ *
+ * The ring is read in one go at boot and the next number is one past the
+ * highest in it, so startup costs the same however many pictures the card
+ * has seen.
+**/
+
+#ifndef CATALOG_H
+#define CATALOG_H
+
+#include <Arduino.h>
+
+#define CATALOG_FILE "CATALOG.DAT"
+#define CATALOG_MAGIC "SCAT"
+#define CATALOG_VERSION 1
+#define CATALOG_ENTRIES 64          // Captures kept, 1 KB of RAM
+#define CATALOG_NAME 13             // "IMG00042.JPG" and the terminator
+
+// Status of a capture
+#define CATALOG_CAPTURING 0         // Named, the JPEG is not complete
+#define CATALOG_CAPTURED 1          // JPEG complete
+#define CATALOG_DECODED 2           // Frame file in the frame cache
+#define CATALOG_SENT 3              // Sent at least once
+#define CATALOG_FAILED 4            // Capture or decode failed
+
+struct catalog_header_t {
+  char magic[4];                    // CATALOG_MAGIC
+  uint32_t version;                 // CATALOG_VERSION
+  uint32_t entries;                 // CATALOG_ENTRIES
+  uint32_t reserved;
+};
+
+struct catalog_entry_t {
+  uint32_t seq;                     // Capture number, 0 for a free record
+  uint32_t jpgBytes;
+  uint32_t key;                     // Frame cache key, 0 before decoding
+  uint16_t sent;                    // Times sent
+  uint8_t status;                   // CATALOG_CAPTURING...
+  uint8_t reserved;
+};
+
+void catalog_begin();
+uint32_t catalog_new(char* jpg);
+void catalog_name(uint32_t seq, char* jpg);
+const catalog_entry_t* catalog_find(uint32_t seq);
+void catalog_captured(uint32_t seq, uint32_t bytes);
+void catalog_decoded(uint32_t seq, uint32_t key);
+void catalog_sent(uint32_t seq);
+void catalog_failed(uint32_t seq);
+
+#endif
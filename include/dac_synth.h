@@ -0,0 +1,46 @@
+/**
+ * Tone synthesis on the Due's own DAC, instead of the AD9850 (-DDDS_DAC).
+ *
+ * A software DDS: a 32 bit phase accumulator clocked once per sample indexes
+ * a sine table, and the samples go to DAC0 through the DACC PDC, two buffers
+ * of DAC_BLOCK in turn, converted on every rising edge of TIOA of TC0
+ * channel 1. The tuning words are those of dds.h with the sample rate as
+ * the reference clock, so the pixel table and the op tables work unchanged.
+ *
+ * The sample counter is also the transmit clock (tx_clock.h). When the PDC
+ * is done with a buffer, the DACC interrupt makes the next one: it runs the
+ * accumulator up to the sample boundary nearest each edge armed on the
+ * schedule, calls the edge handler there, which loads the next word, and
+ * carries on. An edge is never off by more than half a sample, and the time
+ * the interrupt takes to come in changes nothing as long as it refills the
+ * buffer before the other one has been converted. The phase runs on across
+ * every change, as in the AD9850.
+ *
+ * The clock only runs while a frame is sent: the first edge armed starts it
+ * and dac_down() stops it once what was made has been converted.
+**/
+
+#ifndef DAC_SYNTH_H
+#define DAC_SYNTH_H
+
+#include <Arduino.h>
+#include "tx_clock.h"
+
+#define DAC_SAMPLE_TICKS 420        // Transmit clock ticks per sample
+#define DAC_SAMPLE_HZ (TX_CLOCK_HZ / DAC_SAMPLE_TICKS)   // 100 kHz
+#define DAC_SAMPLE_NS (1000000000UL / DAC_SAMPLE_HZ)
+#define DAC_BLOCK 256               // Samples per PDC buffer, 2.56 ms
+#define DAC_SINE_BITS 10            // Sine table of 1024 samples
+#define DAC_MID 2048                // 12 bit DAC, silence
+#define DAC_AMPLITUDE 2047
+
+void dac_begin();
+void dac_clock(void (*edge)());
+uint32_t dac_tick();
+void dac_arm(uint32_t tick);
+uint32_t dac_queued();
+void dac_word(uint32_t word);
+void dac_down();
+void dac_report();
+
+#endif
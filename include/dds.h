@@ -0,0 +1,50 @@
+/**
+ * Fast AD9850 word writer and pixel tuning-word lookup table.
+ *
+ * The AD9850 library computes a double precision tuning word and bit-bangs it
+ * with digitalWrite() on every call. For pixels the word is looked up in a
+ * 256 entry table built once at startup and shifted out with direct port
+ * writes, so the pixel interrupt does no floating point at all.
+ *
+ * With -DDDS_DAC there is no AD9850: the same words, for the DAC sample rate,
+ * step the phase accumulator of dac_synth.h.
+**/
+
+#ifndef DDS_H
+#define DDS_H
+
+#include <Arduino.h>
+
+// AD9850 consts
+#ifdef DDS_STREAM                 // Driven by SPI0, see dds_stream.h
+#define AD9850_CLK_PIN 76         //SPCK
+#define AD9850_FQ_UPDATE_PIN 4    //NPCS1
+#define AD9850_DATA_PIN 75        //MOSI
+#else
+#define AD9850_CLK_PIN 51         //Working clock output pin
+#define AD9850_FQ_UPDATE_PIN 49   //Frequency update
+#define AD9850_DATA_PIN 47        //Serial data output pin
+#endif
+#define AD9850_RST_PIN 45         //Reset output pin
+
+#define DDS_POWER_DOWN 0x04       // Control byte bit
+
+#ifdef DDS_DAC                    // Synthesized on DAC0, see dac_synth.h
+#include "dac_synth.h"
+#define DDS_REF_CLK ((double)DAC_SAMPLE_HZ)
+#else
+#define DDS_REF_CLK 125000000.0   // AD9850 reference clock (Hz)
+#endif
+
+// Tuning word for a constant frequency, folded at compile time
+#define DDS_WORD(freq) ((uint32_t)((freq) * 4294967296.0 / DDS_REF_CLK))
+
+extern uint32_t dds_lut[256];
+
+void dds_begin();
+uint32_t dds_word(double freq);
+void dds_lut_init(double base, double step);
+void dds_write(uint32_t word);
+void dds_down();
+
+#endif
@@ -0,0 +1,44 @@
+/**
+ * Pre-serialized AD9850 word stream clocked out by SPI0 + PDC.
+ *
+ * A colour scan is encoded ahead of time into SPI transmit entries: every
+ * 40 bit AD9850 word becomes 5 byte transfers to the chip select wired to
+ * FQ_UD, the last one with LASTXFER so the chip select rises (and the AD9850
+ * latches) once per word. The SPI baud rate and inter-transfer delay are
+ * chosen so one word takes one pixel period; the PDC then drains a whole
+ * scan with no CPU work per pixel. dds_stream_finish() waits for a stream
+ * to end without its interrupt, for the transmit interrupt to load the
+ * tone after a scan.
+ *
+ * Wiring (DDS_STREAM builds): W_CLK -> SPCK, DATA -> MOSI, FQ_UD -> pin 4
+ * (NPCS1), RESET unchanged. SD shares SPI0, so the card must not be touched
+ * while dds_stream_busy().
+**/
+
+#ifndef DDS_STREAM_H
+#define DDS_STREAM_H
+
+#include <Arduino.h>
+
+#define DDS_STREAM_NPCS 1                 // FQ_UD on NPCS1 (digital pin 4)
+#define DDS_STREAM_BYTES_PER_WORD 5
+
+// Transmit entries needed for n AD9850 words
+#define DDS_STREAM_ENTRIES(n) ((n) * DDS_STREAM_BYTES_PER_WORD)
+
+typedef uint32_t dds_stream_entry_t;      // SPI_TDR image: data, PCS, LASTXFER
+
+void dds_stream_begin(double word_period_us);
+double dds_stream_period_us();
+uint16_t dds_stream_encode(dds_stream_entry_t* dst, const volatile byte* colors, uint16_t count);
+uint16_t dds_stream_append(dds_stream_entry_t* dst, uint32_t word, uint8_t control);
+void dds_stream_start(const dds_stream_entry_t* entries, uint16_t words);
+void dds_stream_start_single(const dds_stream_entry_t* entries);
+bool dds_stream_busy();
+void dds_stream_finish();
+unsigned long dds_stream_done_time();
+uint64_t dds_stream_decode(const dds_stream_entry_t* entry);
+uint16_t dds_stream_verify(const dds_stream_entry_t* entries, const volatile byte* colors,
+                           uint16_t count, double base, double step);
+
+#endif
@@ -0,0 +1,56 @@
+/**
+ * Frame cache: frame files kept on SD by picture, so a picture that was sent
+ * before goes on the air again without being decoded.
+ *
+ * An entry is a frame file (frame_file.h), already laid out in transmit order
+ * for the mode, named after its key in FRAME_CACHE_DIR. The key is a 32 bit
+ * FNV-1a hash of the JPEG bytes and of the frame file format of this build
+ * (VIS code, group layout, version), so other modes never match. The overlay
+ * text is not part of it: it goes on at transmit time and may change between
+ * frames (overlay.h).
+ *
+ * The index (FRAME_CACHE_INDEX, one sector) lists the keys and when each one
+ * was last used. It holds FRAME_CACHE_ENTRIES; adding one more drops the
+ * least recently used entry, and when the card is full the caller drops them
+ * one at a time with frame_cache_evict() until the frame file fits. The entry
+ * used last is never dropped, it may be on the air.
+ *
+ * The JPEG is hashed a sector per frame_cache_hash_step(), so the beacon can
+ * do it between line groups.
+**/
+
+#ifndef FRAME_CACHE_H
+#define FRAME_CACHE_H
+
+#include <Arduino.h>
+
+#define FRAME_CACHE_DIR "FCACHE"
+#define FRAME_CACHE_INDEX "FCACHE/INDEX.DAT"
+#define FRAME_CACHE_MAGIC "FCAC"
+#define FRAME_CACHE_VERSION 1
+#define FRAME_CACHE_ENTRIES 16
+#define FRAME_CACHE_PATH 20           // "FCACHE/0123ABCD.BIN" and the terminator
+
+struct frame_cache_entry_t {
+  uint32_t key;                       // 0 for a free entry
+  uint32_t used;                      // Sequence number of its last use
+};
+
+struct frame_cache_index_t {
+  char magic[4];                      // FRAME_CACHE_MAGIC
+  uint32_t version;                   // FRAME_CACHE_VERSION
+  uint32_t sequence;                  // Last sequence number given out
+  frame_cache_entry_t entries[FRAME_CACHE_ENTRIES];
+};
+
+void frame_cache_begin();
+uint32_t frame_cache_key(const char* jpg);
+bool frame_cache_hash_start(const char* jpg);
+bool frame_cache_hash_step();
+uint32_t frame_cache_hash_finish();
+bool frame_cache_find(uint32_t key, char* path);
+void frame_cache_path(uint32_t key, char* path);
+void frame_cache_add(uint32_t key);
+bool frame_cache_evict();
+
+#endif
@@ -0,0 +1,47 @@
+/**
+ * Frame file: a picture laid out on SD the way the transmitter sends it.
+ *
+ * Sector 0 is a header (frame_file_header_t, zero padded). Then come the line
+ * groups of the frame, each one in the mode's line buffer layout (planar G,
+ * B, R for RGB modes, see sstv_mode.h) padded to SSTV_GROUP_STRIDE, so every
+ * group starts on a sector and is read with one call straight into a line
+ * ring slot, with no reordering afterwards. Files are written through the
+ * sector-buffered SD writer (sd_writer.h).
+ *
+ * The file holds exactly the lines of the mode it was written for: 16 header
+ * lines, 11 footer lines, the picture, then white. A file written for another
+ * mode, or with fewer groups than its header says, is refused on open.
+**/
+
+#ifndef FRAME_FILE_H
+#define FRAME_FILE_H
+
+#include <Arduino.h>
+#include <SD.h>
+#include "sstv_mode.h"
+
+#define FRAME_FILE_MAGIC "SSTV"
+#define FRAME_FILE_VERSION 1
+#define FRAME_FILE_READ_US 3000   // First guess of one group read time
+#define FRAME_FILE_BYTES (Mode::Layout::lines * SSTV_RGB_LINE + SSTV_GROUP_STRIDE)  // Arena taken to write
+
+struct frame_file_header_t {
+  char magic[4];                  // FRAME_FILE_MAGIC
+  uint8_t version;                // FRAME_FILE_VERSION
+  uint8_t vis;                    // Mode the groups are laid out for
+  uint8_t groupLines;             // Picture lines per group
+  uint8_t reserved;
+  uint16_t width;                 // Pixels per line
+  uint16_t lines;                 // Picture lines in the file
+  uint16_t groupBytes;            // Layout bytes of a group
+  uint16_t stride;                // Bytes from one group to the next, whole sectors
+};
+
+bool frame_file_create(const char* filename);
+void frame_file_write_line(const byte* rgb);
+bool frame_file_finish(const char* stage);
+bool frame_file_open(File* src);
+bool frame_file_read_group(File* src, byte* slot);
+unsigned long frame_file_read_us();
+
+#endif
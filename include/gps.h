@@ -0,0 +1,53 @@
+/**
+ * GPS telemetry for the footer.
+ *
+ * The receiver's NMEA stream comes in on Serial2 (RX2, pin 17). The Due core
+ * owns the USART interrupt handlers, so instead of a receive interrupt the
+ * PDC copies every byte into a ring of two halves, switching halves by
+ * itself; nothing runs per byte and the transmit interrupt is never held
+ * off. gps_poll() re-arms the half it has finished reading and feeds up to
+ * GPS_SLICE_BYTES to a parser that keeps no more than the field it is in,
+ * so it can run between line groups. A half it has not read by the time the
+ * PDC needs it is not overwritten: the bytes that do not fit are lost and
+ * counted, and the parser picks up at the next '$'. Each half holds
+ * GPS_POLL_GAP_MS of the stream at GPS_BAUD (512 bytes at least). The camera
+ * and frame cache waits poll too, so the longest gap left is a streamed
+ * band decoded to catch up after a fast boot, some 200 ms.
+ *
+ * Every GGA sentence with a good checksum and a fix becomes the latest fix.
+ * It is published under a sequence count, so gps_fix() copies a consistent
+ * snapshot without locking; the transmitter reads it once per frame with
+ * gps_footer().
+**/
+
+#ifndef GPS_H
+#define GPS_H
+
+#include <Arduino.h>
+
+#ifndef GPS_BAUD
+#define GPS_BAUD 9600             // Receiver rate, -DGPS_BAUD=... for others
+#endif
+#define GPS_POLL_GAP_MS 250       // Longest the foreground goes without gps_poll()
+#define GPS_HALF_FIT ((GPS_BAUD / 10 * GPS_POLL_GAP_MS / 1000 + 63) / 64 * 64)
+#define GPS_RING_BYTES (2 * (GPS_HALF_FIT > 512 ? GPS_HALF_FIT : 512))  // Two halves the PDC fills in turn
+#define GPS_SLICE_BYTES 256       // Parsed per gps_poll() call, under 0.2 ms
+#define GPS_FIELD 16              // Longest NMEA field kept
+
+struct gps_fix_t {
+  int32_t lat;                    // 1/10000 minute, north positive
+  int32_t lon;                    // 1/10000 minute, east positive
+  int32_t alt;                    // Decimetres above mean sea level
+  uint32_t time;                  // UTC hhmmss
+  uint8_t quality;                // GGA fix quality, 0 without a fix
+  uint8_t sats;                   // Satellites used
+  unsigned long at;               // millis() the sentence was complete
+};
+
+void gps_begin();
+bool gps_poll();
+bool gps_fix(gps_fix_t* fix);
+bool gps_footer(char* text, uint8_t size);
+void gps_report();
+
+#endif
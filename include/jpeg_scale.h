@@ -0,0 +1,43 @@
+/**
+ * Scaled JPEG decode: pictures of any size come out as 320 pixel RGB lines.
+ *
+ * The picture is scaled by width / 320 in both directions, so the aspect is
+ * kept and a 640x480 capture gives the same 320x240 lines as a 320x240 one.
+ * Pictures at least 8 times too wide are decoded with the decoder's reduced
+ * IDCT (one pixel per 8x8 block, DC only), which is all the JPEG library
+ * offers; everything else is decoded at full size.
+ *
+ * The decoded pixels then go through a fixed point area-average resampler
+ * that works in a stream: each MCU is scaled horizontally as it is decoded,
+ * into one MCU row of 320 pixel lines, and output lines are made from those
+ * with one line of 32 bit sums. Every source pixel has weight 320 and every
+ * output pixel collects weight width, so scaling up and down are the same
+ * loop and no line is ever held at its source width. At 320 pixels wide the
+ * pixels are copied through unchanged. Grayscale pictures are expanded to R,
+ * G and B here.
+ *
+ * Work is done in small steps so the streaming transmitter can fit it into
+ * its gaps: jpeg_scale_line() makes a line from MCUs already decoded and
+ * jpeg_scale_mcu() decodes one more.
+**/
+
+#ifndef JPEG_SCALE_H
+#define JPEG_SCALE_H
+
+#include <Arduino.h>
+
+#define JPEG_SCALE_WIDTH 320
+#define JPEG_SCALE_MCU_LINES 16      // Tallest MCU (4:2:0)
+#define JPEG_SCALE_REDUCE 8          // Decoder reduced IDCT, 1/8 only
+
+// Arena taken per picture: the MCU row, the output line sums and the output
+// pixel in progress on each line of the MCU row
+#define JPEG_SCALE_BYTES (JPEG_SCALE_MCU_LINES * 3 * JPEG_SCALE_WIDTH + 4 * 3 * JPEG_SCALE_WIDTH + \
+                          JPEG_SCALE_MCU_LINES * (4 * 3 + 2 + 2))
+
+bool jpeg_scale_open(char* filename, uint16_t lines);
+uint16_t jpeg_scale_lines();
+bool jpeg_scale_line(byte* dst);
+bool jpeg_scale_mcu();
+
+#endif
@@ -0,0 +1,39 @@
+/**
+ * Streaming JPEG line source for the transmitter.
+ *
+ * Instead of decoding the whole picture to a .BIN file first, lines scaled
+ * to 320 pixels (jpeg_scale.h) are made into a small ring of 16 line bands
+ * while the frame is being sent, and the transmitter reads lines in place
+ * from the bands, without copying. White bands for the header and footer
+ * overlay go through the same ring ahead of the picture, so the line layout
+ * matches the frame file written by jpeg_decode(): 16 header lines, 11
+ * footer lines, then the picture.
+ *
+ * Decoding happens in jpeg_stream_pump(), one step (an MCU or a scaled line)
+ * per call and only when the worst step time seen so far still fits before
+ * the caller's deadline, so it can be run from the foreground waits without
+ * stretching any tone. A frame that started before its picture was ready
+ * drops the lines it already sent with jpeg_stream_skip(), as far as the
+ * pump has decoded them, until it has caught up.
+**/
+
+#ifndef JPEG_STREAM_H
+#define JPEG_STREAM_H
+
+#include <Arduino.h>
+
+#define JPEG_STREAM_WIDTH 320
+#define JPEG_STREAM_BANDS 2          // Bands in the ring
+#define JPEG_STREAM_BAND_LINES 16    // Lines per band
+#define JPEG_STREAM_MCU_US 6000      // First guess of one decode step time
+#define JPEG_STREAM_BYTES (JPEG_STREAM_BANDS * JPEG_STREAM_BAND_LINES * 3 * JPEG_STREAM_WIDTH)  // Arena taken per frame
+
+bool jpeg_stream_open(char* filename);
+bool jpeg_stream_pump(unsigned long deadline);
+bool jpeg_stream_ready();
+const byte* jpeg_stream_line();
+bool jpeg_stream_skip(uint16_t line);
+void jpeg_stream_release();
+void jpeg_stream_close();
+
+#endif
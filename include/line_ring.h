@@ -0,0 +1,37 @@
+/**
+ * Single producer / single consumer ring of line group slots.
+ *
+ * Each slot holds one line group laid out as the mode sends it (planar G, B,
+ * R for RGB modes, see sstv_mode.h). The producer claims a free slot, lays the
+ * group out in place and publishes it; the consumer takes published slots in
+ * order. Nothing is copied between the two sides: a slot changes hands only
+ * through the two counters, each written by one side alone, with a memory
+ * barrier between the slot contents and the counter.
+ *
+ * The slots are taken from the arena (arena.h) by line_ring_reset().
+ *
+ * The consumer keeps reading the last LINE_RING_HELD slots it took (Scottie
+ * sends red of the previous group after the sync), so those are not handed
+ * back to the producer until it takes further ones.
+**/
+
+#ifndef LINE_RING_H
+#define LINE_RING_H
+
+#include <Arduino.h>
+#include "sstv_mode.h"
+
+#define LINE_RING_SLOTS 5           // Slots in the ring
+#define LINE_RING_HELD 2            // Slots the consumer may still be reading
+#define LINE_RING_SLOT_BYTES SSTV_GROUP_STRIDE  // Frame files are read straight in
+#define LINE_RING_BYTES (LINE_RING_SLOTS * LINE_RING_SLOT_BYTES)   // Arena taken per frame
+
+void line_ring_reset();
+byte* line_ring_claim();
+void line_ring_publish();
+byte* line_ring_take();
+uint16_t line_ring_published();
+uint16_t line_ring_taken();
+void line_ring_report();
+
+#endif
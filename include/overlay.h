@@ -0,0 +1,28 @@
+/**
+ * Callsign header and telemetry footer drawn over the top of the frame.
+ *
+ * The first OVERLAY_HEADER_LINES lines of a frame are the header band and
+ * the next OVERLAY_FOOTER_LINES the footer band, black text on white. The
+ * picture sources leave those lines white and the text is composited into
+ * each line group as it is queued for transmission, from a glyph atlas
+ * expanded at compile time, so changing the text costs a few microseconds
+ * per line and no decode or file rewrite.
+**/
+
+#ifndef OVERLAY_H
+#define OVERLAY_H
+
+#include <Arduino.h>
+
+#define OVERLAY_WIDTH 320
+#define OVERLAY_HEADER_LINES 16
+#define OVERLAY_FOOTER_LINES 11
+#define OVERLAY_LINES (OVERLAY_HEADER_LINES + OVERLAY_FOOTER_LINES)
+#define OVERLAY_HEADER_CHARS 12
+#define OVERLAY_FOOTER_CHARS 76       // (320 - 16) / 4 px
+
+void overlay_set_header(const char* id);
+void overlay_set_footer(const char* text, uint8_t len);
+void overlay_group(byte* slot, uint16_t group);
+
+#endif
@@ -0,0 +1,35 @@
+/**
+ * Sector-buffered SD file writer.
+ *
+ * Capture and decode both write through one buffer of SD_WRITER_SECTORS
+ * sectors, taken from the arena (arena.h) when the file is opened. Data is
+ * collected there and handed to the SD library a full buffer at a time. The
+ * file is written from offset 0 in whole sectors, so every call starts on a
+ * block boundary and fills whole blocks, which the library writes directly
+ * without a read-modify-write through its block cache. Only the last call
+ * of a file can be partial.
+ *
+ * The Arduino SD wrapper does not expose SdFat's contiguous file creation.
+ * Instead, sd_writer_open() removes any old file first, so the new file's
+ * clusters are allocated in order as the buffer is flushed.
+ *
+ * Each stage of a file (e.g. the capture, or the decoded picture) can be
+ * reported on its own with sd_writer_stage().
+**/
+
+#ifndef SD_WRITER_H
+#define SD_WRITER_H
+
+#include <Arduino.h>
+#include <SD.h>
+
+#define SD_WRITER_SECTOR 512
+#define SD_WRITER_SECTORS 4          // Sectors per SD library call
+#define SD_WRITER_BYTES (SD_WRITER_SECTORS * SD_WRITER_SECTOR)   // Arena taken per file
+
+bool sd_writer_open(const char* filename);
+void sd_writer_write(const void* data, uint32_t len);
+void sd_writer_stage(const char* name);
+bool sd_writer_close(const char* name);
+
+#endif
@@ -0,0 +1,228 @@
+/**
+ * SSTV mode descriptors, resolved at compile time.
+ *
+ * A mode is a struct of constants plus three segment lists: Header (VOX
+ * tones, calibration header and VIS code), Preamble, sent once after it, and
+ * Line, repeated for every line group. A segment is either a Tone (frequency
+ * and duration) or a Scan (a run of pixels taken from the line buffer at a
+ * fixed offset). The transmitter compiles the lists into constant op tables
+ * of tuning words and durations in clock ticks, walked by the transmit
+ * interrupt (tx_engine.h); nothing branches on the mode at run time.
+ *
+ * The line buffer layout belongs to the mode: RGB modes store a line as
+ * planar G, B, R in transmit order, YCrCb modes (PD, Robot) store a pair of
+ * lines as the luma and averaged chroma runs they are sent as. Layouts encode
+ * from one pointer per line, so lines can be read where the decoder left them,
+ * and can paint black runs over an encoded group for the overlay text.
+ *
+ * The mode is picked with -DSSTV_MODE=<name>, Scottie1 by default.
+**/
+
+#ifndef SSTV_MODE_H
+#define SSTV_MODE_H
+
+#include <Arduino.h>
+
+#define SSTV_WIDTH 320              // Pixels per picture line
+#define SSTV_RGB_LINE (3 * SSTV_WIDTH)
+
+// Pixel value to frequency: 1500 Hz black to 2300 Hz white
+#define SSTV_BLACK_FREQ 1500
+#define SSTV_COLOR_STEP 3.1372549   // 800 Hz / 255
+
+/**
+ * Constant tone
+ * @param Freq - Hz
+ * @param Us - duration in microseconds
+ * @param Read - read the next line group while it sounds
+**/
+template<uint16_t Freq, uint32_t Us, bool Read = false>
+struct Tone {
+  static constexpr uint16_t freq = Freq;
+  static constexpr uint32_t us = Us;
+  static constexpr bool read = Read;
+};
+
+/**
+ * Pixel run from the line buffer
+ * @param Offset - first byte in the line buffer
+ * @param Count - pixels
+ * @param Previous - take it from the line group read before the last one
+ *                   (Scottie sends red after the sync that reads the next line)
+**/
+template<uint16_t Offset, uint16_t Count, bool Previous = false>
+struct Scan {
+  static constexpr uint16_t offset = Offset;
+  static constexpr uint16_t count = Count;
+  static constexpr bool previous = Previous;
+};
+
+template<class... S>
+struct Segments {};
+
+/**
+ * Even parity bit of a VIS code
+ * @param uint8_t vis - 7 bit code
+ * @return uint8_t - 1 when the code has an odd number of ones
+**/
+constexpr uint8_t sstv_vis_parity(uint8_t vis){
+  return vis == 0 ? 0 : (vis & 1) ^ sstv_vis_parity(vis >> 1);
+}
+
+/**
+ * Tone of a VIS data bit
+ * @param uint8_t vis - 7 bit code
+ * @param uint8_t bit - 0 is sent first, 7 is the parity bit
+ * @return uint16_t - 1100 Hz for a one, 1300 Hz for a zero
+**/
+constexpr uint16_t sstv_vis_freq(uint8_t vis, uint8_t bit){
+  return (bit < 7 ? (vis >> bit) & 1 : sstv_vis_parity(vis)) ? 1100 : 1300;
+}
+
+/**
+ * Start of every frame: VOX tones (optional), calibration header, then the
+ * VIS code LSB first with even parity between a start and a stop bit
+**/
+template<uint8_t Vis>
+using VisHeader = Segments<
+  Tone<1900, 100000>, Tone<1500, 100000>, Tone<1900, 100000>, Tone<1500, 100000>,
+  Tone<2300, 100000>, Tone<1500, 100000>, Tone<2300, 100000>, Tone<1500, 100000>,
+  Tone<1900, 300000>, Tone<1200, 10000>, Tone<1900, 300000>,
+  Tone<1200, 30000>,                                      // Start bit
+  Tone<sstv_vis_freq(Vis, 0), 30000>, Tone<sstv_vis_freq(Vis, 1), 30000>,
+  Tone<sstv_vis_freq(Vis, 2), 30000>, Tone<sstv_vis_freq(Vis, 3), 30000>,
+  Tone<sstv_vis_freq(Vis, 4), 30000>, Tone<sstv_vis_freq(Vis, 5), 30000>,
+  Tone<sstv_vis_freq(Vis, 6), 30000>, Tone<sstv_vis_freq(Vis, 7), 30000>,
+  Tone<1200, 30000>                                       // Stop bit
+>;
+
+/** One RGB line as planar G, B, R **/
+struct RGBLayout {
+  static constexpr uint8_t lines = 1;
+  static constexpr uint16_t bytes = SSTV_RGB_LINE;
+  static void encode(byte* dst, const byte* const* rows);
+  static void black(byte* dst, uint8_t line, uint16_t x, uint16_t n);
+};
+
+/** Two lines as Y0, R-Y, B-Y, Y1 (full width chroma, averaged vertically) **/
+struct PDLayout {
+  static constexpr uint8_t lines = 2;
+  static constexpr uint16_t bytes = 4 * SSTV_WIDTH;
+  static void encode(byte* dst, const byte* const* rows);
+  static void black(byte* dst, uint8_t line, uint16_t x, uint16_t n);
+};
+
+/** Two lines as Y0, R-Y, Y1, B-Y (half width chroma, averaged 2x2) **/
+struct Robot36Layout {
+  static constexpr uint8_t lines = 2;
+  static constexpr uint16_t bytes = 3 * SSTV_WIDTH;
+  static void encode(byte* dst, const byte* const* rows);
+  static void black(byte* dst, uint8_t line, uint16_t x, uint16_t n);
+};
+
+/**
+ * Scottie family: separator, green, separator, blue, sync, porch, red.
+ * The first line is preceded by a lone sync pulse.
+**/
+template<uint8_t Vis, uint32_t PixelNs>
+struct ScottieMode {
+  typedef RGBLayout Layout;
+  static constexpr uint8_t vis = Vis;
+  static constexpr uint32_t pixelNs = PixelNs;
+  static constexpr uint16_t lines = 256;
+  static constexpr uint16_t maxScan = SSTV_WIDTH;
+
+  typedef VisHeader<Vis> Header;
+  typedef Segments<Tone<1200, 9000, true>> Preamble;
+  typedef Segments<
+    Tone<1500, 1500>, Scan<0, SSTV_WIDTH>,
+    Tone<1500, 1500>, Scan<SSTV_WIDTH, SSTV_WIDTH>,
+    Tone<1200, 9000, true>,
+    Tone<1500, 1500>, Scan<2 * SSTV_WIDTH, SSTV_WIDTH, true>
+  > Line;
+};
+
+/** Martin family: sync, porch, green, separator, blue, separator, red, separator **/
+template<uint8_t Vis, uint32_t PixelNs>
+struct MartinMode {
+  typedef RGBLayout Layout;
+  static constexpr uint8_t vis = Vis;
+  static constexpr uint32_t pixelNs = PixelNs;
+  static constexpr uint16_t lines = 256;
+  static constexpr uint16_t maxScan = SSTV_WIDTH;
+
+  typedef VisHeader<Vis> Header;
+  typedef Segments<> Preamble;
+  typedef Segments<
+    Tone<1200, 4862, true>,
+    Tone<1500, 572>, Scan<0, SSTV_WIDTH>,
+    Tone<1500, 572>, Scan<SSTV_WIDTH, SSTV_WIDTH>,
+    Tone<1500, 572>, Scan<2 * SSTV_WIDTH, SSTV_WIDTH>,
+    Tone<1500, 572>
+  > Line;
+};
+
+/** PD family: sync, porch, then Y0, R-Y, B-Y, Y1 back to back for a line pair **/
+template<uint8_t Vis, uint32_t PixelNs>
+struct PDMode {
+  typedef PDLayout Layout;
+  static constexpr uint8_t vis = Vis;
+  static constexpr uint32_t pixelNs = PixelNs;
+  static constexpr uint16_t lines = 256;
+  static constexpr uint16_t maxScan = SSTV_WIDTH;
+
+  typedef VisHeader<Vis> Header;
+  typedef Segments<> Preamble;
+  typedef Segments<
+    Tone<1200, 20000, true>,
+    Tone<1500, 2080>,
+    Scan<0, SSTV_WIDTH>, Scan<SSTV_WIDTH, SSTV_WIDTH>,
+    Scan<2 * SSTV_WIDTH, SSTV_WIDTH>, Scan<3 * SSTV_WIDTH, SSTV_WIDTH>
+  > Line;
+};
+
+/**
+ * Robot 36: every line is sync, porch, Y, then one chroma component behind a
+ * separator that tells which (1500 Hz R-Y on even lines, 2300 Hz B-Y on odd).
+ * Chroma is sent as 160 samples so its pixel period matches luma's.
+**/
+struct Robot36 {
+  typedef Robot36Layout Layout;
+  static constexpr uint8_t vis = 8;
+  static constexpr uint32_t pixelNs = 275000;
+  static constexpr uint16_t lines = 240;
+  static constexpr uint16_t maxScan = SSTV_WIDTH;
+
+  typedef VisHeader<vis> Header;
+  typedef Segments<> Preamble;
+  typedef Segments<
+    Tone<1200, 9000, true>,
+    Tone<1500, 3000>, Scan<0, SSTV_WIDTH>,
+    Tone<1500, 4500>,
+    Tone<1900, 1500>, Scan<SSTV_WIDTH, SSTV_WIDTH / 2>,
+    Tone<1200, 9000>,
+    Tone<1500, 3000>, Scan<3 * SSTV_WIDTH / 2, SSTV_WIDTH>,
+    Tone<2300, 4500>,
+    Tone<1900, 1500>, Scan<5 * SSTV_WIDTH / 2, SSTV_WIDTH / 2>
+  > Line;
+};
+
+typedef ScottieMode<60, 432000> Scottie1;    // 428.22 ms/line, 110 s
+typedef ScottieMode<56, 275200> Scottie2;    // 277.69 ms/line, 71 s
+typedef ScottieMode<76, 1080000> ScottieDX;  // 1050.3 ms/line, 269 s
+typedef MartinMode<44, 457600> Martin1;      // 446.45 ms/line, 114 s
+typedef MartinMode<40, 228800> Martin2;      // 226.80 ms/line, 58 s
+typedef PDMode<99, 532000> PD90;             // 703.04 ms/pair, 90 s
+
+#ifndef SSTV_MODE
+#define SSTV_MODE Scottie1
+#endif
+
+typedef SSTV_MODE Mode;
+
+// Bytes a line group takes in a line ring slot or a frame file: the layout
+// rounded up to whole SD sectors, so a group is read with block reads only
+#define SSTV_SECTOR 512
+#define SSTV_GROUP_STRIDE ((Mode::Layout::bytes + SSTV_SECTOR - 1) / SSTV_SECTOR * SSTV_SECTOR)
+
+#endif
@@ -0,0 +1,59 @@
+/**
+ * Cycle counter tracing of the transmit hot paths.
+ *
+ * A trace point reads the Cortex-M3 DWT cycle counter (84 MHz) where it
+ * starts and records the cycles taken where it ends: one load, then a few
+ * stores into a RAM ring of the last TRACE_ENTRIES events, with interrupts
+ * masked only for those stores. Every point also keeps its count, worst and
+ * total. The points are always compiled in.
+ *
+ * trace_report() dumps the ring over Serial after the frame. On the native
+ * build the counter is the simulated clock, and every event also goes into a
+ * power of two histogram per point, printed instead of the ring.
+**/
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <Arduino.h>
+
+#define TRACE_CPU_MHZ 84
+#define TRACE_ENTRIES 256           // Events kept, 3 KB
+#define TRACE_BUCKETS 33            // Histogram: 0 cycles, then below 2, 4 ... 2^32
+
+// Trace points
+#define TRACE_ISR_LATENCY 0         // Transmit interrupt entry after its deadline
+#define TRACE_ISR 1                 // Transmit interrupt
+#define TRACE_DDS_WRITE 2           // dds_write()
+#define TRACE_SD_READ 3             // Frame file group read
+#define TRACE_SLACK 4               // Group queued before the interrupt took it
+#define TRACE_POINTS 5
+
+/**
+ * Cycle counter, wraps every 51 s
+**/
+static inline uint32_t trace_now(){
+#ifdef SSTV_NATIVE
+  return (uint32_t)(sim_now_ns() * TRACE_CPU_MHZ / 1000);
+#else
+  return DWT->CYCCNT;
+#endif
+}
+
+void trace_begin();
+void trace_clear();
+void trace_value(uint8_t point, uint32_t cycles);
+void trace_report();
+uint32_t trace_count(uint8_t point);
+uint64_t trace_total(uint8_t point);
+
+/**
+ * Record the cycles since a trace_now()
+ * @param uint8_t point - TRACE_ISR...
+ * @param uint32_t start - trace_now() where the event started
+**/
+static inline void trace_span(uint8_t point, uint32_t start){
+  trace_value(point, trace_now() - start);
+}
+
+#endif
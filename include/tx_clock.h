@@ -0,0 +1,73 @@
+/**
+ * Absolute-deadline transmit clock.
+ *
+ * A free running 32 bit counter at MCK/2 (42 MHz) with a one shot compare
+ * interrupt. Every edge of a frame (tones, pixels, sync pulses) is scheduled
+ * at an absolute tick computed from the exact mode timing in nanoseconds
+ * (tx_span(), at compile time): the part of a tick that does not fit is
+ * carried in a fractional accumulator, so rounding never adds up and any edge
+ * is within one tick of the spec no matter how long the frame runs. Late
+ * handling of one edge does not move the next.
+ *
+ * Uses TC0 channel 0 (TC0_Handler). DueTimer defines every TC handler, so it
+ * is no longer included anywhere. With -DDDS_DAC the DAC sample counter is
+ * the clock instead and edges land on whole samples (dac_synth.h).
+**/
+
+#ifndef TX_CLOCK_H
+#define TX_CLOCK_H
+
+#include <Arduino.h>
+
+#define TX_CLOCK_HZ 42000000UL       // MCK / 2
+#define TX_CLOCK_TICKS_PER_US 42
+
+// A point on the schedule: tick + frac / 1000 ticks
+struct tx_deadline_t {
+  uint32_t tick;
+  uint16_t frac;
+};
+
+void tx_clock_begin(void (*isr)());
+uint32_t tx_clock_now();
+void tx_clock_arm(uint32_t tick);
+unsigned long tx_clock_micros_at(uint32_t tick);
+
+// A duration on the schedule: ticks + frac / 1000 ticks
+struct tx_span_t {
+  uint32_t ticks;
+  uint16_t frac;
+};
+
+/**
+ * Exact length of a duration in ticks, worked out at compile time for the
+ * constant op tables so the interrupt only adds
+ * @param uint64_t ns - nanoseconds
+**/
+constexpr tx_span_t tx_span(uint64_t ns){
+  // 42 ticks per 1000 ns, in thousandths of a tick nothing is lost
+  return tx_span_t{ (uint32_t)(ns * TX_CLOCK_TICKS_PER_US / 1000), (uint16_t)(ns * TX_CLOCK_TICKS_PER_US % 1000) };
+}
+
+/**
+ * Move a deadline by an exact duration
+ * @param tx_deadline_t* d - deadline
+ * @param tx_span_t s - from tx_span()
+**/
+inline void tx_deadline_add(tx_deadline_t* d, tx_span_t s){
+  uint16_t frac = d->frac + s.frac;
+  uint16_t carry = frac >= 1000;
+  d->tick += s.ticks + carry;
+  d->frac = frac - carry * 1000;
+}
+
+/**
+ * Signed distance from a deadline to now, in thousandths of a tick
+ * @param tx_deadline_t* d - deadline
+ * @param uint32_t now - tx_clock_now() when the edge happened
+**/
+inline int32_t tx_deadline_error(const tx_deadline_t* d, uint32_t now){
+  return (int32_t)(now - d->tick) * 1000 - d->frac;
+}
+
+#endif
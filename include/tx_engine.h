@@ -0,0 +1,57 @@
+/**
+ * Interrupt-driven SSTV transmitter.
+ *
+ * The whole frame (VOX, VIS header, preamble and every line) is a sequence of
+ * constant op tables built at compile time from the mode descriptor: tuning
+ * words and durations already in clock ticks, with scan ops as the slots the
+ * line groups fill. The transmit clock interrupt walks them: each deadline
+ * sends one pixel or one tone and arms the next edge. The foreground never
+ * waits on an edge; it only keeps the line ring ahead of the interrupt with
+ * tx_queue_slot() / tx_queue_push(), and with the SPI stream backend also
+ * calls tx_service() to encode the next scan.
+ *
+ * Line groups go through the line ring (line_ring.h). The interrupt takes a
+ * new group at the tones marked Read; if none is published yet the last one
+ * is sent again and counted as an underrun.
+**/
+
+#ifndef TX_ENGINE_H
+#define TX_ENGINE_H
+
+#include <Arduino.h>
+#include "sstv_mode.h"
+#include "tx_clock.h"
+
+#define TX_GROUPS (Mode::lines / Mode::Layout::lines)
+
+// Op kinds
+#define TX_TONE 0
+#define TX_SCAN 1
+#define TX_END 2              // End of a table
+#define TX_OFF 3              // End of the frame
+
+// Op flags
+#define TX_ADVANCE 0x01       // Tone: take the next queued group
+#define TX_PREVIOUS 0x02      // Scan: pixels of the group taken before the current one
+
+struct tx_op_t {
+  uint8_t kind;
+  uint8_t flags;
+  uint16_t offset;            // Scan: first byte in the slot
+  uint16_t count;             // Scan: pixels
+  uint32_t word;              // Tone: tuning word
+  tx_span_t span;             // Tone: duration, Scan: whole run
+};
+
+void tx_begin();
+void tx_start();
+bool tx_busy();
+unsigned long tx_started_at();
+byte* tx_queue_slot();
+uint16_t tx_queue_depth();
+void tx_queue_push();
+void tx_service();
+unsigned long tx_bus_free_until();
+void tx_report();
+
+#endif
@@ -0,0 +1,120 @@
+#include <stdio.h>
+#include <vector>
+#include "AD9850.h"
+
+#define DDS_POWER_DOWN 0x04
+
+AD9850 DDS;
+
+static std::vector<sim_dds_event_t> events;
+static FILE* log_fp = 0;
+
+// Chip model state
+static uint8_t pin_clk, pin_fq_ud, pin_data;
+static uint8_t data_level, clk_level, fq_ud_level;
+static uint64_t shift_reg;
+
+static void latch(uint32_t word, uint8_t control){
+  sim_dds_event_t e;
+  e.t_ns = sim_now_ns();
+  e.word = word;
+  e.control = control;
+  events.push_back(e);
+  if(log_fp){
+    fprintf(log_fp, "%llu,%lu,%u,%.4f\n", (unsigned long long)e.t_ns,
+            (unsigned long)e.word, e.control, sim_dds_freq(&e));
+  }
+}
+
+/**
+ * Pin level change seen by the chip: shift DATA on W_CLK rising edges and
+ * latch the last 40 bits on the FQ_UD rising edge
+**/
+static void chip_pin(uint8_t pin, uint8_t val){
+  if(pin == pin_data){
+    data_level = val;
+  } else if(pin == pin_clk){
+    if(val && !clk_level){
+      shift_reg = (shift_reg >> 1) | ((uint64_t)(data_level & 1) << 39);
+    }
+    clk_level = val;
+  } else if(pin == pin_fq_ud){
+    if(val && !fq_ud_level){
+      latch((uint32_t)shift_reg, (uint8_t)(shift_reg >> 32));
+    }
+    fq_ud_level = val;
+  }
+}
+
+AD9850::AD9850() : calibFreq(EX_CLK), deltaphase(0), phase(0) {}
+
+void AD9850::begin(int w_clk, int fq_ud, int data, int reset){
+  (void)reset;
+  pin_clk = w_clk;
+  pin_fq_ud = fq_ud;
+  pin_data = data;
+  sim_pin_watch(pin_clk, chip_pin);
+  sim_pin_watch(pin_fq_ud, chip_pin);
+  sim_pin_watch(pin_data, chip_pin);
+  // Reset and enter serial mode, then power on at 0 Hz
+  sim_advance(sim_cost.dds_setfreq);
+  deltaphase = 0;
+  phase = 0;
+  latch(0, 0);
+}
+
+void AD9850::setfreq(double f, uint8_t p){
+  deltaphase = f * 4294967296.0 / calibFreq;
+  phase = p << 3;
+  sim_advance(sim_cost.dds_setfreq);
+  latch(deltaphase, phase);
+}
+
+void AD9850::down(){
+  sim_advance(sim_cost.dds_setfreq);
+  latch(deltaphase, phase | DDS_POWER_DOWN);
+}
+
+void AD9850::up(){
+  sim_advance(sim_cost.dds_setfreq);
+  latch(deltaphase, phase);
+}
+
+void AD9850::calibrate(double TrimFreq){
+  calibFreq = TrimFreq;
+}
+
+uint32_t sim_dds_event_count(){
+  return events.size();
+}
+
+const sim_dds_event_t* sim_dds_event(uint32_t i){
+  return i < events.size() ? &events[i] : 0;
+}
+
+double sim_dds_freq(const sim_dds_event_t* e){
+  if(e->control & DDS_POWER_DOWN){
+    return 0.0;
+  }
+  return e->word * EX_CLK / 4294967296.0;
+}
+
+void sim_dds_clear(){
+  events.clear();
+}
+
+bool sim_dds_log_open(const char* path){
+  log_fp = fopen(path, "w");
+  if(!log_fp){
+    return false;
+  }
+  fprintf(log_fp, "t_ns,word,control,freq_hz\n");
+  return true;
+}
+
+void sim_dds_log_close(){
+  if(log_fp){
+    fclose(log_fp);
+    log_fp = 0;
+  }
+}
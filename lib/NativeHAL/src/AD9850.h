@@ -0,0 +1,49 @@
+/**
+ * AD9850 stand-in with a recording chip model.
+ *
+ * The chip model decodes the serial load protocol from the W_CLK, FQ_UD and
+ * DATA pins exactly like the part does (40 bits, LSB first, latched on the
+ * FQ_UD rising edge), so anything that bit-bangs the pins is captured too.
+ * DDS.setfreq() latches the same word the real library would compute.
+ * Every latched word is recorded with its simulated timestamp.
+**/
+
+#ifndef AD9850_H_NATIVE
+#define AD9850_H_NATIVE
+
+#include "Arduino.h"
+
+#define EX_CLK 125000000.0   // AD9850 reference clock (Hz)
+
+struct sim_dds_event_t {
+  uint64_t t_ns;       // simulated time the word took effect
+  uint32_t word;       // 32 bit frequency tuning word
+  uint8_t control;     // phase << 3 | power down << 2
+};
+
+class AD9850 {
+  public:
+    AD9850();
+    void begin(int w_clk, int fq_ud, int data, int reset);
+    void setfreq(double f, uint8_t p);
+    void down();
+    void up();
+    void calibrate(double TrimFreq);
+
+  private:
+    double calibFreq;
+    uint32_t deltaphase;
+    uint8_t phase;
+};
+
+extern AD9850 DDS;
+
+// Recorded output
+uint32_t sim_dds_event_count();
+const sim_dds_event_t* sim_dds_event(uint32_t i);
+double sim_dds_freq(const sim_dds_event_t* e);
+void sim_dds_clear();
+bool sim_dds_log_open(const char* path);    // also stream events as CSV
+void sim_dds_log_close();
+
+#endif
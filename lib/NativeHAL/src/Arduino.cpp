@@ -0,0 +1,152 @@
+#include <stdio.h>
+#include "Arduino.h"
+
+#define SIM_PINS 80
+
+static uint8_t pin_state[SIM_PINS];
+static sim_pin_hook_t pin_hooks[SIM_PINS];
+
+HardwareSerial Serial("Serial");
+HardwareSerial Serial1("Serial1");
+HardwareSerial Serial2("Serial2");
+HardwareSerial Serial3("Serial3");
+
+void pinMode(uint8_t pin, uint8_t mode){
+  (void)pin;
+  (void)mode;
+}
+
+void digitalWrite(uint8_t pin, uint8_t val){
+  sim_advance(sim_cost.digital_write);
+  sim_pin_write(pin, val);
+}
+
+void sim_pin_write(uint8_t pin, uint8_t val){
+  if(pin >= SIM_PINS){
+    return;
+  }
+  pin_state[pin] = val ? HIGH : LOW;
+  if(pin_hooks[pin]){
+    pin_hooks[pin](pin, pin_state[pin]);
+  }
+}
+
+int digitalRead(uint8_t pin){
+  return pin < SIM_PINS ? pin_state[pin] : LOW;
+}
+
+void sim_pin_watch(uint8_t pin, sim_pin_hook_t hook){
+  if(pin < SIM_PINS){
+    pin_hooks[pin] = hook;
+  }
+}
+
+unsigned long millis(void){
+  sim_advance(sim_cost.micros_call);
+  return (unsigned long)(sim_now_ns() / 1000000ULL);
+}
+
+unsigned long micros(void){
+  sim_advance(sim_cost.micros_call);
+  return (unsigned long)(sim_now_ns() / 1000ULL);
+}
+
+void delay(unsigned long ms){
+  sim_advance((uint64_t)ms * 1000000ULL);
+}
+
+void delayMicroseconds(unsigned int us){
+  sim_advance((uint64_t)us * 1000ULL);
+}
+
+void yield(void){
+  sim_idle();
+}
+
+/** Print **/
+
+size_t Print::write(const uint8_t* buf, size_t size){
+  size_t n = 0;
+  while(size--){
+    n += write(*buf++);
+  }
+  return n;
+}
+
+size_t Print::printNumber(unsigned long n, int base){
+  char buf[8 * sizeof(long) + 1];
+  char* str = &buf[sizeof(buf) - 1];
+  *str = '\0';
+  if(base < 2){
+    base = 10;
+  }
+  do {
+    unsigned long m = n;
+    n /= base;
+    char c = m - base * n;
+    *--str = c < 10 ? c + '0' : c + 'A' - 10;
+  } while(n);
+  return write(str);
+}
+
+size_t Print::print(const char* s)                 { return write(s); }
+size_t Print::print(char c)                        { return write((uint8_t)c); }
+size_t Print::print(unsigned char n, int base)     { return printNumber(n, base); }
+size_t Print::print(int n, int base)               { return print((long)n, base); }
+size_t Print::print(unsigned int n, int base)      { return printNumber(n, base); }
+size_t Print::print(unsigned long n, int base)     { return printNumber(n, base); }
+
+size_t Print::print(long n, int base){
+  if(base == 10 && n < 0){
+    return write('-') + printNumber(-n, 10);
+  }
+  return printNumber(n, base);
+}
+
+size_t Print::print(double n, int digits){
+  char buf[48];
+  snprintf(buf, sizeof(buf), "%.*f", digits, n);
+  return write(buf);
+}
+
+size_t Print::println(void)                        { return write("\r\n"); }
+size_t Print::println(const char* s)               { return print(s) + println(); }
+size_t Print::println(char c)                      { return print(c) + println(); }
+size_t Print::println(unsigned char n, int base)   { return print(n, base) + println(); }
+size_t Print::println(int n, int base)             { return print(n, base) + println(); }
+size_t Print::println(unsigned int n, int base)    { return print(n, base) + println(); }
+size_t Print::println(long n, int base)            { return print(n, base) + println(); }
+size_t Print::println(unsigned long n, int base)   { return print(n, base) + println(); }
+size_t Print::println(double n, int digits)        { return print(n, digits) + println(); }
+
+/** HardwareSerial **/
+
+void HardwareSerial::begin(unsigned long baud){
+  _baud = baud;
+  if(_device){
+    _device->begin(baud);
+  }
+}
+
+int HardwareSerial::available(){
+  return _device ? _device->available() : 0;
+}
+
+int HardwareSerial::read(){
+  return _device ? _device->read() : -1;
+}
+
+int HardwareSerial::peek(){
+  return _device ? _device->peek() : -1;
+}
+
+size_t HardwareSerial::write(uint8_t c){
+  if(_device){
+    _device->receive(c);
+  } else if(this == &Serial){
+    if(c != '\r'){
+      fputc(c, stdout);
+    }
+  }
+  return 1;
+}
@@ -0,0 +1,138 @@
+/**
+ * Arduino core stand-in for the native build.
+ *
+ * Provides the subset of the Due core the firmware uses. Time only moves when
+ * the firmware spends it (see sim_clock.h), so polling loops on micros() and
+ * spins on volatile flags must call yield() to let interrupts run.
+**/
+
+#ifndef ARDUINO_H_NATIVE
+#define ARDUINO_H_NATIVE
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <math.h>
+#include <type_traits>
+#include "sim_clock.h"
+
+typedef uint8_t byte;
+typedef bool boolean;
+typedef uint16_t word;
+
+#define HIGH 0x1
+#define LOW  0x0
+
+#define INPUT 0x0
+#define OUTPUT 0x1
+#define INPUT_PULLUP 0x2
+
+#define DEC 10
+#define HEX 16
+#define OCT 8
+#define BIN 2
+
+#define F(s) (s)
+
+template<class A, class B> inline typename std::common_type<A, B>::type min(A a, B b) { return a < b ? a : b; }
+template<class A, class B> inline typename std::common_type<A, B>::type max(A a, B b) { return a > b ? a : b; }
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+int digitalRead(uint8_t pin);
+
+unsigned long millis(void);
+unsigned long micros(void);
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void yield(void);
+
+// Observe writes to a pin (used by the AD9850 chip model)
+typedef void (*sim_pin_hook_t)(uint8_t pin, uint8_t val);
+void sim_pin_watch(uint8_t pin, sim_pin_hook_t hook);
+void sim_pin_write(uint8_t pin, uint8_t val);   // direct port write, cost charged by caller
+
+class Print {
+  public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t c) = 0;
+    virtual size_t write(const uint8_t* buf, size_t size);
+    size_t write(const char* str) { return write((const uint8_t*)str, strlen(str)); }
+
+    size_t print(const char* s);
+    size_t print(char c);
+    size_t print(unsigned char n, int base = DEC);
+    size_t print(int n, int base = DEC);
+    size_t print(unsigned int n, int base = DEC);
+    size_t print(long n, int base = DEC);
+    size_t print(unsigned long n, int base = DEC);
+    size_t print(double n, int digits = 2);
+
+    size_t println(void);
+    size_t println(const char* s);
+    size_t println(char c);
+    size_t println(unsigned char n, int base = DEC);
+    size_t println(int n, int base = DEC);
+    size_t println(unsigned int n, int base = DEC);
+    size_t println(long n, int base = DEC);
+    size_t println(unsigned long n, int base = DEC);
+    size_t println(double n, int digits = 2);
+
+  private:
+    size_t printNumber(unsigned long n, int base);
+};
+
+class Stream : public Print {
+  public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+    virtual void flush() {}
+};
+
+#define SIM_UART_RX_BUFFER 128     // SERIAL_BUFFER_SIZE of the Due core
+
+/**
+ * Something plugged into a simulated UART (camera, GPS, console)
+**/
+class SimSerialDevice {
+  public:
+    virtual ~SimSerialDevice() {}
+    virtual void begin(unsigned long baud) { (void)baud; }
+    virtual void receive(uint8_t c) = 0;     // byte sent by the firmware
+    virtual int available() = 0;             // bytes ready for the firmware
+    virtual int read() = 0;
+    virtual int peek() = 0;
+};
+
+class HardwareSerial : public Stream {
+  public:
+    HardwareSerial(const char* name) : _name(name), _device(0), _baud(0) {}
+    void begin(unsigned long baud);
+    void end() {}
+    void attach(SimSerialDevice* device) { _device = device; }
+    unsigned long baud() const { return _baud; }
+
+    virtual int available();
+    virtual int read();
+    virtual int peek();
+    virtual size_t write(uint8_t c);
+    using Print::write;
+    operator bool() { return true; }
+
+  private:
+    const char* _name;
+    SimSerialDevice* _device;
+    unsigned long _baud;
+};
+
+extern HardwareSerial Serial;
+extern HardwareSerial Serial1;
+extern HardwareSerial Serial2;
+extern HardwareSerial Serial3;
+
+// Sketch entry points
+void setup(void);
+void loop(void);
+
+#endif
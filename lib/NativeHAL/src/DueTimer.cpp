@@ -0,0 +1,60 @@
+#include "DueTimer.h"
+
+DueTimer Timer0(0);
+DueTimer Timer1(1);
+DueTimer Timer2(2);
+DueTimer Timer3(3);
+DueTimer Timer4(4);
+DueTimer Timer5(5);
+
+DueTimer::DueTimer(unsigned short _timer) : timer(_timer), sim_id(-1), period_us(0), callback(0) {}
+
+DueTimer& DueTimer::attachInterrupt(void (*isr)()){
+  callback = isr;
+  if(sim_id < 0){
+    sim_id = sim_timer_add(isr);
+  }
+  return *this;
+}
+
+DueTimer& DueTimer::detachInterrupt(){
+  stop();
+  return *this;
+}
+
+DueTimer& DueTimer::start(double microseconds){
+  if(microseconds > 0){
+    setPeriod(microseconds);
+  }
+  if(sim_id >= 0 && period_us > 0){
+    // The TC runs from MCK/2, so the period is quantised to 42 MHz ticks
+    uint64_t ticks = (uint64_t)(period_us * 42.0 + 0.5);
+    sim_timer_start(sim_id, ticks * 1000ULL / 42ULL);
+  }
+  return *this;
+}
+
+DueTimer& DueTimer::stop(){
+  if(sim_id >= 0){
+    sim_timer_stop(sim_id);
+  }
+  return *this;
+}
+
+DueTimer& DueTimer::setFrequency(double frequency){
+  period_us = 1000000.0 / frequency;
+  return *this;
+}
+
+DueTimer& DueTimer::setPeriod(double microseconds){
+  period_us = microseconds;
+  return *this;
+}
+
+double DueTimer::getFrequency() const {
+  return 1000000.0 / period_us;
+}
+
+double DueTimer::getPeriod() const {
+  return period_us;
+}
@@ -0,0 +1,36 @@
+/**
+ * DueTimer stand-in: periodic interrupts on the simulated clock.
+**/
+
+#ifndef DUETIMER_H_NATIVE
+#define DUETIMER_H_NATIVE
+
+#include "Arduino.h"
+
+class DueTimer {
+  public:
+    DueTimer(unsigned short timer);
+    DueTimer& attachInterrupt(void (*isr)());
+    DueTimer& detachInterrupt();
+    DueTimer& start(double microseconds = -1);
+    DueTimer& stop();
+    DueTimer& setFrequency(double frequency);
+    DueTimer& setPeriod(double microseconds);
+    double getFrequency() const;
+    double getPeriod() const;
+
+  private:
+    unsigned short timer;
+    int sim_id;
+    double period_us;
+    void (*callback)();
+};
+
+extern DueTimer Timer0;
+extern DueTimer Timer1;
+extern DueTimer Timer2;
+extern DueTimer Timer3;
+extern DueTimer Timer4;
+extern DueTimer Timer5;
+
+#endif
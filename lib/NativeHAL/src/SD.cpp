@@ -0,0 +1,310 @@
+#include <stdio.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <dirent.h>
+#include "SD.h"
+
+#define SD_BLOCK 512
+
+sim_sd_stats_t sim_sd_stats;
+SDClass SD;
+
+struct SimFileState {
+  FILE* fp;
+  char name[13];
+  uint32_t pos;
+  uint32_t size;
+  uint32_t block;       // block held in the SdFat cache
+  int refs;
+};
+
+/**
+ * Charge simulated time to the card and account it
+**/
+static void sd_charge(uint64_t ns){
+  uint64_t t0 = sim_now_ns();
+  sim_advance(ns);
+  sim_sd_stats.busy_ns += sim_now_ns() - t0;
+}
+
+static void host_path(char* dst, size_t len, const char* root, const char* name){
+  while(*name == '/'){
+    name++;
+  }
+  snprintf(dst, len, "%s/%s", root, name);
+}
+
+File::File() : _state(0) {}
+
+File::File(const File& other) : _state(other._state){
+  if(_state){
+    _state->refs++;
+  }
+}
+
+File& File::operator=(const File& other){
+  if(this != &other){
+    if(other._state){
+      other._state->refs++;
+    }
+    if(_state && --_state->refs == 0){
+      delete _state;
+    }
+    _state = other._state;
+  }
+  return *this;
+}
+
+File::~File(){
+  if(_state && --_state->refs == 0){
+    if(_state->fp){
+      fclose(_state->fp);
+    }
+    delete _state;
+  }
+}
+
+/**
+ * Charge a block transfer for every block in [from, from + count) that is not
+ * the one already cached
+**/
+void File::touch(uint32_t from, uint32_t count, bool writing){
+  if(count == 0){
+    return;
+  }
+  uint32_t first = from / SD_BLOCK;
+  uint32_t last = (from + count - 1) / SD_BLOCK;
+  for(uint32_t b = first; b <= last; b++){
+    if(b != _state->block){
+      _state->block = b;
+      if(writing){
+        sim_sd_stats.blocks_written++;
+      } else {
+        sim_sd_stats.blocks_read++;
+      }
+      sd_charge(sim_cost.sd_block);
+    }
+  }
+}
+
+size_t File::write(uint8_t b){
+  return write(&b, 1);
+}
+
+size_t File::write(const uint8_t* buf, size_t size){
+  if(!_state || !_state->fp){
+    return 0;
+  }
+  sim_sd_stats.write_calls++;
+  sd_charge(size == 1 ? sim_cost.sd_write_byte : sim_cost.sd_call + size * 20);
+  if(SD._capacity > 0 && _state->pos + size > _state->size){
+    uint64_t room = SD._capacity > SD._used ? SD._capacity - SD._used : 0;
+    uint64_t grow = _state->pos + size - _state->size;
+    if(grow > room){
+      size -= grow - room;   // The card is full
+    }
+  }
+  touch(_state->pos, size, true);
+  fseek(_state->fp, _state->pos, SEEK_SET);
+  size_t n = fwrite(buf, 1, size, _state->fp);
+  _state->pos += n;
+  if(_state->pos > _state->size){
+    SD._used += _state->pos - _state->size;
+    _state->size = _state->pos;
+  }
+  sim_sd_stats.bytes_written += n;
+  return n;
+}
+
+int File::read(){
+  uint8_t b;
+  return read(&b, 1) == 1 ? b : -1;
+}
+
+int File::read(void* buf, uint16_t nbyte){
+  if(!_state || !_state->fp){
+    return -1;
+  }
+  sim_sd_stats.read_calls++;
+  uint32_t n = nbyte;
+  if(n > _state->size - _state->pos){
+    n = _state->size - _state->pos;
+  }
+  sd_charge(nbyte == 1 ? sim_cost.sd_read_byte : sim_cost.sd_call + n * 20);
+  touch(_state->pos, n, false);
+  fseek(_state->fp, _state->pos, SEEK_SET);
+  n = fread(buf, 1, n, _state->fp);
+  _state->pos += n;
+  sim_sd_stats.bytes_read += n;
+  return n;
+}
+
+int File::peek(){
+  if(!_state || !_state->fp || _state->pos >= _state->size){
+    return -1;
+  }
+  fseek(_state->fp, _state->pos, SEEK_SET);
+  return fgetc(_state->fp);
+}
+
+int File::available(){
+  if(!_state || !_state->fp){
+    return 0;
+  }
+  return _state->size - _state->pos;
+}
+
+void File::flush(){
+  if(_state && _state->fp){
+    fflush(_state->fp);
+  }
+}
+
+boolean File::seek(uint32_t pos){
+  if(!_state || !_state->fp || pos > _state->size){
+    return false;
+  }
+  _state->pos = pos;
+  return true;
+}
+
+uint32_t File::position(){
+  return _state ? _state->pos : 0;
+}
+
+uint32_t File::size(){
+  return _state ? _state->size : 0;
+}
+
+void File::close(){
+  if(_state && _state->fp){
+    fclose(_state->fp);
+    _state->fp = 0;
+  }
+}
+
+File::operator bool(){
+  return _state && _state->fp;
+}
+
+char* File::name(){
+  return _state ? _state->name : 0;
+}
+
+/** SDClass **/
+
+void SDClass::setRoot(const char* dir){
+  snprintf(_root, sizeof(_root), "%s", dir);
+}
+
+void SDClass::setCapacity(uint64_t bytes){
+  _capacity = bytes;
+}
+
+/**
+ * Bytes of the files under a host directory
+**/
+uint64_t SDClass::scan(const char* dir){
+  uint64_t total = 0;
+  DIR* d = opendir(dir);
+  if(!d){
+    return 0;
+  }
+  struct dirent* e;
+  while((e = readdir(d)) != 0){
+    if(strcmp(e->d_name, ".") == 0 || strcmp(e->d_name, "..") == 0){
+      continue;
+    }
+    char path[512];
+    struct stat st;
+    snprintf(path, sizeof(path), "%s/%s", dir, e->d_name);
+    if(stat(path, &st) != 0){
+      continue;
+    }
+    total += S_ISDIR(st.st_mode) ? scan(path) : (uint64_t)st.st_size;
+  }
+  closedir(d);
+  return total;
+}
+
+boolean SDClass::begin(uint8_t csPin){
+  (void)csPin;
+  if(_root[0] == '\0'){
+    setRoot("sdcard");
+  }
+  sd_charge(sim_cost.sd_open);
+  if(::mkdir(_root, 0755) != 0 && errno != EEXIST){
+    return false;
+  }
+  _used = scan(_root);
+  return true;
+}
+
+File SDClass::open(const char* filename, uint8_t mode){
+  char path[512];
+  host_path(path, sizeof(path), _root, filename);
+  sim_sd_stats.opens++;
+  sd_charge(sim_cost.sd_open);
+
+  File f;
+  FILE* fp;
+  if(mode & O_WRITE){
+    struct stat st;
+    if((mode & O_TRUNC) && stat(path, &st) == 0){
+      _used -= st.st_size;
+    }
+    fp = fopen(path, (mode & O_TRUNC) ? "w+b" : "r+b");
+    if(!fp && (mode & O_CREAT)){
+      fp = fopen(path, "w+b");
+    }
+  } else {
+    fp = fopen(path, "rb");
+  }
+  if(!fp){
+    return f;
+  }
+
+  f._state = new SimFileState();
+  f._state->fp = fp;
+  f._state->refs = 1;
+  f._state->block = UINT32_MAX;
+  snprintf(f._state->name, sizeof(f._state->name), "%s", filename);
+  fseek(fp, 0, SEEK_END);
+  f._state->size = ftell(fp);
+  // Arduino SD opens FILE_WRITE positioned at the end of the file
+  f._state->pos = (mode & O_WRITE) && !(mode & O_TRUNC) ? f._state->size : 0;
+  return f;
+}
+
+boolean SDClass::exists(const char* filepath){
+  char path[512];
+  struct stat st;
+  host_path(path, sizeof(path), _root, filepath);
+  sd_charge(sim_cost.sd_open);
+  return stat(path, &st) == 0;
+}
+
+boolean SDClass::mkdir(const char* filepath){
+  char path[512];
+  host_path(path, sizeof(path), _root, filepath);
+  return ::mkdir(path, 0755) == 0 || errno == EEXIST;
+}
+
+boolean SDClass::remove(const char* filepath){
+  char path[512];
+  struct stat st;
+  host_path(path, sizeof(path), _root, filepath);
+  sd_charge(sim_cost.sd_open);
+  if(stat(path, &st) != 0 || unlink(path) != 0){
+    return false;
+  }
+  _used -= st.st_size;
+  return true;
+}
+
+boolean SDClass::rmdir(const char* filepath){
+  char path[512];
+  host_path(path, sizeof(path), _root, filepath);
+  return ::rmdir(path) == 0;
+}
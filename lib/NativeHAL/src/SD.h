@@ -0,0 +1,96 @@
+/**
+ * SD library stand-in backed by a host directory (the "card").
+ *
+ * Mirrors the Arduino SD API and charges SdFat-like costs: a directory scan
+ * per open/exists, a fixed overhead per call and one block transfer for every
+ * 512 byte block a file access touches. With a capacity set (--sd-capacity)
+ * writes that would fill the card past it come back short, as on a full card.
+**/
+
+#ifndef SD_H_NATIVE
+#define SD_H_NATIVE
+
+#include "Arduino.h"
+
+#define O_READ   0x01
+#define O_RDONLY O_READ
+#define O_WRITE  0x02
+#define O_WRONLY O_WRITE
+#define O_RDWR   (O_READ | O_WRITE)
+#define O_APPEND 0x04
+#define O_CREAT  0x10
+#define O_TRUNC  0x40
+
+#define FILE_READ O_READ
+#define FILE_WRITE (O_READ | O_WRITE | O_CREAT)
+
+#define SD_CHIP_SELECT_PIN 53
+
+struct sim_sd_stats_t {
+  uint32_t opens;
+  uint32_t read_calls;
+  uint32_t write_calls;
+  uint32_t blocks_read;
+  uint32_t blocks_written;
+  uint64_t bytes_read;
+  uint64_t bytes_written;
+  uint64_t busy_ns;       // simulated time spent inside the SD library
+};
+
+extern sim_sd_stats_t sim_sd_stats;
+
+struct SimFileState;
+
+class File : public Stream {
+  public:
+    File();
+    File(const File& other);
+    File& operator=(const File& other);
+    ~File();
+
+    virtual size_t write(uint8_t b);
+    virtual size_t write(const uint8_t* buf, size_t size);
+    virtual int read();
+    virtual int peek();
+    virtual int available();
+    virtual void flush();
+    int read(void* buf, uint16_t nbyte);
+    boolean seek(uint32_t pos);
+    uint32_t position();
+    uint32_t size();
+    void close();
+    operator bool();
+    char* name();
+    using Print::write;
+
+  private:
+    friend class SDClass;
+    SimFileState* _state;
+    void touch(uint32_t from, uint32_t count, bool writing);
+};
+
+class SDClass {
+  public:
+    boolean begin(uint8_t csPin = SD_CHIP_SELECT_PIN);
+    File open(const char* filename, uint8_t mode = FILE_READ);
+    boolean exists(const char* filepath);
+    boolean mkdir(const char* filepath);
+    boolean remove(const char* filepath);
+    boolean rmdir(const char* filepath);
+
+    void setRoot(const char* dir);     // host directory backing the card
+    const char* root() const { return _root; }
+    void setCapacity(uint64_t bytes);  // 0 for no limit
+    uint64_t used() const { return _used; }
+
+  private:
+    friend class File;
+    char _root[256];
+    uint64_t _capacity;
+    uint64_t _used;                    // Bytes of every file on the card
+    uint64_t scan(const char* dir);
+};
+
+extern SDClass SD;
+
+#endif
@@ -0,0 +1,18 @@
+/**
+ * SPI stand-in: the SD stand-in does not go through the bus.
+**/
+
+#ifndef SPI_H_NATIVE
+#define SPI_H_NATIVE
+
+#include "Arduino.h"
+
+class SPIClass {
+  public:
+    void begin() {}
+    void end() {}
+};
+
+extern SPIClass SPI;
+
+#endif
@@ -0,0 +1,157 @@
+/**
+ * Host entry point: runs setup() and loop() against the stand-ins in
+ * simulated time and prints where the time went.
+ *
+ *   program [--sd DIR] [--sd-capacity BYTES] [--camera FILE.JPG] [--camera-script FILE]
+ *           [--gps FILE.NMEA]
+ *           [--dds-log FILE.csv] [--wav FILE.WAV] [--wav-rate HZ]
+ *           [--wav-bench RUNS] [--demod-image FILE.PPM] [--demod-lines FILE.csv]
+ *           [--run-seconds N] [--cost name=ns ...]
+ *   program --arena-plan
+ *
+ * --wav writes what the AD9850 sent as audio once the run is over, and
+ * --wav-bench times that rendering (see sim_wav.h); with the DAC synthesizer
+ * (-DDDS_DAC) --wav writes the samples it converted instead (see sim_dac.h).
+ * Every frame sent is received back by a Scottie demodulator and checked
+ * against what was queued and against its source JPEG decoded on the host
+ * (see sim_demod.h, sim_reference.h); --demod-image and --demod-lines keep
+ * what it saw.
+ * --gps replays an NMEA log as the GPS receiver (see sim_gps.h).
+ * --arena-plan prints the RAM each pipeline stage takes in the flags of this
+ * build (see arena.h) and exits without running.
+ *
+ * Exits 1 when one of the firmware's sim_check() self-checks failed.
+**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "Arduino.h"
+#include "SD.h"
+#include "AD9850.h"
+#include "sim_camera.h"
+#include "sim_gps.h"
+#include "sim_wav.h"
+#include "sim_dac.h"
+#include "sim_demod.h"
+
+// Firmware, arena.cpp
+void arena_plan();
+
+static void usage(const char* argv0){
+  fprintf(stderr, "usage: %s [--sd DIR] [--sd-capacity BYTES] [--camera FILE.JPG] [--camera-script FILE]"
+                  " [--gps FILE.NMEA] [--dds-log FILE.csv] [--wav FILE.WAV] [--wav-rate HZ] [--wav-bench RUNS]"
+                  " [--demod-image FILE.PPM] [--demod-lines FILE.csv]"
+                  " [--run-seconds N] [--cost name=ns]\n"
+                  "       %s --arena-plan\n", argv0, argv0);
+  exit(2);
+}
+
+static void report(uint64_t setup_ns){
+  uint64_t now = sim_now_ns();
+  fprintf(stderr, "\n--- simulated run ---\n");
+  fprintf(stderr, "setup()        %12.3f ms\n", setup_ns / 1e6);
+  fprintf(stderr, "total          %12.3f ms\n", now / 1e6);
+  fprintf(stderr, "dds words      %12lu\n", (unsigned long)sim_dds_event_count());
+  fprintf(stderr, "dac samples    %12llu\n", (unsigned long long)sim_dac_sample_count());
+  fprintf(stderr, "sd opens       %12lu\n", (unsigned long)sim_sd_stats.opens);
+  fprintf(stderr, "sd read calls  %12lu  %llu bytes  %lu blocks\n",
+          (unsigned long)sim_sd_stats.read_calls, (unsigned long long)sim_sd_stats.bytes_read,
+          (unsigned long)sim_sd_stats.blocks_read);
+  fprintf(stderr, "sd write calls %12lu  %llu bytes  %lu blocks\n",
+          (unsigned long)sim_sd_stats.write_calls, (unsigned long long)sim_sd_stats.bytes_written,
+          (unsigned long)sim_sd_stats.blocks_written);
+  fprintf(stderr, "sd busy        %12.3f ms\n", sim_sd_stats.busy_ns / 1e6);
+  fprintf(stderr, "sd used        %12llu bytes\n", (unsigned long long)SD.used());
+  sim_camera_report(stderr);
+  sim_gps_report(stderr);
+}
+
+int main(int argc, char** argv){
+  double run_seconds = 0;
+  const char* wav_path = 0;
+  unsigned long wav_rate = SIM_WAV_RATE;
+  unsigned long wav_runs = 0;
+  const char* demod_image = 0;
+  const char* demod_lines = 0;
+
+  for(int i = 1; i < argc; i++){
+    const char* arg = argv[i];
+    const char* val = i + 1 < argc ? argv[i + 1] : 0;
+    if(strcmp(arg, "--sd") == 0 && val){
+      SD.setRoot(val); i++;
+    } else if(strcmp(arg, "--sd-capacity") == 0 && val){
+      SD.setCapacity(strtoull(val, 0, 10)); i++;
+    } else if(strcmp(arg, "--camera") == 0 && val){
+      sim_camera_set_image(val); i++;
+    } else if(strcmp(arg, "--camera-script") == 0 && val){
+      if(!sim_camera_load_script(val)){
+        fprintf(stderr, "bad camera script %s\n", val);
+        return 2;
+      }
+      i++;
+    } else if(strcmp(arg, "--gps") == 0 && val){
+      if(!sim_gps_load_log(val)){
+        fprintf(stderr, "bad NMEA log %s\n", val);
+        return 2;
+      }
+      i++;
+    } else if(strcmp(arg, "--dds-log") == 0 && val){
+      if(!sim_dds_log_open(val)){
+        fprintf(stderr, "cannot write %s\n", val);
+        return 1;
+      }
+      i++;
+    } else if(strcmp(arg, "--wav") == 0 && val){
+      wav_path = val; i++;
+    } else if(strcmp(arg, "--wav-rate") == 0 && val){
+      wav_rate = strtoul(val, 0, 10); i++;
+    } else if(strcmp(arg, "--wav-bench") == 0 && val){
+      wav_runs = strtoul(val, 0, 10); i++;
+    } else if(strcmp(arg, "--demod-image") == 0 && val){
+      demod_image = val; i++;
+    } else if(strcmp(arg, "--demod-lines") == 0 && val){
+      demod_lines = val; i++;
+    } else if(strcmp(arg, "--run-seconds") == 0 && val){
+      run_seconds = atof(val); i++;
+    } else if(strcmp(arg, "--arena-plan") == 0){
+      arena_plan();
+      return 0;
+    } else if(strcmp(arg, "--cost") == 0 && val){
+      char name[32];
+      unsigned long ns;
+      if(sscanf(val, "%31[^=]=%lu", name, &ns) != 2 || !sim_set_cost(name, ns)){
+        fprintf(stderr, "unknown cost %s\n", val);
+        return 2;
+      }
+      i++;
+    } else {
+      usage(argv[0]);
+    }
+  }
+
+  sim_camera_attach(&Serial1);
+  sim_gps_attach(&Serial2);
+  setup();
+  uint64_t setup_ns = sim_now_ns();
+
+  uint64_t end = setup_ns + (uint64_t)(run_seconds * 1e9);
+  while(sim_now_ns() < end){
+    loop();
+    yield();
+  }
+
+  sim_dds_log_close();
+  report(setup_ns);
+  if(!sim_demod_run(demod_image, demod_lines)){
+    return 1;
+  }
+  bool dac = sim_dac_sample_count() > 0;
+  if(wav_path && !(dac ? sim_dac_write_wav(wav_path) : sim_wav_render(wav_path, wav_rate))){
+    fprintf(stderr, "cannot write %s\n", wav_path);
+    return 1;
+  }
+  if(wav_runs > 0){
+    sim_wav_bench(wav_rate, wav_runs);
+  }
+  return sim_check_failed() ? 1 : 0;
+}
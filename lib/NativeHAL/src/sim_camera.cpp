@@ -0,0 +1,337 @@
+#include <string.h>
+#include <stdlib.h>
+#include <deque>
+#include <utility>
+#include "sim_camera.h"
+
+#define VC0706_RESET 0x26
+#define VC0706_GEN_VERSION 0x11
+#define VC0706_SET_PORT 0x24
+#define VC0706_READ_FBUF 0x32
+#define VC0706_GET_FBUF_LEN 0x34
+#define VC0706_FBUF_CTRL 0x36
+#define VC0706_READ_DATA 0x30
+#define VC0706_WRITE_DATA 0x31
+
+static char image_path[256];
+
+struct sim_camera_script_t {
+  unsigned long max_baud;
+  unsigned long max_chunk;
+  unsigned long boot_ms;
+  unsigned long read_delay_us;
+  unsigned long drop_ms;
+  unsigned long drop_for_ms;
+};
+
+static sim_camera_script_t script = { 115200, 8192, 1000, 100, 0, 0 };
+
+/**
+ * Whether the camera answers a command at a time
+ * @param uint64_t at - simulated ns
+**/
+static bool answers(uint64_t at){
+  if(at < script.boot_ms * 1000000ULL){
+    return false;
+  }
+  uint64_t drop = script.drop_ms * 1000000ULL;
+  return script.drop_ms == 0 || at < drop ||
+         (script.drop_for_ms > 0 && at >= drop + script.drop_for_ms * 1000000ULL);
+}
+
+/**
+ * The camera on the other end of the UART
+**/
+class SimVC0706 : public SimSerialDevice {
+  public:
+    SimVC0706() : camBaud(38400), hostBaud(0), hostFree(0), camFree(0),
+                  imageSize(0x00), frame(0), frameLen(0),
+                  commands(0), bytesSent(0), overruns(0), garbled(0) {}
+
+    virtual void begin(unsigned long baud){
+      hostBaud = baud;
+    }
+
+    /**
+     * Picture size kept from before power on
+    **/
+    void set_size(uint8_t size){
+      imageSize = size;
+    }
+
+    /**
+     * Byte from the firmware: it reaches the camera once it is off the wire
+    **/
+    virtual void receive(uint8_t c){
+      uint64_t at = max(sim_now_ns(), hostFree) + byte_ns(hostBaud);
+      hostFree = at;
+      if(hostBaud != camBaud){
+        garbled++;
+        cmd.clear();
+        return;
+      }
+      cmd.push_back(c);
+      if(cmd[0] != 0x56){
+        cmd.clear();
+        return;
+      }
+      if(cmd.size() >= 4 && cmd.size() == 4u + cmd[3]){
+        if(answers(at)){
+          execute(at + sim_cost.cam_command);
+        }
+        cmd.clear();
+      }
+    }
+
+    virtual int available(){
+      sync();
+      return ring.size();
+    }
+
+    virtual int read(){
+      sync();
+      if(ring.empty()){
+        return -1;
+      }
+      uint8_t c = ring.front();
+      ring.pop_front();
+      return c;
+    }
+
+    virtual int peek(){
+      sync();
+      return ring.empty() ? -1 : ring.front();
+    }
+
+    void report(FILE* out){
+      fprintf(out, "camera         %12lu commands  %lu bytes sent  %lu overruns  %lu garbled  %lu baud\n",
+              commands, bytesSent, overruns, garbled, camBaud);
+    }
+
+  private:
+    std::deque<uint8_t> cmd;                           // Command being received
+    std::deque<std::pair<uint64_t, uint8_t> > wire;    // Reply bytes and when they arrive
+    std::deque<uint8_t> ring;                          // Firmware receive ring
+    unsigned long camBaud;
+    unsigned long hostBaud;
+    uint64_t hostFree;      // Firmware to camera line free
+    uint64_t camFree;       // Camera to firmware line free
+    uint8_t imageSize;
+    FILE* frame;            // Frozen frame
+    uint32_t frameLen;
+    unsigned long commands;
+    unsigned long bytesSent;
+    unsigned long overruns;
+    unsigned long garbled;
+
+    static uint64_t byte_ns(unsigned long baud){
+      return baud ? 10 * 1000000000ULL / baud : 0;
+    }
+
+    /**
+     * Move the bytes that have arrived by now into the ring
+    **/
+    void sync(){
+      uint64_t now = sim_now_ns();
+      while(!wire.empty() && wire.front().first <= now){
+        if(ring.size() >= SIM_UART_RX_BUFFER){
+          overruns++;
+        } else {
+          ring.push_back(wire.front().second);
+        }
+        wire.pop_front();
+      }
+    }
+
+    void send(uint64_t at, uint8_t c){
+      at = max(at, camFree) + byte_ns(camBaud);
+      camFree = at;
+      if(hostBaud != camBaud){
+        c ^= 0xA5;
+        garbled++;
+      }
+      wire.push_back(std::make_pair(at, c));
+      bytesSent++;
+    }
+
+    void reply(uint64_t at, uint8_t id, uint8_t status, const uint8_t* data, uint8_t n){
+      send(at, 0x76);
+      send(at, 0x00);
+      send(at, id);
+      send(at, status);
+      send(at, n);
+      for(uint8_t i = 0; i < n; i++){
+        send(at, data[i]);
+      }
+    }
+
+    static unsigned long baud_of(uint16_t code){
+      switch(code){
+        case 0xAEC8: return 9600;
+        case 0x56E4: return 19200;
+        case 0x2AF2: return 38400;
+        case 0x1C4C: return 57600;
+        case 0x0DA6: return 115200;
+      }
+      return 0;
+    }
+
+    void freeze(){
+      if(frame){
+        fclose(frame);
+      }
+      frame = fopen(image_path, "rb");
+      frameLen = 0;
+      if(frame){
+        fseek(frame, 0, SEEK_END);
+        frameLen = ftell(frame);
+      }
+    }
+
+    void read_fbuf(uint64_t at){
+      // 56 00 32 0C 00 0A a3 a2 a1 a0 n3 n2 n1 n0 delay
+      uint32_t addr = (uint32_t)cmd[6] << 24 | (uint32_t)cmd[7] << 16 | cmd[8] << 8 | cmd[9];
+      uint32_t len = (uint32_t)cmd[10] << 24 | (uint32_t)cmd[11] << 16 | cmd[12] << 8 | cmd[13];
+      static const uint8_t mark[] = { 0x76, 0x00, VC0706_READ_FBUF, 0x00, 0x00 };
+
+      for(uint8_t i = 0; i < 5; i++){
+        send(at, mark[i]);
+      }
+      at = camFree + script.read_delay_us * 1000ULL;
+      uint32_t n = min(len, (uint32_t)script.max_chunk);
+      for(uint32_t i = 0; i < n; i++){
+        int c = -1;
+        if(frame && addr + i < frameLen){
+          fseek(frame, addr + i, SEEK_SET);
+          c = fgetc(frame);
+        }
+        send(at, c < 0 ? 0 : c);
+      }
+      if(n < len){
+        return;  // Camera buffer limit: no trailer
+      }
+      for(uint8_t i = 0; i < 5; i++){
+        send(at, mark[i]);
+      }
+    }
+
+    void execute(uint64_t at){
+      commands++;
+      uint8_t id = cmd[2];
+      switch(id){
+        case VC0706_RESET:
+        case VC0706_WRITE_DATA:
+          // 56 00 31 05 04 01 00 19 size
+          if(id == VC0706_WRITE_DATA && cmd[3] == 5 && cmd[7] == 0x19){
+            imageSize = cmd[8];
+          }
+          reply(at, id, 0, 0, 0);
+          break;
+        case VC0706_GEN_VERSION: {
+          static const uint8_t version[] = "VC0703 1.00";
+          reply(at, id, 0, version, 11);
+          break;
+        }
+        case VC0706_READ_DATA:
+          reply(at, id, 0, &imageSize, 1);
+          break;
+        case VC0706_SET_PORT: {
+          unsigned long baud = cmd[3] == 3 ? baud_of(cmd[5] << 8 | cmd[6]) : 0;
+          if(baud == 0 || baud > script.max_baud){
+            reply(at, id, 3, 0, 0);
+          } else {
+            reply(at, id, 0, 0, 0);
+            camBaud = baud;   // After the ack is on the wire
+          }
+          break;
+        }
+        case VC0706_FBUF_CTRL:
+          if(cmd[4] == 0x00){
+            freeze();
+          }
+          reply(at, id, 0, 0, 0);
+          break;
+        case VC0706_GET_FBUF_LEN: {
+          uint8_t len[4] = { (uint8_t)(frameLen >> 24), (uint8_t)(frameLen >> 16),
+                             (uint8_t)(frameLen >> 8), (uint8_t)frameLen };
+          reply(at, id, 0, len, 4);
+          break;
+        }
+        case VC0706_READ_FBUF:
+          if(cmd[3] == 12){
+            read_fbuf(at);
+          }
+          break;
+        default:
+          reply(at, id, 1, 0, 0);
+      }
+    }
+};
+
+static SimVC0706 camera;
+
+void sim_camera_set_image(const char* path){
+  snprintf(image_path, sizeof(image_path), "%s", path);
+}
+
+/**
+ * Host file of the picture, 0 if none was set
+**/
+const char* sim_camera_image(){
+  return image_path[0] ? image_path : 0;
+}
+
+/**
+ * Read a camera script
+ * @param const char* path - host file
+ * @return bool - false if it could not be read or has an unknown key
+**/
+bool sim_camera_load_script(const char* path){
+  FILE* f = fopen(path, "r");
+  if(!f){
+    return false;
+  }
+  char line[128];
+  bool ok = true;
+  while(fgets(line, sizeof(line), f)){
+    char* hash = strchr(line, '#');
+    if(hash){
+      *hash = '\0';
+    }
+    char key[32];
+    unsigned long value;
+    int n = sscanf(line, "%31s %lu", key, &value);
+    if(n <= 0){
+      continue;
+    }
+    if(n != 2){
+      ok = false;
+    } else if(strcmp(key, "max_baud") == 0){
+      script.max_baud = value;
+    } else if(strcmp(key, "max_chunk") == 0){
+      script.max_chunk = value;
+    } else if(strcmp(key, "boot_ms") == 0){
+      script.boot_ms = value;
+    } else if(strcmp(key, "read_delay_us") == 0){
+      script.read_delay_us = value;
+    } else if(strcmp(key, "drop_ms") == 0){
+      script.drop_ms = value;
+    } else if(strcmp(key, "drop_for_ms") == 0){
+      script.drop_for_ms = value;
+    } else if(strcmp(key, "image_size") == 0){
+      camera.set_size(value);
+    } else {
+      ok = false;
+    }
+  }
+  fclose(f);
+  return ok;
+}
+
+void sim_camera_attach(HardwareSerial* port){
+  port->attach(&camera);
+}
+
+void sim_camera_report(FILE* out){
+  camera.report(out);
+}
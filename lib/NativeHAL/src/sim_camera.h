@@ -0,0 +1,35 @@
+/**
+ * VC0706 camera stand-in speaking the serial protocol on Serial1.
+ *
+ * Commands written by the firmware are decoded byte by byte and answered the
+ * way the camera does, with every byte timed on the wire at the current baud
+ * rate (10 bits per byte) after sim_cost.cam_command of processing. Replies
+ * land in a 128 byte receive ring like the Due core's; bytes that arrive
+ * while it is full are lost and counted as overruns. While the firmware's
+ * UART and the camera disagree on the baud rate every byte is garbled.
+ *
+ * The picture is a host file (--camera). A script (--camera-script) sets how
+ * the camera behaves, one "key value" per line, # starts a comment:
+ *
+ *   max_baud 115200    fastest rate SET_PORT accepts (default 115200)
+ *   max_chunk 8192     READ_FBUF replies longer than this are cut short
+ *   boot_ms 1000       no reply to anything before this time after power on
+ *   read_delay_us 100  gap between a READ_FBUF reply header and its data
+ *   drop_ms 0          no reply to anything from this time after power on
+ *   drop_for_ms 0      ... for this long, then as before (0 is for good)
+ *   image_size 0       picture size register at power on (17 is 320x240)
+**/
+
+#ifndef SIM_CAMERA_H
+#define SIM_CAMERA_H
+
+#include <stdio.h>
+#include "Arduino.h"
+
+void sim_camera_set_image(const char* path);
+const char* sim_camera_image();
+bool sim_camera_load_script(const char* path);
+void sim_camera_attach(HardwareSerial* port);
+void sim_camera_report(FILE* out);
+
+#endif
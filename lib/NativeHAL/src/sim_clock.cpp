@@ -0,0 +1,202 @@
+#include "sim_clock.h"
+#include <string.h>
+#include <stdio.h>
+#include <chrono>
+
+#define SIM_MAX_TIMERS 9    // TC0..TC2 x 3 channels, like the Due
+
+sim_costs_t sim_cost = {
+  120000,   // dds_setfreq
+  6000,     // dds_write
+  1100,     // digital_write
+  300,      // micros_call
+  400,      // isr_entry
+  2500,     // sd_read_byte
+  3000,     // sd_write_byte
+  4000,     // sd_call
+  1100000,  // sd_block
+  12000000, // sd_open
+  5000000,  // cam_command
+  100,      // dac_sample
+  9766,     // jpeg_mcu_px, 2.5 ms a 16x16 MCU
+  300000    // jpeg_mcu_dc
+};
+
+struct sim_timer_t {
+  sim_isr_t isr;
+  uint64_t period;
+  uint64_t deadline;
+  bool running;
+  bool hw;
+};
+
+static uint64_t now_ns = 0;
+static bool in_isr = false;
+static sim_timer_t timers[SIM_MAX_TIMERS];
+static int timer_count = 0;
+static bool check_failed = false;
+
+uint64_t sim_now_ns(){
+  return now_ns;
+}
+
+/**
+ * Real time of the host, for benchmarks of the code itself
+**/
+uint64_t sim_host_ns(){
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+bool sim_in_isr(){
+  return in_isr;
+}
+
+/**
+ * Earliest running timer due at or before limit, -1 if none
+**/
+static int next_timer(uint64_t limit){
+  int best = -1;
+  for(int i = 0; i < timer_count; i++){
+    if(timers[i].running && timers[i].deadline <= limit){
+      if(best < 0 || timers[i].deadline < timers[best].deadline){
+        best = i;
+      }
+    }
+  }
+  return best;
+}
+
+static void fire(int id){
+  sim_timer_t* t = &timers[id];
+  if(now_ns < t->deadline){
+    now_ns = t->deadline;
+  }
+  t->deadline += t->period;
+  if(t->period == 0){
+    t->running = false;   // one shot, the handler may re-arm it
+  }
+  if(t->hw){
+    t->isr();
+    return;
+  }
+  in_isr = true;
+  now_ns += sim_cost.isr_entry;
+  t->isr();
+  in_isr = false;
+}
+
+/**
+ * Charge ns of CPU time. Inside a handler the time simply accumulates; in the
+ * foreground any timer falling due is serviced first and the foreground work
+ * finishes that much later.
+ * @param uint64_t ns - cost in nanoseconds
+**/
+void sim_advance(uint64_t ns){
+  if(in_isr){
+    now_ns += ns;
+    return;
+  }
+
+  uint64_t remaining = ns;
+  for(;;){
+    int id = next_timer(now_ns + remaining);
+    if(id < 0){
+      now_ns += remaining;
+      return;
+    }
+    if(timers[id].deadline > now_ns){
+      remaining -= timers[id].deadline - now_ns;
+    }
+    fire(id);
+  }
+}
+
+/**
+ * Foreground is spinning on a flag: skip straight to the next interrupt
+**/
+void sim_idle(){
+  if(in_isr){
+    return;
+  }
+  int id = next_timer(UINT64_MAX);
+  if(id < 0){
+    now_ns += 1000;
+    return;
+  }
+  fire(id);
+}
+
+bool sim_set_cost(const char* name, uint32_t ns){
+  struct { const char* name; uint32_t* field; } table[] = {
+    { "dds_setfreq",   &sim_cost.dds_setfreq },
+    { "dds_write",     &sim_cost.dds_write },
+    { "digital_write", &sim_cost.digital_write },
+    { "micros_call",   &sim_cost.micros_call },
+    { "isr_entry",     &sim_cost.isr_entry },
+    { "sd_read_byte",  &sim_cost.sd_read_byte },
+    { "sd_write_byte", &sim_cost.sd_write_byte },
+    { "sd_call",       &sim_cost.sd_call },
+    { "sd_block",      &sim_cost.sd_block },
+    { "sd_open",       &sim_cost.sd_open },
+    { "cam_command",   &sim_cost.cam_command },
+    { "dac_sample",    &sim_cost.dac_sample },
+    { "jpeg_mcu_px",   &sim_cost.jpeg_mcu_px },
+    { "jpeg_mcu_dc",   &sim_cost.jpeg_mcu_dc },
+  };
+  for(unsigned i = 0; i < sizeof(table) / sizeof(table[0]); i++){
+    if(strcmp(table[i].name, name) == 0){
+      *table[i].field = ns;
+      return true;
+    }
+  }
+  return false;
+}
+
+int sim_timer_add(sim_isr_t isr){
+  if(timer_count >= SIM_MAX_TIMERS){
+    return -1;
+  }
+  timers[timer_count].isr = isr;
+  timers[timer_count].running = false;
+  timers[timer_count].hw = false;
+  return timer_count++;
+}
+
+int sim_timer_add_hw(sim_isr_t isr){
+  int id = sim_timer_add(isr);
+  if(id >= 0){
+    timers[id].hw = true;
+  }
+  return id;
+}
+
+void sim_timer_start(int id, uint64_t period_ns){
+  timers[id].period = period_ns;
+  timers[id].deadline = now_ns + period_ns;
+  timers[id].running = true;
+}
+
+void sim_timer_stop(int id){
+  timers[id].running = false;
+}
+
+/**
+ * Fire once at an absolute time (now if it already passed)
+ * @param int id - timer
+ * @param uint64_t deadline_ns - simulated time
+**/
+void sim_timer_at(int id, uint64_t deadline_ns){
+  timers[id].period = 0;
+  timers[id].deadline = deadline_ns;
+  timers[id].running = true;
+}
+
+void sim_check(bool ok, const char* what){
+  fprintf(stderr, "check %-40s %s\n", what, ok ? "ok" : "FAILED");
+  check_failed = check_failed || !ok;
+}
+
+bool sim_check_failed(){
+  return check_failed;
+}
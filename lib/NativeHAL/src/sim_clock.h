@@ -0,0 +1,60 @@
+/**
+ * Simulated time base for the native build.
+ *
+ * Every stand-in charges its modelled cost to this clock instead of taking
+ * real time, so a full capture -> decode -> transmit run is reproducible and
+ * every timing number is exact. Timer interrupts are fired from inside
+ * sim_advance() at their deadline, and the time the handler charges is stolen
+ * from the foreground exactly as it would be on the Due.
+**/
+
+#ifndef SIM_CLOCK_H
+#define SIM_CLOCK_H
+
+#include <stdint.h>
+
+typedef void (*sim_isr_t)(void);
+
+/**
+ * Modelled cost (nanoseconds) of the slow operations on a Due at 84 MHz.
+ * Defaults are bench figures; override with --cost name=ns on the command line.
+**/
+struct sim_costs_t {
+  uint32_t dds_setfreq;       // DDS.setfreq(): double maths + 40 bit bit-bang
+  uint32_t dds_write;         // dds_write(): 40 bits through direct port writes
+  uint32_t digital_write;     // digitalWrite()
+  uint32_t micros_call;       // one micros()/millis() poll
+  uint32_t isr_entry;         // interrupt entry + exit
+  uint32_t sd_read_byte;      // File::read() single byte from the cache
+  uint32_t sd_write_byte;     // File::write() single byte into the cache
+  uint32_t sd_call;           // fixed overhead of a buffered File::read/write call
+  uint32_t sd_block;          // one 512 byte block transfer to/from the card
+  uint32_t sd_open;           // SD.open()/SD.exists() directory scan
+  uint32_t cam_command;       // VC0706 processing before it answers a command
+  uint32_t dac_sample;        // one sample of the DAC synthesizer's oscillator
+  uint32_t jpeg_mcu_px;       // JpegDec.read(): full IDCT, per pixel of the MCU
+  uint32_t jpeg_mcu_dc;       // JpegDec.read(): one reduced (DC only) MCU
+};
+
+extern sim_costs_t sim_cost;
+
+uint64_t sim_now_ns();
+void sim_advance(uint64_t ns);       // charge foreground (or ISR) time
+void sim_idle();                     // jump to the next timer deadline
+bool sim_in_isr();
+uint64_t sim_host_ns();              // host steady clock, not simulated
+bool sim_set_cost(const char* name, uint32_t ns);
+
+// Periodic timers (backing DueTimer). Hardware timers model peripherals
+// clocked by DMA: their callback costs no CPU time.
+int sim_timer_add(sim_isr_t isr);
+int sim_timer_add_hw(sim_isr_t isr);
+void sim_timer_start(int id, uint64_t period_ns);
+void sim_timer_at(int id, uint64_t deadline_ns);   // one shot, absolute
+void sim_timer_stop(int id);
+
+// Self-checks run by the firmware; a failed one makes the program exit 1
+void sim_check(bool ok, const char* what);
+bool sim_check_failed();
+
+#endif
@@ -0,0 +1,82 @@
+#include <stdio.h>
+#include "sim_dac.h"
+#include "sim_wav.h"
+
+#define DAC_CODE_MID 2048           // Silence
+#define DAC_PCM_GAIN 16             // 12 bit codes to 16 bit PCM
+
+static std::vector<sim_dac_run_t> runs;
+
+/**
+ * Record samples converted by the DAC
+ * @param const uint16_t* codes - DAC codes, one per sample
+ * @param uint32_t count - samples
+ * @param uint64_t t0_ns - simulated time of the first one
+ * @param uint32_t period_ns - sample period
+**/
+void sim_dac_play(const uint16_t* codes, uint32_t count, uint64_t t0_ns, uint32_t period_ns){
+  sim_dac_run_t* last = runs.empty() ? 0 : &runs.back();
+  if(!last || last->period_ns != period_ns || last->t_ns + (uint64_t)last->codes.size() * period_ns != t0_ns){
+    runs.push_back(sim_dac_run_t{ t0_ns, period_ns, std::vector<uint16_t>() });
+    last = &runs.back();
+  }
+  last->codes.insert(last->codes.end(), codes, codes + count);
+}
+
+uint32_t sim_dac_run_count(){
+  return runs.size();
+}
+
+const sim_dac_run_t* sim_dac_run(uint32_t i){
+  return &runs[i];
+}
+
+uint64_t sim_dac_sample_count(){
+  uint64_t n = 0;
+  for(const sim_dac_run_t& r : runs){
+    n += r.codes.size();
+  }
+  return n;
+}
+
+/**
+ * Write the recorded output as a WAV file at the sample rate of the first
+ * run, the stops between runs as silence
+ * @param const char* path - host file
+ * @return bool - false if the file could not be written or nothing was sent
+**/
+bool sim_dac_write_wav(const char* path){
+  if(runs.empty()){
+    return false;
+  }
+  FILE* fp = fopen(path, "wb");
+  if(!fp){
+    return false;
+  }
+  uint32_t period = runs[0].period_ns;
+  uint32_t rate = 1000000000UL / period;
+  sim_wav_header(fp, rate, 0);
+
+  uint64_t samples = 0;
+  int16_t pcm;
+  for(const sim_dac_run_t& r : runs){
+    uint64_t at = (r.t_ns - runs[0].t_ns) / period;
+    for(pcm = 0; samples < at; samples++){
+      fwrite(&pcm, 2, 1, fp);
+    }
+    for(uint16_t code : r.codes){
+      pcm = (int16_t)((code - DAC_CODE_MID) * DAC_PCM_GAIN);
+      fwrite(&pcm, 2, 1, fp);     // Hosts are little endian, like WAV
+    }
+    samples += r.codes.size();
+  }
+
+  fseek(fp, 0, SEEK_SET);
+  sim_wav_header(fp, rate, samples);
+  bool ok = ferror(fp) == 0;
+  fclose(fp);
+
+  fprintf(stderr, "wav            %12.3f s audio  %llu samples at %lu Hz from the DAC\n",
+          (double)samples / rate, (unsigned long long)samples, (unsigned long)rate);
+  return ok;
+}
@@ -0,0 +1,30 @@
+/**
+ * Recorder of the Due's DAC0 output for the native build.
+ *
+ * The DAC synthesizer (dac_synth.h) hands every buffer over as the PDC
+ * stand-in finishes converting it, with the simulated time of its first
+ * sample. Buffers that follow each other without a gap join into one run;
+ * the clock stopping between frames starts a new one. The runs are what the
+ * loopback receiver demodulates (sim_demod.h) and what --wav writes instead
+ * of the AD9850 rendering.
+**/
+
+#ifndef SIM_DAC_H
+#define SIM_DAC_H
+
+#include <stdint.h>
+#include <vector>
+
+struct sim_dac_run_t {
+  uint64_t t_ns;                    // Simulated time of the first sample
+  uint32_t period_ns;               // Between samples
+  std::vector<uint16_t> codes;      // 12 bit DAC codes
+};
+
+void sim_dac_play(const uint16_t* codes, uint32_t count, uint64_t t0_ns, uint32_t period_ns);
+uint32_t sim_dac_run_count();
+const sim_dac_run_t* sim_dac_run(uint32_t i);
+uint64_t sim_dac_sample_count();
+bool sim_dac_write_wav(const char* path);
+
+#endif
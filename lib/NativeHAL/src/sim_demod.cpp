@@ -0,0 +1,513 @@
+#include <stdio.h>
+#include <math.h>
+#include <vector>
+#include <algorithm>
+#include "sim_demod.h"
+#include "AD9850.h"
+#include "sim_dac.h"
+#include "sim_reference.h"
+
+#define WIDTH 320                   // Pixels per scan
+#define LINES 256                   // Scottie lines per frame
+#define BLACK_FREQ 1500.0
+#define WHITE_FREQ 2300.0
+#define TOLERANCE 50.0              // Hz either side of a tone
+
+#define MS 1000000LL                // Nanoseconds
+#define SYNC_FREQ 1200.0
+#define SYNC_NS (9 * MS)
+#define SEPARATOR_NS (3 * MS / 2)   // Also the porch after the sync
+#define LEADER_FREQ 1900.0
+#define LEADER_NS (300 * MS)
+#define BREAK_NS (10 * MS)
+#define VIS_BIT_NS (30 * MS)
+
+#define SYNC_SEARCH_NS (5 * MS)     // Sync found this far from where it is due
+#define PSNR_MIN 40.0               // dB, every channel
+#define PSNR_LOSSLESS 99.0          // Reported for identical channels
+#define OVERLAY_LINES 27            // Header and footer bands over the picture
+#define WHITE_MIN 240               // Every pixel of a line sent white at least this
+
+// Phase of the DAC output
+#define DAC_GUESS_FREQ 1900.0       // Before the first tone, Hz
+#define DAC_MAX_FREQ 3000.0         // Highest phase step taken as the tone, Hz
+#define DAC_MIN_WEIGHT 1e-3         // Of a sample at a peak of the sine
+#define DAC_STEP_SAMPLES 10         // Samples per step of frequency
+#define DAC_EDGE_WINDOW 16          // Samples the lines either side of a tone start go through
+#define DAC_EDGE_PASSES 6
+
+// Scottie modes by VIS code
+struct sim_scottie_t {
+  uint8_t vis;
+  const char* name;
+  uint32_t pixelNs;
+};
+
+static const sim_scottie_t modes[] = {
+  { 60, "Scottie 1", 432000 },
+  { 56, "Scottie 2", 275200 },
+  { 76, "Scottie DX", 1080000 }
+};
+
+// Frame queued by the firmware
+static bool framed = false;
+static uint64_t frameAt;            // Simulated time the last frame started
+static uint8_t sentVis;
+static uint8_t sentGroupLines;
+static uint16_t sentGroupBytes;
+static std::vector<uint8_t> sent;   // Groups back to back
+
+// Recorded output as steps of frequency
+static std::vector<int64_t> stepAt;
+static std::vector<double> stepFreq;
+
+// Recorded DAC output: unwrapped phase of every sample of the last frame
+static std::vector<double> samplePhase;   // Cycles
+static std::vector<float> sampleWeight;   // How well the code gives it, 1 at 0 V
+static int64_t sampleAt0;                 // ns of the first sample
+static double samplePeriod;               // ns
+
+/**
+ * Start recording a frame, called by the transmitter as it starts
+ * @param uint8_t vis - mode of the frame
+ * @param uint8_t groupLines - picture lines per group
+ * @param uint16_t groupBytes - layout bytes of a group
+**/
+void sim_frame_begin(uint8_t vis, uint8_t groupLines, uint16_t groupBytes){
+  framed = true;
+  frameAt = sim_now_ns();
+  sentVis = vis;
+  sentGroupLines = groupLines;
+  sentGroupBytes = groupBytes;
+  sent.clear();
+  sim_reference_begin();
+}
+
+/**
+ * Record the next group, as it is handed to the transmitter
+ * @param const uint8_t* group - groupBytes laid out as the mode sends them
+**/
+void sim_frame_group(const uint8_t* group){
+  sent.insert(sent.end(), group, group + sentGroupBytes);
+}
+
+static bool near(double f, double tone){
+  return fabs(f - tone) < TOLERANCE;
+}
+
+/**
+ * Phase of the DAC output at a time, between samples it runs on at the
+ * frequency of the earlier one
+ * @param int64_t t - ns
+ * @return double - cycles
+**/
+static double phase_at(int64_t t){
+  double x = std::max(0.0, (t - sampleAt0) / samplePeriod);
+  size_t i = std::min((size_t)x, samplePhase.size() - 2);
+  return samplePhase[i] + (samplePhase[i + 1] - samplePhase[i]) * (x - i);
+}
+
+/**
+ * Mean frequency over a stretch of time, as a boxcar filter sees it
+ * @param int64_t from - ns
+ * @param int64_t to - ns, after from
+**/
+static double mean_freq(int64_t from, int64_t to){
+  if(!samplePhase.empty()){
+    return (phase_at(to) - phase_at(from)) * 1e9 / (to - from);
+  }
+  size_t i = std::upper_bound(stepAt.begin(), stepAt.end(), from) - stepAt.begin();
+  i = i > 0 ? i - 1 : 0;
+  double sum = 0;
+  for(int64_t t = from; t < to && i < stepAt.size(); i++){
+    int64_t end = i + 1 < stepAt.size() ? std::min(stepAt[i + 1], to) : to;
+    if(end > t){
+      sum += stepFreq[i] * (end - t);
+      t = end;
+    }
+  }
+  return sum / (to - from);
+}
+
+/**
+ * Stretch of one tone starting at a step
+ * @param size_t* i - first step, moved past the stretch
+ * @return int64_t - ns it lasts, 0 if the step is not the tone
+**/
+static int64_t tone_run(size_t* i, double tone){
+  size_t s = *i;
+  while(*i < stepAt.size() && near(stepFreq[*i], tone)){
+    (*i)++;
+  }
+  if(*i == s){
+    return 0;
+  }
+  return (*i < stepAt.size() ? stepAt[*i] : stepAt.back()) - stepAt[s];
+}
+
+/**
+ * Unwrap the phase of every sample of a DAC run. The sine only gives the
+ * phase up to which half cycle it is in: of the two, the one nearer to the
+ * phase the last step predicts is taken.
+ * @param const sim_dac_run_t* r - frame as converted
+**/
+static void dac_phase(const sim_dac_run_t* r){
+  uint16_t lo = *std::min_element(r->codes.begin(), r->codes.end());
+  uint16_t hi = *std::max_element(r->codes.begin(), r->codes.end());
+  double mid = (hi + lo) / 2.0;
+  double amplitude = std::max(1.0, (hi - lo) / 2.0);
+
+  sampleAt0 = r->t_ns;
+  samplePeriod = r->period_ns;
+  samplePhase.resize(r->codes.size());
+  sampleWeight.resize(r->codes.size());
+  double maxStep = DAC_MAX_FREQ * samplePeriod / 1e9;
+  double step = DAC_GUESS_FREQ * samplePeriod / 1e9;
+  for(size_t n = 0; n < r->codes.size(); n++){
+    double a = std::max(-1.0, std::min(1.0, (r->codes[n] - mid) / amplitude));
+    double x = asin(a) / (2 * M_PI);
+    sampleWeight[n] = std::max(DAC_MIN_WEIGHT, 1 - a * a);
+    if(n == 0){
+      samplePhase[0] = x;
+      continue;
+    }
+    double predicted = samplePhase[n - 1] + step;
+    double d1 = remainder(x - predicted, 1.0);
+    double d2 = remainder(0.5 - x - predicted, 1.0);
+    samplePhase[n] = predicted + (fabs(d1) < fabs(d2) ? d1 : d2);
+    double taken = samplePhase[n] - samplePhase[n - 1];
+    if(taken > 0 && taken < maxStep){
+      step = taken;
+    }
+  }
+}
+
+// Phase of a stretch of samples as a line: one frequency
+struct sim_dac_fit_t {
+  double at0;                       // Phase the line has at sample 0
+  double slope;                     // Cycles per sample
+};
+
+/**
+ * Least squares line through the phase of a stretch of samples. Near the
+ * peaks of the sine a code says little about the phase: a sample counts by
+ * the inverse of its phase error, the slope of the sine there squared.
+ * @param int64_t from - first sample
+ * @param int64_t to - last sample
+**/
+static sim_dac_fit_t dac_fit(int64_t from, int64_t to){
+  from = std::max((int64_t)0, from);
+  to = std::min((int64_t)samplePhase.size() - 1, to);
+  double sw = 0, sx = 0, sy = 0, sxx = 0, sxy = 0;
+  for(int64_t i = from; i <= to; i++){
+    double w = sampleWeight[i];
+    double x = i - from;
+    sw += w;
+    sx += w * x;
+    sy += w * samplePhase[i];
+    sxx += w * x * x;
+    sxy += w * x * samplePhase[i];
+  }
+  double d = sw * sxx - sx * sx;
+  sim_dac_fit_t f;
+  f.slope = d > 0 ? (sw * sxy - sx * sy) / d : 0;
+  f.at0 = sw > 0 ? (sy - f.slope * sx) / sw - f.slope * from : 0;
+  return f;
+}
+
+/**
+ * Steps of frequency every DAC_STEP_SAMPLES, the slope of the phase over
+ * each. A step where the tone changes gets a frequency in between.
+**/
+static void dac_steps(){
+  for(size_t i = 0; i + DAC_STEP_SAMPLES < samplePhase.size(); i += DAC_STEP_SAMPLES){
+    sim_dac_fit_t f = dac_fit(i, i + DAC_STEP_SAMPLES);
+    stepAt.push_back(sampleAt0 + (int64_t)llround(i * samplePeriod));
+    stepFreq.push_back(f.slope * 1e9 / samplePeriod);
+  }
+}
+
+/**
+ * Where a tone found to start at a step really starts: where the line of
+ * its phase crosses the line through the samples right before, moved there
+ * until it settles
+ * @param int64_t at - ns of the first step of the tone
+ * @return int64_t - ns
+**/
+static int64_t dac_tone_start(int64_t at){
+  double s = (at - sampleAt0) / samplePeriod;
+  sim_dac_fit_t tone = dac_fit(s + DAC_STEP_SAMPLES, s + DAC_STEP_SAMPLES + 3 * DAC_EDGE_WINDOW);
+  double knee = s;
+  for(uint8_t pass = 0; pass < DAC_EDGE_PASSES; pass++){
+    int64_t c = (int64_t)floor(knee);
+    sim_dac_fit_t before = dac_fit(c - DAC_EDGE_WINDOW, c - 1);
+    double turn = before.slope - tone.slope;
+    if(fabs(turn) < 1e-9){
+      break;
+    }
+    knee = std::max(s - 2 * DAC_STEP_SAMPLES, std::min(s + DAC_STEP_SAMPLES, (tone.at0 - before.at0) / turn));
+  }
+  return sampleAt0 + (int64_t)llround(knee * samplePeriod);
+}
+
+/**
+ * Time a tone starts at
+ * @param size_t i - its first step
+**/
+static int64_t tone_start(size_t i){
+  return samplePhase.empty() ? stepAt[i] : dac_tone_start(stepAt[i]);
+}
+
+static bool about(int64_t ns, int64_t nominal){
+  return ns > nominal * 4 / 5 && ns < nominal * 6 / 5;
+}
+
+/**
+ * Find the calibration header of the last frame and read the VIS code after it
+ * @param int64_t* visStart - time the start bit begins
+ * @param uint8_t* vis - 7 bit code
+ * @return bool - false if there is no header or the parity is wrong
+**/
+static bool read_vis(int64_t* visStart, uint8_t* vis){
+  size_t from = std::lower_bound(stepAt.begin(), stepAt.end(), (int64_t)frameAt) - stepAt.begin();
+  for(size_t i = from; i < stepAt.size(); i++){
+    size_t j = i;
+    if(!about(tone_run(&j, LEADER_FREQ), LEADER_NS) ||
+       !about(tone_run(&j, SYNC_FREQ), BREAK_NS) ||
+       !about(tone_run(&j, LEADER_FREQ), LEADER_NS)){
+      continue;
+    }
+    size_t start = j;
+    if(!about(tone_run(&j, SYNC_FREQ), VIS_BIT_NS)){
+      continue;
+    }
+
+    // 7 data bits LSB first, then even parity: 1100 Hz is a one, 1300 Hz a zero
+    *visStart = tone_start(start);
+    uint8_t bits = 0;
+    for(uint8_t b = 0; b < 8; b++){
+      int64_t t = *visStart + (b + 1) * VIS_BIT_NS;
+      if(mean_freq(t + VIS_BIT_NS / 10, t + VIS_BIT_NS * 9 / 10) < SYNC_FREQ){
+        bits |= 1 << b;
+      }
+    }
+    *vis = bits & 0x7F;
+    return !__builtin_parity(bits);
+  }
+  return false;
+}
+
+static uint8_t pixel(double f){
+  double c = (f - BLACK_FREQ) * 255 / (WHITE_FREQ - BLACK_FREQ);
+  return (uint8_t)lround(std::max(0.0, std::min(255.0, c)));
+}
+
+/**
+ * Read a scan of 320 pixels
+ * @param int64_t start - ns the first pixel begins
+ * @param uint8_t* dst - one channel, every third byte
+**/
+static void read_scan(int64_t start, uint32_t pixelNs, uint8_t* dst){
+  for(uint16_t x = 0; x < WIDTH; x++){
+    int64_t t = start + (int64_t)x * pixelNs;
+    dst[3 * x] = pixel(mean_freq(t, t + pixelNs));
+  }
+}
+
+static double psnr(double squares, uint32_t n){
+  if(squares == 0 || n == 0){
+    return PSNR_LOSSLESS;
+  }
+  return 10 * log10(255.0 * 255.0 * n / squares);
+}
+
+static bool write_image(const char* path, const std::vector<uint8_t>& rgb){
+  FILE* fp = fopen(path, "wb");
+  if(!fp){
+    return false;
+  }
+  fprintf(fp, "P6\n%d %d\n255\n", WIDTH, LINES);
+  fwrite(rgb.data(), 1, rgb.size(), fp);
+  bool ok = ferror(fp) == 0;
+  fclose(fp);
+  return ok;
+}
+
+/**
+ * Demodulate the last frame of the recorded output and compare it with what
+ * was queued for it
+ * @param const char* image_path - PPM of the rebuilt picture, or 0
+ * @param const char* lines_path - CSV of the sync error of every line, or 0
+ * @return bool - false if one of the files could not be written
+**/
+bool sim_demod_run(const char* image_path, const char* lines_path){
+  if(!framed){
+    return true;
+  }
+
+  stepAt.clear();
+  stepFreq.clear();
+  samplePhase.clear();
+  sampleWeight.clear();
+  for(uint32_t i = 0; i < sim_dds_event_count(); i++){
+    stepAt.push_back(sim_dds_event(i)->t_ns);
+    stepFreq.push_back(sim_dds_freq(sim_dds_event(i)));
+  }
+  for(uint32_t i = 0; i < sim_dac_run_count(); i++){
+    const sim_dac_run_t* r = sim_dac_run(i);
+    if(r->t_ns >= frameAt && r->codes.size() > 1){
+      dac_phase(r);
+      dac_steps();
+      break;
+    }
+  }
+
+  int64_t visStart = 0;
+  uint8_t vis = 0;
+  bool visOk = read_vis(&visStart, &vis);
+  const sim_scottie_t* mode = 0;
+  for(const sim_scottie_t& m : modes){
+    mode = visOk && m.vis == vis ? &m : mode;
+  }
+  fprintf(stderr, "demod VIS      %12u  %s\n", vis,
+          !visOk ? "not found" : mode ? mode->name : "not a Scottie mode");
+  sim_check(visOk && vis == sentVis, "VIS code received as sent");
+  if(!mode){
+    return true;
+  }
+
+  // Syncs: start bit, 7 bits, parity and stop bit, then a lone sync before
+  // the first line; each line's sync comes after its green and blue scans
+  int64_t scan = (int64_t)WIDTH * mode->pixelNs;
+  int64_t line = 3 * SEPARATOR_NS + SYNC_NS + 3 * scan;
+  int64_t first = visStart + 10 * VIS_BIT_NS + SYNC_NS + 2 * SEPARATOR_NS + 2 * scan;
+
+  std::vector<int64_t> syncs;
+  for(size_t i = 0; i < stepAt.size();){
+    size_t from = i;
+    int64_t ns = tone_run(&i, SYNC_FREQ);
+    if(ns == 0){
+      i++;
+    } else if(about(ns, SYNC_NS) && stepAt[from] > visStart){
+      syncs.push_back(tone_start(from));
+    }
+  }
+
+  std::vector<int64_t> error(LINES, 0);
+  std::vector<bool> found(LINES, false);
+  uint16_t lines = 0;
+  int64_t worst = 0;
+  for(int64_t s : syncs){
+    int64_t k = (s - first + line / 2) / line;
+    int64_t e = s - (first + k * line);
+    if(k >= 0 && k < LINES && !found[k] && llabs(e) < SYNC_SEARCH_NS){
+      error[k] = e;
+      found[k] = true;
+      lines++;
+      worst = std::max(worst, (int64_t)llabs(e));
+    }
+  }
+
+  // Slant: least squares slope of the sync error over the frame
+  double n = 0, sk = 0, se = 0, skk = 0, ske = 0;
+  for(uint16_t k = 0; k < LINES; k++){
+    if(found[k]){
+      n++;
+      sk += k;
+      se += error[k];
+      skk += (double)k * k;
+      ske += (double)k * error[k];
+    }
+  }
+  double slope = n > 1 ? (n * ske - sk * se) / (n * skk - sk * sk) : 0;
+  double slant = slope * (LINES - 1);
+
+  fprintf(stderr, "demod syncs    %12u  of %u, worst %.3f us off the nominal period\n",
+          lines, LINES, worst / 1e3);
+  fprintf(stderr, "demod slant    %12.3f us over the frame  %.4f pixels\n",
+          slant / 1e3, slant / mode->pixelNs);
+  sim_check(lines == LINES, "every line sync received");
+  sim_check(fabs(slant) < mode->pixelNs / 10.0, "slant under a tenth of a pixel");
+
+  // Rebuild the picture on each line's own sync
+  std::vector<uint8_t> rgb(LINES * WIDTH * 3);
+  for(uint16_t k = 0; k < LINES; k++){
+    int64_t s = first + k * line + error[k];
+    uint8_t* dst = &rgb[k * WIDTH * 3];
+    read_scan(s - 2 * scan - SEPARATOR_NS, mode->pixelNs, dst + 1);
+    read_scan(s - scan, mode->pixelNs, dst + 2);
+    read_scan(s + SYNC_NS + SEPARATOR_NS, mode->pixelNs, dst);
+  }
+
+  // Scottie groups are one line of planar green, blue, red
+  bool compare = sentGroupLines == 1 && sentGroupBytes == 3 * WIDTH && sent.size() == LINES * 3 * WIDTH;
+  double squares[3] = { 0, 0, 0 };
+  for(uint16_t k = 0; compare && k < LINES; k++){
+    const uint8_t* g = &sent[k * 3 * WIDTH];
+    for(uint16_t x = 0; x < WIDTH; x++){
+      const uint8_t* px = &rgb[(k * WIDTH + x) * 3];
+      double d[3] = { (double)px[0] - g[2 * WIDTH + x], (double)px[1] - g[x], (double)px[2] - g[WIDTH + x] };
+      for(uint8_t c = 0; c < 3; c++){
+        squares[c] += d[c] * d[c];
+      }
+    }
+  }
+  double r = psnr(squares[0], LINES * WIDTH);
+  double g = psnr(squares[1], LINES * WIDTH);
+  double b = psnr(squares[2], LINES * WIDTH);
+  if(compare){
+    fprintf(stderr, "demod queued   %12.2f dB R  %.2f dB G  %.2f dB B\n", r, g, b);
+  }
+  sim_check(compare && std::min(r, std::min(g, b)) >= PSNR_MIN, "picture received as queued, within 40 dB PSNR");
+
+  // Against the source: lines sent white before the picture was ready (fast
+  // boot) are counted and expected white, the picture goes on below them in
+  // its place
+  std::vector<uint8_t> ref;
+  const char* source = 0;
+  bool referenced = sim_reference_frame(WIDTH, LINES, &ref, &source);
+  uint16_t lost = OVERLAY_LINES;
+  while(referenced && lost < LINES &&
+        *std::min_element(&rgb[lost * WIDTH * 3], &rgb[(lost + 1) * WIDTH * 3]) >= WHITE_MIN){
+    lost++;
+  }
+  lost -= OVERLAY_LINES;
+  if(referenced){
+    std::fill(ref.begin() + OVERLAY_LINES * WIDTH * 3, ref.begin() + (OVERLAY_LINES + lost) * WIDTH * 3, 0xFF);
+  }
+  squares[0] = squares[1] = squares[2] = 0;
+  for(size_t i = 0; referenced && i < rgb.size(); i++){
+    double d = (double)rgb[i] - ref[i];
+    squares[i % 3] += d * d;
+  }
+  r = psnr(squares[0], LINES * WIDTH);
+  g = psnr(squares[1], LINES * WIDTH);
+  b = psnr(squares[2], LINES * WIDTH);
+  if(referenced){
+    fprintf(stderr, "demod source   %12.2f dB R  %.2f dB G  %.2f dB B  %s, picture from line %u\n",
+            r, g, b, source, OVERLAY_LINES + lost);
+  } else {
+    fprintf(stderr, "demod source   %12s  %s\n", "", source[0] ? source : "no JPEG named");
+  }
+  sim_check(referenced && std::min(r, std::min(g, b)) >= PSNR_MIN,
+            "picture received within 40 dB PSNR of the source JPEG");
+
+  bool ok = true;
+  if(image_path && !write_image(image_path, rgb)){
+    fprintf(stderr, "cannot write %s\n", image_path);
+    ok = false;
+  }
+  FILE* fp = lines_path ? fopen(lines_path, "w") : 0;
+  if(lines_path && !fp){
+    fprintf(stderr, "cannot write %s\n", lines_path);
+    ok = false;
+  }
+  if(fp){
+    fprintf(fp, "line,found,sync_error_ns\n");
+    for(uint16_t k = 0; k < LINES; k++){
+      fprintf(fp, "%u,%d,%lld\n", k, found[k] ? 1 : 0, (long long)error[k]);
+    }
+    fclose(fp);
+  }
+  return ok;
+}
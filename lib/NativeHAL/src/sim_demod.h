@@ -0,0 +1,43 @@
+/**
+ * Loopback Scottie receiver for the recorded AD9850 or DAC output.
+ *
+ * It knows the Scottie standard, not the firmware's tables: it finds the
+ * calibration header and reads the VIS code, looks the mode up by it, finds
+ * every 9 ms sync pulse and reads the green, blue and red scans around it. A
+ * pixel is the mean frequency over its period, as a receiver's filter sees
+ * it, mapped back from 1500-2300 Hz.
+ *
+ * The rebuilt picture is compared twice. The firmware hands over every line
+ * group as it queues it (sim_frame_*), which checks the transmitter: what
+ * was queued must come out. The picture itself is checked against the
+ * reference of sim_reference.h, the source JPEG decoded and scaled on the
+ * host with the overlay drawn apart, so a fault in the decoder, the scaler
+ * or the overlay shows even when it is sent faithfully. Picture lines the
+ * firmware sent white before the picture was ready (fast boot) are counted
+ * from the top and must be white; every other line must be the picture line
+ * that belongs there.
+ *
+ * Of several frames (the beacon) the last one is received. sim_demod_run()
+ * reports the VIS code, the sync error of each line against the nominal
+ * line period, the slant that adds up over the frame and the PSNR of each
+ * channel against both, and fails a sim_check() when one of them is off.
+ *
+ * With the DAC synthesizer there are no words, only samples (sim_dac.h). The
+ * phase of every sample is worked out from its code; the tones are found in
+ * steps of its slope every 100 us, a tone starts where the lines of the
+ * phase before and after it cross, and a pixel is the phase it gains over
+ * its period.
+**/
+
+#ifndef SIM_DEMOD_H
+#define SIM_DEMOD_H
+
+#include <stdint.h>
+
+// Firmware side: the frame as it is queued for transmission
+void sim_frame_begin(uint8_t vis, uint8_t groupLines, uint16_t groupBytes);
+void sim_frame_group(const uint8_t* group);
+
+bool sim_demod_run(const char* image_path, const char* lines_path);
+
+#endif
@@ -0,0 +1,110 @@
+#include <deque>
+#include <vector>
+#include "sim_gps.h"
+#include "sim_clock.h"
+
+/**
+ * The receiver on the other end of the UART
+**/
+class SimGps : public SimSerialDevice {
+  public:
+    SimGps() : baud(0), start(0), sent(0), sentences(0), overruns(0) {}
+
+    void load(const std::vector<uint8_t>& data){
+      log = data;
+    }
+
+    virtual void begin(unsigned long b){
+      baud = b;
+      start = sim_now_ns();
+      sent = 0;
+    }
+
+    virtual void receive(uint8_t c){
+      (void)c;   // Configuration sentences, ignored
+    }
+
+    virtual int available(){
+      sync();
+      return ring.size();
+    }
+
+    virtual int read(){
+      sync();
+      if(ring.empty()){
+        return -1;
+      }
+      uint8_t c = ring.front();
+      ring.pop_front();
+      return c;
+    }
+
+    virtual int peek(){
+      sync();
+      return ring.empty() ? -1 : ring.front();
+    }
+
+    void report(FILE* out){
+      fprintf(out, "gps            %12lu bytes sent  %lu sentences  %lu overruns\n",
+              sent, sentences, overruns);
+    }
+
+  private:
+    std::vector<uint8_t> log;
+    std::deque<uint8_t> ring;     // Firmware receive ring
+    unsigned long baud;
+    uint64_t start;               // When the port was opened
+    unsigned long sent;
+    unsigned long sentences;
+    unsigned long overruns;
+
+    /**
+     * Move the bytes that have come off the wire by now into the ring
+    **/
+    void sync(){
+      if(log.empty() || baud == 0){
+        return;
+      }
+      uint64_t due = (sim_now_ns() - start) * baud / 10000000000ULL;
+      while(sent < due){
+        uint8_t c = log[sent % log.size()];
+        if(ring.size() >= SIM_UART_RX_BUFFER){
+          overruns++;
+        } else {
+          ring.push_back(c);
+        }
+        sentences += c == '$';
+        sent++;
+      }
+    }
+};
+
+static SimGps gps;
+
+/**
+ * Read an NMEA log
+ * @param const char* path - host file
+ * @return bool - false if it could not be read or is empty
+**/
+bool sim_gps_load_log(const char* path){
+  FILE* f = fopen(path, "rb");
+  if(!f){
+    return false;
+  }
+  std::vector<uint8_t> data;
+  int c;
+  while((c = fgetc(f)) != EOF){
+    data.push_back(c);
+  }
+  fclose(f);
+  gps.load(data);
+  return !data.empty();
+}
+
+void sim_gps_attach(HardwareSerial* port){
+  port->attach(&gps);
+}
+
+void sim_gps_report(FILE* out){
+  gps.report(out);
+}
@@ -0,0 +1,21 @@
+/**
+ * GPS receiver stand-in sending a recorded NMEA log on Serial2.
+ *
+ * The log (--gps) is sent over and over, back to back at the rate the
+ * firmware opens the port at, so a build with -DGPS_BAUD=115200 replays it
+ * twelve times as fast as a 9600 baud receiver would. Bytes land in a
+ * SIM_UART_RX_BUFFER receive ring and are lost as overruns when it is full.
+ * Without a log the receiver stays silent.
+**/
+
+#ifndef SIM_GPS_H
+#define SIM_GPS_H
+
+#include <stdio.h>
+#include "Arduino.h"
+
+bool sim_gps_load_log(const char* path);
+void sim_gps_attach(HardwareSerial* port);
+void sim_gps_report(FILE* out);
+
+#endif
@@ -0,0 +1,447 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include "sim_jpeg.h"
+
+#define MAX_COMPONENTS 3
+
+static const uint8_t zigzag[64] = {
+   0,  1,  8, 16,  9,  2,  3, 10, 17, 24, 32, 25, 18, 11,  4,  5,
+  12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13,  6,  7, 14, 21, 28,
+  35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+  58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63
+};
+
+struct huffman_t {
+  bool defined;
+  uint8_t values[256];
+  int32_t maxCode[18];              // Largest code of each length, -1 if none
+  int32_t offset[17];               // values index of a code minus the code
+};
+
+struct component_t {
+  uint8_t id;
+  uint8_t h, v;                     // Sampling factors
+  uint8_t quant;
+  uint8_t dcTable, acTable;
+  uint16_t blocksWide, blocksHigh;  // Blocks covering the padded picture
+  int32_t dc;                       // Prediction
+  std::vector<uint8_t> plane;       // Decoded samples, or one per block reduced
+};
+
+struct decoder_t {
+  const uint8_t* data;
+  size_t size;
+  size_t pos;
+  uint32_t bits;
+  uint8_t bitCount;
+  bool failed;
+
+  uint16_t quant[4][64];
+  huffman_t dc[4], ac[4];
+  component_t comp[MAX_COMPONENTS];
+  uint8_t comps;
+  uint8_t hMax, vMax;
+  uint16_t width, height;
+  uint16_t restart;
+  bool frame;
+};
+
+/**
+ * Next bit of the entropy coded data; a marker reads as zeros
+**/
+static int get_bit(decoder_t* d){
+  if(d->bitCount == 0){
+    uint8_t b = 0;
+    if(d->pos < d->size){
+      b = d->data[d->pos];
+      if(b == 0xFF){
+        uint8_t next = d->pos + 1 < d->size ? d->data[d->pos + 1] : 0;
+        if(next == 0x00){
+          d->pos += 2;
+        } else {
+          b = 0;                    // Marker: leave it for the caller
+        }
+      } else {
+        d->pos++;
+      }
+    }
+    d->bits = b;
+    d->bitCount = 8;
+  }
+  d->bitCount--;
+  return (d->bits >> d->bitCount) & 1;
+}
+
+static int32_t get_bits(decoder_t* d, uint8_t n){
+  int32_t v = 0;
+  while(n--){
+    v = (v << 1) | get_bit(d);
+  }
+  return v;
+}
+
+/**
+ * Value of n magnitude bits, negative ones coded as their complement
+**/
+static int32_t extend(int32_t v, uint8_t n){
+  return n == 0 ? 0 : v < (1 << (n - 1)) ? v - (1 << n) + 1 : v;
+}
+
+static uint8_t decode_symbol(decoder_t* d, const huffman_t* h){
+  int32_t code = 0;
+  for(uint8_t len = 1; len <= 16; len++){
+    code = (code << 1) | get_bit(d);
+    if(code <= h->maxCode[len]){
+      return h->values[h->offset[len] + code];
+    }
+  }
+  d->failed = true;
+  return 0;
+}
+
+static uint16_t be16(const uint8_t* p){
+  return p[0] << 8 | p[1];
+}
+
+static bool read_quant(decoder_t* d, const uint8_t* p, uint16_t len){
+  while(len > 0){
+    uint8_t precision = p[0] >> 4;
+    uint8_t id = p[0] & 3;
+    uint16_t bytes = 1 + 64 * (precision ? 2 : 1);
+    if(len < bytes){
+      return false;
+    }
+    for(uint8_t i = 0; i < 64; i++){
+      d->quant[id][zigzag[i]] = precision ? be16(p + 1 + 2 * i) : p[1 + i];
+    }
+    p += bytes;
+    len -= bytes;
+  }
+  return true;
+}
+
+static bool read_huffman(decoder_t* d, const uint8_t* p, uint16_t len){
+  while(len > 17){
+    huffman_t* h = (p[0] >> 4 ? d->ac : d->dc) + (p[0] & 3);
+    const uint8_t* counts = p + 1;
+    uint16_t total = 0;
+    for(uint8_t i = 0; i < 16; i++){
+      total += counts[i];
+    }
+    if(total > 256 || len < 17 + total){
+      return false;
+    }
+    memcpy(h->values, p + 17, total);
+
+    int32_t code = 0;
+    uint16_t k = 0;
+    for(uint8_t bits = 1; bits <= 16; bits++){
+      h->offset[bits] = k - code;
+      code += counts[bits - 1];
+      k += counts[bits - 1];
+      h->maxCode[bits] = counts[bits - 1] ? code - 1 : -1;
+      code <<= 1;
+    }
+    h->maxCode[17] = 0x7FFFFFFF;
+    h->defined = true;
+    p += 17 + total;
+    len -= 17 + total;
+  }
+  return true;
+}
+
+static bool read_frame(decoder_t* d, const uint8_t* p, uint16_t len){
+  if(len < 6 || p[0] != 8){
+    return false;
+  }
+  d->height = be16(p + 1);
+  d->width = be16(p + 3);
+  d->comps = p[5];
+  if((d->comps != 1 && d->comps != 3) || len < 6 + 3 * d->comps || d->width == 0 || d->height == 0){
+    return false;
+  }
+  d->hMax = d->vMax = 1;
+  for(uint8_t i = 0; i < d->comps; i++){
+    component_t* c = &d->comp[i];
+    c->id = p[6 + 3 * i];
+    c->h = p[7 + 3 * i] >> 4;
+    c->v = p[7 + 3 * i] & 15;
+    c->quant = p[8 + 3 * i] & 3;
+    if(c->h < 1 || c->h > 2 || c->v < 1 || c->v > 2){
+      return false;
+    }
+    d->hMax = std::max(d->hMax, c->h);
+    d->vMax = std::max(d->vMax, c->v);
+  }
+  d->frame = true;
+  return true;
+}
+
+/**
+ * Dequantize a block and either keep its mean or run the IDCT
+ * @param int32_t* coef - coefficients in natural order
+ * @param uint8_t* dst - top left sample in the plane, or the block's sample reduced
+ * @param uint32_t stride - plane width
+**/
+static void block_out(const decoder_t* d, const component_t* c, const int32_t* coef, uint8_t* dst,
+                      uint32_t stride, bool reduce){
+  static double cosines[8][8];
+  static bool ready = false;
+  if(!ready){
+    for(uint8_t x = 0; x < 8; x++){
+      for(uint8_t u = 0; u < 8; u++){
+        cosines[x][u] = (u == 0 ? sqrt(0.5) : 1.0) * cos((2 * x + 1) * u * M_PI / 16) / 2;
+      }
+    }
+    ready = true;
+  }
+
+  const uint16_t* q = d->quant[c->quant];
+  if(reduce){
+    double v = coef[0] * q[0] / 8.0 + 128;
+    *dst = (uint8_t)std::max(0L, std::min(255L, lround(v)));
+    return;
+  }
+
+  double tmp[64];
+  for(uint8_t y = 0; y < 8; y++){
+    for(uint8_t u = 0; u < 8; u++){
+      double s = 0;
+      for(uint8_t v = 0; v < 8; v++){
+        s += cosines[y][v] * coef[v * 8 + u] * q[v * 8 + u];
+      }
+      tmp[y * 8 + u] = s;
+    }
+  }
+  for(uint8_t y = 0; y < 8; y++){
+    for(uint8_t x = 0; x < 8; x++){
+      double s = 0;
+      for(uint8_t u = 0; u < 8; u++){
+        s += cosines[x][u] * tmp[y * 8 + u];
+      }
+      dst[y * stride + x] = (uint8_t)std::max(0L, std::min(255L, lround(s + 128)));
+    }
+  }
+}
+
+/**
+ * Decode one block of a component into its plane
+**/
+static void decode_block(decoder_t* d, component_t* c, uint16_t bx, uint16_t by, bool reduce){
+  int32_t coef[64] = { 0 };
+  uint8_t n = decode_symbol(d, &d->dc[c->dcTable]);
+  c->dc += extend(get_bits(d, n), n);
+  coef[0] = c->dc;
+  for(uint8_t k = 1; k < 64 && !d->failed;){
+    uint8_t rs = decode_symbol(d, &d->ac[c->acTable]);
+    uint8_t run = rs >> 4;
+    uint8_t size = rs & 15;
+    if(size == 0){
+      if(run != 15){
+        break;                      // End of block
+      }
+      k += 16;
+      continue;
+    }
+    k += run;
+    if(k > 63){
+      d->failed = true;
+      break;
+    }
+    coef[zigzag[k++]] = extend(get_bits(d, size), size);
+  }
+
+  if(bx >= c->blocksWide || by >= c->blocksHigh){
+    return;
+  }
+  if(reduce){
+    block_out(d, c, coef, &c->plane[(uint32_t)by * c->blocksWide + bx], 0, true);
+  } else {
+    uint32_t stride = c->blocksWide * 8;
+    block_out(d, c, coef, &c->plane[(uint32_t)by * 8 * stride + bx * 8], stride, false);
+  }
+}
+
+/**
+ * Skip to past the next RSTn and reset the predictions
+**/
+static void restart(decoder_t* d){
+  d->bitCount = 0;
+  while(d->pos + 1 < d->size && !(d->data[d->pos] == 0xFF && d->data[d->pos + 1] >= 0xD0 && d->data[d->pos + 1] <= 0xD7)){
+    d->pos++;
+  }
+  d->pos += 2;
+  for(uint8_t i = 0; i < d->comps; i++){
+    d->comp[i].dc = 0;
+  }
+}
+
+static bool read_scan(decoder_t* d, const uint8_t* p, uint16_t len, bool reduce){
+  uint8_t ns = p[0];
+  if(!d->frame || len < 4 + 2 * ns || ns != d->comps){
+    return false;                   // Only scans of every component at once
+  }
+  for(uint8_t i = 0; i < ns; i++){
+    component_t* c = &d->comp[i];
+    if(p[1 + 2 * i] != c->id){
+      return false;
+    }
+    c->dcTable = p[2 + 2 * i] >> 4 & 3;
+    c->acTable = p[2 + 2 * i] & 3;
+    if(!d->dc[c->dcTable].defined || !d->ac[c->acTable].defined){
+      return false;
+    }
+  }
+
+  // A single component is not interleaved: one block per MCU
+  bool single = ns == 1;
+  uint16_t mcuWide = single ? (d->width + 7) / 8 : (d->width + 8 * d->hMax - 1) / (8 * d->hMax);
+  uint16_t mcuHigh = single ? (d->height + 7) / 8 : (d->height + 8 * d->vMax - 1) / (8 * d->vMax);
+  for(uint8_t i = 0; i < ns; i++){
+    component_t* c = &d->comp[i];
+    c->blocksWide = single ? mcuWide : mcuWide * c->h;
+    c->blocksHigh = single ? mcuHigh : mcuHigh * c->v;
+    c->plane.assign((size_t)c->blocksWide * c->blocksHigh * (reduce ? 1 : 64), 0);
+    c->dc = 0;
+  }
+
+  d->bitCount = 0;
+  uint32_t mcus = (uint32_t)mcuWide * mcuHigh;
+  for(uint32_t m = 0; m < mcus && !d->failed; m++){
+    if(d->restart && m > 0 && m % d->restart == 0){
+      restart(d);
+    }
+    uint16_t mx = m % mcuWide;
+    uint16_t my = m / mcuWide;
+    for(uint8_t i = 0; i < ns; i++){
+      component_t* c = &d->comp[i];
+      uint8_t h = single ? 1 : c->h;
+      uint8_t v = single ? 1 : c->v;
+      for(uint8_t y = 0; y < v; y++){
+        for(uint8_t x = 0; x < h; x++){
+          decode_block(d, c, mx * h + x, my * v + y, reduce);
+        }
+      }
+    }
+  }
+  return !d->failed;
+}
+
+/**
+ * Colour convert the planes, chroma repeated over the luma it covers
+**/
+static void convert(const decoder_t* d, sim_jpeg_t* out){
+  uint8_t scale = out->reduced ? 1 : 8;
+  out->rgb.resize((size_t)out->rgbWidth * out->rgbHeight * 3);
+  uint8_t* px = out->rgb.data();
+  for(uint32_t y = 0; y < out->rgbHeight; y++){
+    for(uint32_t x = 0; x < out->rgbWidth; x++){
+      double s[MAX_COMPONENTS];
+      for(uint8_t i = 0; i < d->comps; i++){
+        const component_t* c = &d->comp[i];
+        uint32_t cx = x * c->h / d->hMax;
+        uint32_t cy = y * c->v / d->vMax;
+        s[i] = c->plane[cy * c->blocksWide * scale + cx];
+      }
+      if(d->comps == 1){
+        px[0] = px[1] = px[2] = (uint8_t)s[0];
+      } else {
+        double rgb[3] = {
+          s[0] + 1.402 * (s[2] - 128),
+          s[0] - 0.344136 * (s[1] - 128) - 0.714136 * (s[2] - 128),
+          s[0] + 1.772 * (s[1] - 128)
+        };
+        for(uint8_t k = 0; k < 3; k++){
+          px[k] = (uint8_t)std::max(0L, std::min(255L, lround(rgb[k])));
+        }
+      }
+      px += 3;
+    }
+  }
+}
+
+/**
+ * Decode a JPEG from a host file
+ * @param const char* path - host file
+ * @param uint16_t reduceWidth - pictures at least this wide are decoded
+ *                               reduced, 0 for never
+ * @param sim_jpeg_t* out - the picture
+ * @return bool - false if it could not be read or is not a baseline JPEG
+**/
+bool sim_jpeg_decode(const char* path, uint16_t reduceWidth, sim_jpeg_t* out){
+  FILE* fp = fopen(path, "rb");
+  if(!fp){
+    return false;
+  }
+  std::vector<uint8_t> file;
+  uint8_t buf[4096];
+  size_t n;
+  while((n = fread(buf, 1, sizeof(buf), fp)) > 0){
+    file.insert(file.end(), buf, buf + n);
+  }
+  fclose(fp);
+
+  static decoder_t d;
+  d = decoder_t();
+  d.data = file.data();
+  d.size = file.size();
+  if(d.size < 4 || d.data[0] != 0xFF || d.data[1] != 0xD8){
+    return false;
+  }
+  d.pos = 2;
+
+  while(d.pos + 4 <= d.size){
+    if(d.data[d.pos] != 0xFF){
+      return false;
+    }
+    uint8_t marker = d.data[d.pos + 1];
+    if(marker == 0xFF){
+      d.pos++;                      // Fill byte
+      continue;
+    }
+    uint16_t len = be16(d.data + d.pos + 2);
+    const uint8_t* p = d.data + d.pos + 4;
+    if(len < 2 || d.pos + 2 + len > d.size){
+      return false;
+    }
+    d.pos += 2 + len;
+    len -= 2;
+
+    bool ok = true;
+    switch(marker){
+      case 0xDB:
+        ok = read_quant(&d, p, len);
+        break;
+      case 0xC4:
+        ok = read_huffman(&d, p, len);
+        break;
+      case 0xC0:
+      case 0xC1:
+        ok = read_frame(&d, p, len);
+        out->width = d.width;
+        out->height = d.height;
+        out->reduced = reduceWidth > 0 && d.width >= reduceWidth;
+        break;
+      case 0xDD:
+        d.restart = len >= 2 ? be16(p) : 0;
+        break;
+      case 0xDA:
+        if(!read_scan(&d, p, len, out->reduced)){
+          return false;
+        }
+        out->rgbWidth = out->reduced ? (d.width + 7) / 8 : d.width;
+        out->rgbHeight = out->reduced ? (d.height + 7) / 8 : d.height;
+        convert(&d, out);
+        return true;
+      default:
+        ok = marker < 0xC2 || marker > 0xCF || marker == 0xC4 || marker == 0xC8 || marker == 0xCC;
+        break;                      // Other SOFn: progressive or arithmetic
+    }
+    if(!ok){
+      return false;
+    }
+  }
+  return false;
+}
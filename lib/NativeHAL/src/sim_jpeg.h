@@ -0,0 +1,31 @@
+/**
+ * Baseline JPEG decoder for the native build's reference picture.
+ *
+ * It shares no code with the JPEG library the firmware decodes with, so the
+ * reference the loopback receiver compares a frame with (sim_reference.h)
+ * is made independently of it. Baseline huffman pictures only, grayscale or
+ * YCbCr with any sampling the camera uses, restart markers included. The
+ * chroma is repeated over the luma pixels it covers rather than smoothed.
+ *
+ * Reduced, every 8x8 block of every component gives one pixel, its mean
+ * (the DC coefficient), the same picture a DC-only IDCT makes.
+**/
+
+#ifndef SIM_JPEG_H
+#define SIM_JPEG_H
+
+#include <stdint.h>
+#include <vector>
+
+struct sim_jpeg_t {
+  uint16_t width;                   // Pixels of the JPEG
+  uint16_t height;
+  bool reduced;                     // rgb holds one pixel per 8x8 block
+  uint16_t rgbWidth;                // Pixels of rgb
+  uint16_t rgbHeight;
+  std::vector<uint8_t> rgb;         // 3 bytes (R, G, B) per pixel
+};
+
+bool sim_jpeg_decode(const char* path, uint16_t reduceWidth, sim_jpeg_t* out);
+
+#endif
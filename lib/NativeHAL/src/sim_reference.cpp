@@ -0,0 +1,240 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include "sim_reference.h"
+#include "sim_jpeg.h"
+#include "sim_camera.h"
+#include "SD.h"
+
+#define REDUCE_WIDTH (8 * 320)      // Narrowest picture the firmware reduces
+#define HEADER_LINES 16             // White bands over the picture
+#define FOOTER_LINES 11
+#define TEXT_LEFT 16
+#define TEXT_TOP 3                  // In its band
+#define HEADER_CHARS 12
+#define HEADER_PIXEL 3              // Pixels per font bit
+#define HEADER_ADVANCE 24
+#define FOOTER_CHARS 76
+#define FOOTER_ADVANCE 4
+
+// The overlay's fonts: the glyphs are copied, the way they are drawn is not
+static const uint8_t headerFont[43][11] = {
+  {0x00, 0x18, 0x24, 0x62, 0x62, 0x62, 0x7E, 0x62, 0x62, 0x62, 0x00}, // A
+  {0x00, 0x7C, 0x32, 0x32, 0x32, 0x3C, 0x32, 0x32, 0x32, 0x7C, 0x00}, // B
+  {0x00, 0x3C, 0x62, 0x62, 0x60, 0x60, 0x60, 0x62, 0x62, 0x3C, 0x00}, // C
+  {0x00, 0x7C, 0x32, 0x32, 0x32, 0x32, 0x32, 0x32, 0x32, 0x7C, 0x00}, // D
+  {0x00, 0x7E, 0x60, 0x60, 0x60, 0x7C, 0x60, 0x60, 0x60, 0x7E, 0x00}, // E
+  {0x00, 0x7E, 0x60, 0x60, 0x60, 0x7C, 0x60, 0x60, 0x60, 0x60, 0x00}, // F
+  {0x00, 0x3C, 0x62, 0x62, 0x60, 0x60, 0x66, 0x62, 0x62, 0x3C, 0x00}, // G
+  {0x00, 0x62, 0x62, 0x62, 0x62, 0x7E, 0x62, 0x62, 0x62, 0x62, 0x00}, // H
+  {0x00, 0x3C, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x3C, 0x00}, // I
+  {0x00, 0x1E, 0x0C, 0x0C, 0x0C, 0x0C, 0x4C, 0x4C, 0x4C, 0x38, 0x00}, // J
+  {0x00, 0x62, 0x64, 0x68, 0x70, 0x68, 0x64, 0x62, 0x62, 0x62, 0x00}, // K
+  {0x00, 0x60, 0x60, 0x60, 0x60, 0x60, 0x60, 0x60, 0x60, 0x7E, 0x00}, // L
+  {0x00, 0x42, 0x62, 0x76, 0x6A, 0x62, 0x62, 0x62, 0x62, 0x62, 0x00}, // M
+  {0x00, 0x42, 0x62, 0x72, 0x6A, 0x66, 0x62, 0x62, 0x62, 0x62, 0x00}, // N
+  {0x00, 0x3C, 0x62, 0x62, 0x62, 0x62, 0x62, 0x62, 0x62, 0x3C, 0x00}, // O
+  {0x00, 0x7C, 0x62, 0x62, 0x62, 0x7C, 0x60, 0x60, 0x60, 0x60, 0x00}, // P
+  {0x00, 0x3C, 0x62, 0x62, 0x62, 0x62, 0x62, 0x6A, 0x6A, 0x3C, 0x08}, // Q
+  {0x00, 0x7C, 0x62, 0x62, 0x62, 0x7C, 0x68, 0x64, 0x62, 0x62, 0x00}, // R
+  {0x00, 0x3C, 0x62, 0x60, 0x60, 0x3C, 0x06, 0x06, 0x46, 0x3C, 0x00}, // S
+  {0x00, 0x7E, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x00}, // T
+  {0x00, 0x62, 0x62, 0x62, 0x62, 0x62, 0x62, 0x62, 0x62, 0x3C, 0x00}, // U
+  {0x00, 0x62, 0x62, 0x62, 0x62, 0x62, 0x62, 0x22, 0x14, 0x08, 0x00}, // V
+  {0x00, 0x62, 0x62, 0x62, 0x62, 0x62, 0x6A, 0x76, 0x62, 0x42, 0x00}, // W
+  {0x00, 0x42, 0x62, 0x74, 0x38, 0x1C, 0x2E, 0x46, 0x42, 0x42, 0x00}, // X
+  {0x00, 0x42, 0x62, 0x74, 0x38, 0x18, 0x18, 0x18, 0x18, 0x18, 0x00}, // Y
+  {0x00, 0x7E, 0x06, 0x0E, 0x0C, 0x18, 0x30, 0x70, 0x60, 0x7E, 0x00}, // Z
+  {0x00, 0x3C, 0x62, 0x62, 0x66, 0x6A, 0x72, 0x62, 0x62, 0x3C, 0x00}, // 0
+  {0x00, 0x38, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x00}, // 1
+  {0x00, 0x3C, 0x46, 0x06, 0x06, 0x1C, 0x20, 0x60, 0x60, 0x7E, 0x00}, // 2
+  {0x00, 0x3C, 0x46, 0x06, 0x06, 0x1C, 0x06, 0x06, 0x46, 0x3C, 0x00}, // 3
+  {0x00, 0x0C, 0x1C, 0x2C, 0x4C, 0x4C, 0x7E, 0x0C, 0x0C, 0x0C, 0x00}, // 4
+  {0x00, 0x7E, 0x60, 0x60, 0x60, 0x7C, 0x06, 0x06, 0x46, 0x3C, 0x00}, // 5
+  {0x00, 0x3C, 0x62, 0x60, 0x60, 0x7C, 0x62, 0x62, 0x62, 0x3C, 0x00}, // 6
+  {0x00, 0x7E, 0x06, 0x0C, 0x18, 0x30, 0x30, 0x30, 0x30, 0x30, 0x00}, // 7
+  {0x00, 0x3C, 0x62, 0x62, 0x62, 0x3C, 0x62, 0x62, 0x62, 0x3C, 0x00}, // 8
+  {0x00, 0x3C, 0x46, 0x46, 0x46, 0x3E, 0x06, 0x06, 0x46, 0x3C, 0x00}, // 9
+  {0x00, 0x00, 0x02, 0x06, 0x0E, 0x1C, 0x38, 0x70, 0x60, 0x40, 0x00}, // /
+  {0x00, 0x00, 0x00, 0x00, 0x00, 0x7E, 0x7E, 0x00, 0x00, 0x00, 0x00}, // -
+  {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x06, 0x06, 0x00}, // .
+  {0x00, 0x3C, 0x46, 0x06, 0x06, 0x0C, 0x10, 0x00, 0x30, 0x30, 0x00}, // ?
+  {0x00, 0x18, 0x18, 0x18, 0x18, 0x10, 0x10, 0x00, 0x18, 0x18, 0x00}, // !
+  {0x00, 0x00, 0x00, 0x18, 0x18, 0x00, 0x00, 0x18, 0x18, 0x00, 0x00}, // :
+  {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00}  // space
+};
+
+// Two characters from '0' on per entry, the first in the high nibble
+static const uint8_t footerFont[23][5] = {
+  { 0xE2, 0xA6, 0xA2, 0xA2, 0xE2 }, { 0xEE, 0x22, 0xE6, 0x82, 0xEE },
+  { 0xAE, 0xA8, 0xEE, 0x22, 0x2E }, { 0x8E, 0x82, 0xE2, 0xA2, 0xE2 },
+  { 0xEE, 0xAA, 0xEE, 0xA2, 0xE2 }, { 0x00, 0x22, 0x00, 0x22, 0x04 },
+  { 0x20, 0x4E, 0x80, 0x4E, 0x20 }, { 0x8E, 0x42, 0x26, 0x40, 0x84 },
+  { 0x64, 0x9A, 0xBE, 0x8A, 0x7A }, { 0xC6, 0xA8, 0xC8, 0xA8, 0xC6 },
+  { 0xCE, 0xA8, 0xAC, 0xA8, 0xCE }, { 0xE6, 0x88, 0xCE, 0x8A, 0x86 },
+  { 0xA4, 0xA4, 0xE4, 0xA4, 0xA4 }, { 0x69, 0x2A, 0x2C, 0x2A, 0x49 },
+  { 0x8A, 0x8E, 0x8E, 0x8A, 0xEA }, { 0x04, 0x9A, 0xDA, 0xBA, 0x94 },
+  { 0xC4, 0xAA, 0xCA, 0x8E, 0x86 }, { 0xC6, 0xA8, 0xC4, 0xA2, 0xAC },
+  { 0xE0, 0x4A, 0x4A, 0x4A, 0x44 }, { 0x09, 0xA9, 0xA9, 0x6F, 0x26 },
+  { 0x0A, 0xAA, 0x46, 0xA2, 0x04 }, { 0xE6, 0x24, 0x44, 0x84, 0xE6 },
+  { 0x00, 0x00, 0x00, 0x00, 0x00 }
+};
+
+// Named by the firmware since the last frame started
+static sim_jpeg_t named;
+static char namedPath[512];
+static bool namedOk = false;
+static std::vector<char> header;
+static std::vector<char> footer;
+
+// Taken for the frame on the air
+static bool onAir = false;
+static sim_jpeg_t frameJpeg;
+static char framePath[512];
+static bool frameOk = false;
+static std::vector<char> frameHeader;
+static std::vector<char> frameFooter;
+
+/**
+ * Read a JPEG the firmware opens, as it is on the card now
+ * @param const char* filename - path on the SD card
+**/
+void sim_frame_source(const char* filename){
+  snprintf(namedPath, sizeof(namedPath), "%s/%s", SD.root(), filename);
+  namedOk = sim_jpeg_decode(namedPath, REDUCE_WIDTH, &named);
+  if(onAir && framePath[0] == '\0'){  // First one named during the frame
+    frameJpeg = named;
+    snprintf(framePath, sizeof(framePath), "%s", namedPath);
+    frameOk = namedOk;
+  }
+}
+
+void sim_frame_header(const char* text, uint8_t len){
+  header.assign(text, text + len);
+}
+
+void sim_frame_footer(const char* text, uint8_t len){
+  footer.assign(text, text + len);
+}
+
+/**
+ * Take what was named so far for the frame starting now
+**/
+void sim_reference_begin(){
+  onAir = true;
+  frameHeader = header;
+  frameFooter = footer;
+  snprintf(framePath, sizeof(framePath), "%s", namedPath);
+  if(namedPath[0] != '\0'){
+    frameJpeg = named;
+    frameOk = namedOk;
+  }
+}
+
+static uint8_t header_glyph(char ch){
+  return ch >= 'A' && ch <= 'Z' ? ch - 'A' :
+         ch >= '0' && ch <= '9' ? ch - '0' + 26 :
+         ch == '/' ? 36 : ch == '-' ? 37 : ch == '.' ? 38 :
+         ch == '?' ? 39 : ch == '!' ? 40 : ch == ':' ? 41 : 42;
+}
+
+static void black(std::vector<uint8_t>* rgb, uint16_t width, uint16_t line, uint16_t x){
+  if(x < width){
+    memset(&(*rgb)[(line * width + x) * 3], 0, 3);
+  }
+}
+
+/**
+ * Draw the callsign and the telemetry, black on the white bands
+**/
+static void draw_text(std::vector<uint8_t>* rgb, uint16_t width){
+  for(size_t c = 0; c < std::min(frameHeader.size(), (size_t)HEADER_CHARS); c++){
+    const uint8_t* glyph = headerFont[header_glyph(frameHeader[c])];
+    for(uint8_t y = 0; y < 11; y++){
+      for(uint8_t bit = 0; bit < 8; bit++){
+        if(!(glyph[y] & 0x80 >> bit)){
+          continue;
+        }
+        for(uint8_t p = 0; p < HEADER_PIXEL; p++){
+          black(rgb, width, TEXT_TOP + y, TEXT_LEFT + HEADER_ADVANCE * c + HEADER_PIXEL * bit + p);
+        }
+      }
+    }
+  }
+  for(size_t c = 0; c < std::min(frameFooter.size(), (size_t)FOOTER_CHARS); c++){
+    char ch = frameFooter[c];
+    if(ch < '0' || ch > '['){
+      continue;                     // Drawn as a space
+    }
+    const uint8_t* glyph = footerFont[(ch - '0') / 2];
+    uint8_t shift = (ch - '0') % 2 ? 0 : 4;
+    for(uint8_t y = 0; y < 5; y++){
+      for(uint8_t bit = 0; bit < 4; bit++){
+        if(glyph[y] >> shift & 0x8 >> bit){
+          black(rgb, width, HEADER_LINES + TEXT_TOP + y, TEXT_LEFT + FOOTER_ADVANCE * c + bit);
+        }
+      }
+    }
+  }
+}
+
+/**
+ * Scale the source to width pixels, every output pixel the mean of the
+ * source area under it. The last line covers what is left of the picture.
+ * @param uint16_t lines - most lines of picture
+**/
+static void draw_picture(std::vector<uint8_t>* rgb, uint16_t width, uint16_t lines){
+  const sim_jpeg_t& s = frameJpeg;
+  double scale = (double)s.rgbWidth / width;   // Source pixels per output pixel
+  uint16_t out = std::min((double)lines, ceil(s.rgbHeight / scale));
+  for(uint16_t y = 0; y < out; y++){
+    double y0 = y * scale;
+    double y1 = std::min((double)s.rgbHeight, y0 + scale);
+    for(uint16_t x = 0; x < width; x++){
+      double x0 = x * scale;
+      double x1 = std::min((double)s.rgbWidth, x0 + scale);
+      double sum[3] = { 0, 0, 0 };
+      double area = 0;
+      for(uint32_t sy = (uint32_t)y0; sy < y1; sy++){
+        double h = std::min(y1, sy + 1.0) - std::max(y0, (double)sy);
+        for(uint32_t sx = (uint32_t)x0; sx < x1; sx++){
+          double a = h * (std::min(x1, sx + 1.0) - std::max(x0, (double)sx));
+          const uint8_t* px = &s.rgb[(sy * s.rgbWidth + sx) * 3];
+          for(uint8_t c = 0; c < 3; c++){
+            sum[c] += a * px[c];
+          }
+          area += a;
+        }
+      }
+      uint8_t* dst = &(*rgb)[((HEADER_LINES + FOOTER_LINES + y) * width + x) * 3];
+      for(uint8_t c = 0; c < 3; c++){
+        dst[c] = (uint8_t)lround(sum[c] / area);
+      }
+    }
+  }
+}
+
+/**
+ * The frame that started last as it should be received
+ * @param uint16_t width - pixels per line
+ * @param uint16_t lines - lines of the frame, bands included
+ * @param std::vector<uint8_t>* rgb - 3 bytes (R, G, B) per pixel
+ * @param const char** source - host path of the JPEG it was made from
+ * @return bool - false if no JPEG could be decoded for it
+**/
+bool sim_reference_frame(uint16_t width, uint16_t lines, std::vector<uint8_t>* rgb, const char** source){
+  if(framePath[0] == '\0' && sim_camera_image()){
+    snprintf(framePath, sizeof(framePath), "%s", sim_camera_image());
+    frameOk = sim_jpeg_decode(framePath, REDUCE_WIDTH, &frameJpeg);
+  }
+  *source = framePath;
+  if(!frameOk){
+    return false;
+  }
+
+  rgb->assign((size_t)width * lines * 3, 0xFF);
+  draw_text(rgb, width);
+  draw_picture(rgb, width, lines - HEADER_LINES - FOOTER_LINES);
+  return true;
+}
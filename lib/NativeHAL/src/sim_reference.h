@@ -0,0 +1,32 @@
+/**
+ * Reference picture for the loopback receiver: the frame as it should come
+ * out, made without the firmware's decoder, scaler or overlay.
+ *
+ * The firmware names the JPEG it opens and the overlay text it sets
+ * (sim_frame_source, sim_frame_header, sim_frame_footer). The JPEG is read
+ * off the card at once, before the catalog can recycle it, and decoded on
+ * the host (sim_jpeg.h), reduced if it is wide enough for the firmware to
+ * reduce it too. A frame takes the last JPEG named before it starts, or if
+ * there is none yet (fast boot captures under the first lines) the first
+ * one named while it is on the air; with none at all, the camera's picture.
+ *
+ * The reference is scaled to 320 pixels by the area of every source pixel
+ * under an output pixel, in floating point, and starts under the white
+ * header and footer bands. Its text is drawn from the fonts pixel by pixel.
+**/
+
+#ifndef SIM_REFERENCE_H
+#define SIM_REFERENCE_H
+
+#include <stdint.h>
+#include <vector>
+
+// Firmware side: what the next frame is made of
+void sim_frame_source(const char* filename);
+void sim_frame_header(const char* text, uint8_t len);
+void sim_frame_footer(const char* text, uint8_t len);
+
+void sim_reference_begin();
+bool sim_reference_frame(uint16_t width, uint16_t lines, std::vector<uint8_t>* rgb, const char** source);
+
+#endif
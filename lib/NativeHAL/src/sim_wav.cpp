@@ -0,0 +1,215 @@
+#include <stdio.h>
+#include <math.h>
+#include <chrono>
+#include "sim_wav.h"
+#include "AD9850.h"
+
+#define BLOCK 256                   // Samples per sine kernel call
+#define AMPLITUDE 29491.0f          // 0.9 of full scale
+#define TURN 4294967296.0           // Phase units per cycle
+
+typedef void (*sim_wav_sink_t)(const int16_t* pcm, uint32_t n, void* ctx);
+
+/**
+ * sin() of a block of phases (1/2^32 cycle each), as cos() of the distance
+ * from the nearest peak with a 10th order polynomial, within 5e-7 of sin().
+ * Integer folding and a fixed length keep the loop free of branches, so it
+ * vectorises.
+**/
+static void sine_block(const uint32_t* phase, float* out){
+  for(uint32_t i = 0; i < BLOCK; i++){
+    int32_t d = (int32_t)(phase[i] & 0x7FFFFFFF) - 0x40000000;   // From the peak
+    int32_t m = d >> 31;
+    float y = ((d ^ m) - m) * (float)(M_PI / 2 / 1073741824.0);  // 0..pi/2
+    float y2 = y * y;
+    float c = 1.0f + y2 * (-1.0f / 2 + y2 * (1.0f / 24 + y2 * (-1.0f / 720 + y2 * (1.0f / 40320 + y2 * (-1.0f / 3628800)))));
+    out[i] = c * (1 - 2 * (int32_t)(phase[i] >> 31));   // Second half cycle is negative
+  }
+}
+
+/**
+ * Phase units of a number of cycles, whole cycles dropped
+**/
+static uint32_t turns(double cycles){
+  return (uint32_t)(uint64_t)llround((cycles - floor(cycles)) * TURN);
+}
+
+/**
+ * First sample at or after a time
+ * @param uint64_t t_ns - from the start of the audio
+**/
+static uint64_t sample_at(uint64_t t_ns, uint32_t rate){
+  return (t_ns * rate + 999999999ULL) / 1000000000ULL;
+}
+
+// Samples waiting for the sine kernel
+struct sim_wav_block_t {
+  uint32_t phase[BLOCK];
+  float gain[BLOCK];                // 0 while powered down
+  uint32_t n;
+};
+
+/**
+ * Make the samples of a block and hand them to the sink
+**/
+static void flush_block(sim_wav_block_t* b, sim_wav_sink_t sink, void* ctx){
+  float sine[BLOCK];
+  int16_t pcm[BLOCK];
+  sine_block(b->phase, sine);
+  for(uint32_t i = 0; i < BLOCK; i++){
+    pcm[i] = (int16_t)(sine[i] * b->gain[i]);
+  }
+  sink(pcm, b->n, ctx);
+  b->n = 0;
+}
+
+/**
+ * Play the recorded words through the oscillator, from the first tone to the
+ * last word. Each word covers only a few samples, so the phases of several
+ * words fill a block before the sine kernel runs.
+ * @param uint32_t rate - samples per second
+ * @param sim_wav_sink_t sink - gets the samples a block at a time
+ * @return uint64_t - samples made
+**/
+static uint64_t render(uint32_t rate, sim_wav_sink_t sink, void* ctx){
+  uint32_t count = sim_dds_event_count();
+  uint32_t first = 0;
+  while(first < count && sim_dds_freq(sim_dds_event(first)) == 0.0){
+    first++;
+  }
+  if(first + 1 >= count){
+    return 0;
+  }
+
+  uint64_t t0 = sim_dds_event(first)->t_ns;
+  uint32_t phase = 0;               // At the start of the word being played
+  uint64_t n = 0;                   // Next sample
+  sim_wav_block_t block = {};
+
+  for(uint32_t e = first; e + 1 < count; e++){
+    double f = sim_dds_freq(sim_dds_event(e));
+    uint64_t from = sim_dds_event(e)->t_ns - t0;
+    uint64_t to = sim_dds_event(e + 1)->t_ns - t0;
+    uint64_t end = sample_at(to, rate);
+    float gain = f == 0.0 ? 0.0f : AMPLITUDE;
+
+    // Samples are on the word's own phase line, so a change between two
+    // samples splits that step at its exact time
+    uint32_t p = phase + turns(f * (n * 1e9 / rate - from) * 1e-9);
+    uint32_t inc = turns(f / rate);
+    for(; n < end; n++, p += inc){
+      block.phase[block.n] = p;
+      block.gain[block.n] = gain;
+      if(++block.n == BLOCK){
+        flush_block(&block, sink, ctx);
+      }
+    }
+    phase += turns(f * (to - from) * 1e-9);
+  }
+  if(block.n > 0){
+    flush_block(&block, sink, ctx);
+  }
+  return n;
+}
+
+static void put_u32(FILE* fp, uint32_t v){
+  uint8_t b[4] = { (uint8_t)v, (uint8_t)(v >> 8), (uint8_t)(v >> 16), (uint8_t)(v >> 24) };
+  fwrite(b, 1, 4, fp);
+}
+
+static void put_u16(FILE* fp, uint16_t v){
+  uint8_t b[2] = { (uint8_t)v, (uint8_t)(v >> 8) };
+  fwrite(b, 1, 2, fp);
+}
+
+/**
+ * 16 bit mono WAV header, written again with the sample count at the end
+ * @param uint32_t samples - 0 while unknown
+**/
+void sim_wav_header(FILE* fp, uint32_t rate, uint32_t samples){
+  fwrite("RIFF", 1, 4, fp);
+  put_u32(fp, 36 + 2 * samples);
+  fwrite("WAVEfmt ", 1, 8, fp);
+  put_u32(fp, 16);
+  put_u16(fp, 1);                   // PCM
+  put_u16(fp, 1);                   // Mono
+  put_u32(fp, rate);
+  put_u32(fp, 2 * rate);
+  put_u16(fp, 2);
+  put_u16(fp, 16);
+  fwrite("data", 1, 4, fp);
+  put_u32(fp, 2 * samples);
+}
+
+static void file_sink(const int16_t* pcm, uint32_t n, void* ctx){
+  fwrite(pcm, 2, n, (FILE*)ctx);    // Hosts are little endian, like WAV
+}
+
+static void null_sink(const int16_t* pcm, uint32_t n, void* ctx){
+  int64_t* sum = (int64_t*)ctx;
+  for(uint32_t i = 0; i < n; i++){
+    *sum += pcm[i];
+  }
+}
+
+/**
+ * Write the recorded output as a WAV file
+ * @param const char* path - host file
+ * @param uint32_t rate - samples per second
+ * @return bool - false if the file could not be written or nothing was sent
+**/
+bool sim_wav_render(const char* path, uint32_t rate){
+  FILE* fp = fopen(path, "wb");
+  if(!fp){
+    return false;
+  }
+  sim_wav_header(fp, rate, 0);
+
+  auto start = std::chrono::steady_clock::now();
+  uint64_t samples = render(rate, file_sink, fp);
+  double took = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  fseek(fp, 0, SEEK_SET);
+  sim_wav_header(fp, rate, samples);
+  bool ok = ferror(fp) == 0;
+  fclose(fp);
+
+  fprintf(stderr, "wav            %12.3f s audio  %llu samples at %lu Hz  %.0fx real time\n",
+          (double)samples / rate, (unsigned long long)samples, (unsigned long)rate,
+          took > 0 ? samples / (double)rate / took : 0.0);
+  return ok && samples > 0;
+}
+
+/**
+ * Time the oscillator alone over the recorded words and check the sine
+ * polynomial against sin()
+ * @param uint32_t rate - samples per second
+ * @param uint32_t runs - renders to time
+**/
+void sim_wav_bench(uint32_t rate, uint32_t runs){
+  uint32_t ph[BLOCK];
+  float sine[BLOCK];
+  double worst = 0;
+  for(uint32_t k = 0; k < (1u << 20); k += BLOCK){
+    for(uint32_t i = 0; i < BLOCK; i++){
+      ph[i] = (k + i) * 4096u;
+    }
+    sine_block(ph, sine);
+    for(uint32_t i = 0; i < BLOCK; i++){
+      double err = fabs(sine[i] - sin(ph[i] / TURN * 2 * M_PI));
+      worst = err > worst ? err : worst;
+    }
+  }
+
+  int64_t sum = 0;
+  uint64_t samples = 0;
+  auto start = std::chrono::steady_clock::now();
+  for(uint32_t r = 0; r < runs; r++){
+    samples = render(rate, null_sink, &sum);
+  }
+  double took = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() / runs;
+
+  fprintf(stderr, "wav bench      %12.3f ms per render  %.1f Msamples/s  %.0fx real time  sine error %.3f LSB\n",
+          took * 1e3, took > 0 ? samples / took / 1e6 : 0.0,
+          took > 0 ? samples / (double)rate / took : 0.0, worst * AMPLITUDE);
+}
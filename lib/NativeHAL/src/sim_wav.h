@@ -0,0 +1,29 @@
+/**
+ * Offline audio of the recorded AD9850 output.
+ *
+ * The tuning words latched during the run (AD9850.h) are played through a
+ * numerically controlled oscillator: the phase runs on continuously across
+ * every word change, as it does in the chip's phase accumulator, and a word
+ * that lands between two samples splits that sample's phase step at its
+ * exact time. A powered down DDS is silence. The audio starts at the first
+ * tone and ends at the last word, and is written as 16 bit mono WAV.
+ *
+ * Each run of samples at one frequency is made in blocks: the phases first,
+ * then a branch free sine polynomial over the whole block, which the compiler
+ * turns into SIMD code. sim_wav_bench() times that against real time and
+ * checks the polynomial against sin().
+**/
+
+#ifndef SIM_WAV_H
+#define SIM_WAV_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#define SIM_WAV_RATE 48000          // Default sample rate (Hz)
+
+bool sim_wav_render(const char* path, uint32_t rate);
+void sim_wav_bench(uint32_t rate, uint32_t runs);
+void sim_wav_header(FILE* fp, uint32_t rate, uint32_t samples);
+
+#endif
@@ -0,0 +1,172 @@
+#include "arena.h"
+#include "sstv_mode.h"
+#include "cam_capture.h"
+#include "sd_writer.h"
+#include "jpeg_scale.h"
+#include "jpeg_stream.h"
+#include "frame_file.h"
+#include "line_ring.h"
+
+#ifdef SSTV_NATIVE
+#include "sim_clock.h"
+#endif
+
+#define STACK_PAINT 0xA5
+#define STACK_MARGIN 256          // Below the stack pointer left unpainted
+
+// What each stage takes, in the order it takes it
+#ifdef DECODE_TO_BIN
+#define TRANSMIT_BYTES (SSTV_RGB_LINE + LINE_RING_BYTES)
+#else
+#define TRANSMIT_BYTES (JPEG_SCALE_BYTES + JPEG_STREAM_BYTES + SSTV_RGB_LINE + LINE_RING_BYTES)
+#endif
+#ifdef BEACON
+#define HELD_BYTES TRANSMIT_BYTES  // The next frame is prepared above the one on the air
+#elif defined(FAST_BOOT)
+#define HELD_BYTES (SSTV_RGB_LINE + LINE_RING_BYTES)  // The picture is taken while the overlay is sent
+#else
+#define HELD_BYTES 0
+#endif
+#define CAPTURE_BYTES (HELD_BYTES + CAM_BUFFER_BYTES + SD_WRITER_BYTES)
+#define DECODE_BYTES (HELD_BYTES + JPEG_SCALE_BYTES + FRAME_FILE_BYTES + SD_WRITER_BYTES + SSTV_RGB_LINE)
+
+#define MAX2(a, b) ((a) > (b) ? (a) : (b))
+#define ARENA_BYTES MAX2(CAPTURE_BYTES, MAX2(DECODE_BYTES, TRANSMIT_BYTES))
+
+static_assert(ARENA_BYTES <= ARENA_LIMIT, "pipeline buffers do not fit ARENA_LIMIT");
+
+static const uint32_t planned[ARENA_STAGES] = { CAPTURE_BYTES, DECODE_BYTES, TRANSMIT_BYTES };
+static const char* const names[ARENA_STAGES] = { "Capture", "Decode", "Transmit" };
+
+static byte arena[ARENA_BYTES] __attribute__((aligned(ARENA_ALIGN)));
+static uint32_t top = 0;          // Bytes handed out in this stage
+static uint32_t base = 0;         // Bytes kept under it, see arena_hold()
+static uint8_t stage = ARENA_CAPTURE;
+static uint32_t peak[ARENA_STAGES];
+static uint32_t allocs = 0;       // arena_alloc() calls since reset
+
+#ifndef SSTV_NATIVE
+extern "C" char* sbrk(int incr);
+static byte* paintTo = 0;         // Top of the painted RAM
+#endif
+
+/**
+ * Fill the free RAM between the heap and the stack with a pattern, so the
+ * report can tell how close they came. Call first thing in setup().
+**/
+void arena_paint_stack(){
+#ifndef SSTV_NATIVE
+  paintTo = (byte*)__get_MSP() - STACK_MARGIN;
+  for(byte* p = (byte*)sbrk(0); p < paintTo; p++){
+    *p = STACK_PAINT;
+  }
+#endif
+}
+
+/**
+ * Start a stage, giving back every buffer of the one before
+ * @param uint8_t s - ARENA_CAPTURE...
+**/
+void arena_begin(uint8_t s){
+  stage = s;
+  top = base;
+}
+
+/**
+ * Keep the buffers taken so far under every stage begun until
+ * arena_release(), so a stage can run while the current one goes on
+**/
+void arena_hold(){
+  base = top;
+}
+
+/**
+ * Stop keeping the buffers of arena_hold(). What is in use stays valid
+ * until the next arena_begin().
+**/
+void arena_release(){
+  base = 0;
+}
+
+/**
+ * Take a buffer for the rest of the stage
+ * @param uint32_t bytes - size, rounded up to ARENA_ALIGN
+ * @return void* - the buffer, contents undefined
+**/
+void* arena_alloc(uint32_t bytes){
+  bytes = (bytes + ARENA_ALIGN - 1) / ARENA_ALIGN * ARENA_ALIGN;
+  if(top + bytes > sizeof(arena)){
+    Serial.print("Arena full in ");
+    Serial.println(names[stage]);
+    while (1);
+  }
+
+  void* p = arena + top;
+  top += bytes;
+  allocs++;
+  if(top > peak[stage]){
+    peak[stage] = top;
+  }
+  return p;
+}
+
+/**
+ * Buffers taken since reset, in every stage
+ * @return uint32_t - arena_alloc() calls
+**/
+uint32_t arena_allocs(){
+  return allocs;
+}
+
+/**
+ * Print what every stage takes as planned at build time, and the arena
+ * against ARENA_LIMIT, without running anything
+**/
+void arena_plan(){
+  Serial.print("RAM arena plan: ");
+  Serial.print(sizeof(arena));
+  Serial.print(" of ");
+  Serial.print(ARENA_LIMIT);
+  Serial.println(" bytes");
+  for(uint8_t s = 0; s < ARENA_STAGES; s++){
+    Serial.print("  ");
+    Serial.print(names[s]);
+    Serial.print(": ");
+    Serial.print(planned[s]);
+    Serial.println(" bytes");
+  }
+}
+
+/**
+ * Print the arena use of every stage against its plan
+**/
+void arena_report(){
+  Serial.print("RAM arena: ");
+  Serial.print(sizeof(arena));
+  Serial.println(" bytes");
+  bool planOk = true;
+  for(uint8_t s = 0; s < ARENA_STAGES; s++){
+    Serial.print("  ");
+    Serial.print(names[s]);
+    Serial.print(": peak ");
+    Serial.print(peak[s]);
+    Serial.print(" of ");
+    Serial.print(planned[s]);
+    Serial.println(" planned");
+    planOk = planOk && peak[s] <= planned[s];
+  }
+#ifdef SSTV_NATIVE
+  sim_check(planOk, "arena stages within their plan");
+#endif
+
+#ifndef SSTV_NATIVE
+  byte* heapEnd = (byte*)sbrk(0);   // The heap never shrinks
+  byte* p = heapEnd;
+  while(p < paintTo && *p == STACK_PAINT){
+    p++;
+  }
+  Serial.print("Heap to stack never touched: ");
+  Serial.print(p - heapEnd);
+  Serial.println(" bytes");
+#endif
+}
@@ -0,0 +1,438 @@
+#include "bench.h"
+
+#ifdef BENCH
+#ifndef SSTV_NATIVE
+#error "BENCH times the pipeline on the host, build it in the native env"
+#endif
+
+#include <SD.h>
+#include <JPEGDecoder.h>
+#include <stdlib.h>
+#include <new>
+#include "dds.h"
+#include "overlay.h"
+#include "sstv_mode.h"
+#include "arena.h"
+#include "trace.h"
+#include "catalog.h"
+#include "jpeg_scale.h"
+#include "sim_clock.h"
+#include "sim_jpeg.h"
+
+// Pipeline stages, in main.cpp
+uint16_t scottie_freq(uint8_t c);
+bool decode_start(char* filename, char* fileout);
+bool decode_step();
+bool decode_finish();
+bool sstv_transmit_file(char* filename);
+
+// How a figure is compared with its baseline
+#define BENCH_HOST 0                // Host time, lower is better
+#define BENCH_HOST_RATE 1           // Host throughput, higher is better
+#define BENCH_SIM 2                 // Simulated time, lower is better
+#define BENCH_COUNT 3               // Allocations, no more than the baseline
+#define BENCH_REL 4                 // Host time over a reference timed alongside
+
+struct bench_result_t {
+  const char* stage;
+  const char* name;                 // Case: corpus file or what was timed
+  const char* metric;
+  double value;
+  uint8_t kind;                     // BENCH_HOST...
+};
+
+// 5MP.JPG is 2592x1944, wide enough for the reduced IDCT
+static const char* const corpus[] = { "160X120.JPG", "320X240.JPG", "640X480.JPG", "5MP.JPG" };
+static const uint8_t CORPUS_FILES = sizeof(corpus) / sizeof(corpus[0]);
+
+static bench_result_t results[BENCH_RESULTS];
+static uint8_t count = 0;
+static uint32_t heapAllocs = 0;     // operator new calls since reset
+static volatile uint32_t sink;      // Keeps the timed loops from being folded
+static double calibration = 0;      // Calibration loop, fastest host ns per byte
+
+void* operator new(size_t bytes){
+  heapAllocs++;
+  void* p = malloc(bytes ? bytes : 1);
+  if(!p){
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+void operator delete(void* p) noexcept {
+  free(p);
+}
+
+/**
+ * Arena and heap allocations so far
+**/
+static uint32_t allocs(){
+  return arena_allocs() + heapAllocs;
+}
+
+static void add(const char* stage, const char* name, const char* metric, double value, uint8_t kind){
+  if(count >= BENCH_RESULTS){
+    Serial.println("bench: too many results");
+    while (1);
+  }
+  bench_result_t* r = &results[count++];
+  r->stage = stage;
+  r->name = name;
+  r->metric = metric;
+  r->value = value;
+  r->kind = kind;
+}
+
+/**
+ * Time the host reference decoder (sim_jpeg.h) over a corpus JPEG, reduced
+ * as the firmware reduces it. It runs on the same host in the same run,
+ * interleaved with the firmware's decodes, so a host figure over it keeps
+ * only what the firmware's code costs.
+ * @param const char* filename - corpus JPEG
+ * @return uint64_t - host ns it took, 0 if it failed
+**/
+static uint64_t bench_reference(const char* filename){
+  char path[256];
+  strcpy(path, SD.root());
+  strcat(path, "/");
+  strcat(path, filename);
+
+  sim_jpeg_t ref;
+  uint64_t hostFrom = sim_host_ns();
+  if(!sim_jpeg_decode(path, JPEG_SCALE_REDUCE * JPEG_SCALE_WIDTH, &ref)){
+    return 0;
+  }
+  uint64_t host = sim_host_ns() - hostFrom;
+  sink += ref.rgb[0];
+  return host;
+}
+
+/**
+ * Decode every corpus JPEG to the bench frame file
+ * @return bool - false if one could not be decoded
+**/
+static bool bench_decode(){
+  char fileout[] = BENCH_FRAME;
+
+  for(uint8_t f = 0; f < CORPUS_FILES; f++){
+    char filename[CATALOG_NAME];
+    strcpy(filename, corpus[f]);
+    File jpg = SD.open(filename);
+    if(!jpg){
+      Serial.print("bench: no ");
+      Serial.println(filename);
+      return false;
+    }
+    uint32_t bytes = jpg.size();
+    jpg.close();
+
+    uint64_t bestHost = UINT64_MAX;
+    uint64_t bestRef = UINT64_MAX;
+    uint64_t sim = 0;
+    uint32_t frameAllocs = 0;
+    uint32_t pixels = 0;
+    for(uint8_t run = 0; run < BENCH_RUNS; run++){
+      uint32_t allocsFrom = allocs();
+      uint64_t simFrom = sim_now_ns();
+      uint64_t hostFrom = sim_host_ns();
+      if(!decode_start(filename, fileout)){
+        return false;
+      }
+      while(decode_step());
+      if(!decode_finish()){
+        return false;
+      }
+      bestHost = min(bestHost, sim_host_ns() - hostFrom);
+      sim = sim_now_ns() - simFrom;
+      frameAllocs = allocs() - allocsFrom;
+      pixels = (uint32_t)JpegDec.width * JpegDec.height;
+
+      uint64_t ref = bench_reference(filename);
+      if(ref == 0){
+        Serial.print("bench: reference decoder failed on ");
+        Serial.println(filename);
+        return false;
+      }
+      bestRef = min(bestRef, ref);
+    }
+
+    add("decode", corpus[f], "host_ns_px", (double)bestHost / pixels, BENCH_HOST);
+    add("decode", corpus[f], "host_rel", (double)bestHost / bestRef, BENCH_REL);
+    add("decode", corpus[f], "mb_s", bytes * 1000.0 / bestHost, BENCH_HOST_RATE);
+    add("decode", corpus[f], "sim_ns_px", (double)sim / pixels, BENCH_SIM);
+    add("decode", corpus[f], "allocs", frameAllocs, BENCH_COUNT);
+  }
+  return true;
+}
+
+/**
+ * Time a fixed loop, FNV-1a over a buffer, for the stages that decode
+ * nothing to be put against. One multiply after another, so only the
+ * host's speed changes it; it is timed between their own timings and the
+ * fastest counts.
+**/
+static void bench_calibrate(){
+  static uint8_t buf[BENCH_CAL_BYTES];
+  for(uint16_t i = 0; i < BENCH_CAL_BYTES; i++){
+    buf[i] = i * 37;
+  }
+
+  uint64_t hostFrom = sim_host_ns();
+  uint32_t hash = 2166136261UL;
+  for(uint16_t pass = 0; pass < BENCH_CAL_PASSES; pass++){
+    for(uint16_t i = 0; i < BENCH_CAL_BYTES; i++){
+      hash = (hash ^ buf[i]) * 16777619UL;
+    }
+  }
+  double ns = (double)(sim_host_ns() - hostFrom) / ((double)BENCH_CAL_PASSES * BENCH_CAL_BYTES);
+  sink += hash;
+  if(calibration == 0 || ns < calibration){
+    calibration = ns;
+  }
+}
+
+/**
+ * Composite the header and footer into white line groups
+**/
+static void bench_overlay(){
+  const uint16_t groups = (OVERLAY_LINES + Mode::Layout::lines - 1) / Mode::Layout::lines;
+
+  arena_begin(ARENA_TRANSMIT);
+  byte* white = (byte*)arena_alloc(SSTV_RGB_LINE);
+  byte* slot = (byte*)arena_alloc(Mode::Layout::bytes);
+  memset(white, 0xFF, SSTV_RGB_LINE);
+  const byte* rows[Mode::Layout::lines];
+  for(uint8_t i = 0; i < Mode::Layout::lines; i++){
+    rows[i] = white;
+  }
+
+  uint64_t host = UINT64_MAX;
+  for(uint8_t timing = 0; timing < BENCH_RUNS; timing++){
+    bench_calibrate();
+    uint64_t hostFrom = sim_host_ns();
+    for(uint16_t run = 0; run < BENCH_OVERLAY_RUNS; run++){
+      for(uint16_t g = 0; g < groups; g++){
+        Mode::Layout::encode(slot, rows);
+        overlay_group(slot, g);
+      }
+      sink += slot[run % Mode::Layout::bytes];
+    }
+    host = min(host, sim_host_ns() - hostFrom);
+  }
+
+  const double nsPx = (double)host / ((double)BENCH_OVERLAY_RUNS * groups * Mode::Layout::lines * SSTV_WIDTH);
+  add("overlay", "header_footer", "host_ns_px", nsPx, BENCH_HOST);
+  add("overlay", "header_footer", "host_rel", nsPx / calibration, BENCH_REL);
+}
+
+/**
+ * Colour to tuning word, computed as the AD9850 library does and looked up
+ * as the transmitter does
+**/
+static void bench_freq(){
+  const double pixels = (double)BENCH_FREQ_RUNS * 256;
+
+  uint64_t host = UINT64_MAX;
+  for(uint8_t timing = 0; timing < BENCH_RUNS; timing++){
+    bench_calibrate();
+    uint64_t hostFrom = sim_host_ns();
+    uint32_t sum = 0;
+    for(uint32_t run = 0; run < BENCH_FREQ_RUNS; run++){
+      for(uint16_t c = 0; c < 256; c++){
+        sum += dds_word(scottie_freq((c + run) & 0xFF));
+      }
+    }
+    host = min(host, sim_host_ns() - hostFrom);
+    sink += sum;
+  }
+  add("freq", "scottie_freq_word", "host_ns_px", host / pixels, BENCH_HOST);
+  add("freq", "scottie_freq_word", "host_rel", host / pixels / calibration, BENCH_REL);
+
+  host = UINT64_MAX;
+  for(uint8_t timing = 0; timing < BENCH_RUNS; timing++){
+    bench_calibrate();
+    uint64_t hostFrom = sim_host_ns();
+    uint32_t sum = 0;
+    for(uint32_t run = 0; run < BENCH_FREQ_RUNS; run++){
+      for(uint16_t c = 0; c < 256; c++){
+        sum += dds_lut[(c + run) & 0xFF];
+      }
+    }
+    host = min(host, sim_host_ns() - hostFrom);
+    sink += sum;
+  }
+  add("freq", "dds_lut", "host_ns_px", host / pixels, BENCH_HOST);
+  add("freq", "dds_lut", "host_rel", host / pixels / calibration, BENCH_REL);
+}
+
+/**
+ * Send the bench frame file once
+ * @return bool - false if it could not be opened
+**/
+static bool bench_transmit(){
+  char filename[] = BENCH_FRAME;
+
+  uint32_t allocsFrom = allocs();
+  if(!sstv_transmit_file(filename)){
+    return false;
+  }
+  uint32_t frameAllocs = allocs() - allocsFrom;
+
+  const double nsPerCycle = 1000.0 / TRACE_CPU_MHZ;
+  const double pixels = (double)Mode::lines * SSTV_WIDTH;
+  add("transmit", "isr", "sim_ns_px", trace_total(TRACE_ISR) * nsPerCycle / pixels, BENCH_SIM);
+  uint32_t reads = trace_count(TRACE_SD_READ);
+  if(reads > 0){
+    add("transmit", "sd_read", "sim_ns_line",
+        trace_total(TRACE_SD_READ) * nsPerCycle / ((double)reads * Mode::Layout::lines), BENCH_SIM);
+  }
+  add("transmit", "frame", "allocs", frameAllocs, BENCH_COUNT);
+  return true;
+}
+
+/**
+ * Baseline figure of a result
+ * @param const char* csv - BENCH_BASELINE contents
+ * @param bench_result_t* r - result
+ * @param double* value - gets the figure
+ * @return bool - false if the baseline does not have it
+**/
+static bool baseline_value(const char* csv, const bench_result_t* r, double* value){
+  char key[64];
+  strcpy(key, r->stage);
+  strcat(key, ",");
+  strcat(key, r->name);
+  strcat(key, ",");
+  strcat(key, r->metric);
+  strcat(key, ",");
+  size_t len = strlen(key);
+
+  for(const char* line = csv; *line; ){
+    if(strncmp(line, key, len) == 0){
+      *value = strtod(line + len, 0);
+      return true;
+    }
+    const char* end = strchr(line, '\n');
+    if(!end){
+      break;
+    }
+    line = end + 1;
+  }
+  return false;
+}
+
+/**
+ * Whether a result is within the slack of its baseline
+**/
+static bool within(const bench_result_t* r, double base){
+  switch(r->kind){
+    case BENCH_HOST:
+      return r->value <= base * BENCH_HOST_SLACK;
+    case BENCH_HOST_RATE:
+      return r->value * BENCH_HOST_SLACK >= base;
+    case BENCH_SIM:
+      return r->value <= base * BENCH_SIM_SLACK;
+    case BENCH_REL:
+      return r->value <= base * BENCH_REL_SLACK;
+    default:
+      return r->value <= base;
+  }
+}
+
+/**
+ * Print every result against the baseline, or with -DBENCH_RECORD write all
+ * but the absolute host ones as the new baseline
+ * @return bool - false on a regression or without a baseline
+**/
+static bool bench_compare(){
+  static char csv[BENCH_RESULTS * 64];
+  File file;
+
+#ifdef BENCH_RECORD
+  const bool recording = true;
+  SD.remove(BENCH_BASELINE);        // FILE_WRITE appends
+  file = SD.open(BENCH_BASELINE, FILE_WRITE);
+  if(!file){
+    Serial.println("bench: error writing baseline");
+    return false;
+  }
+  Serial.println("bench: recording the baseline");
+#else
+  const bool recording = false;
+  if(!SD.exists(BENCH_BASELINE)){
+    Serial.println("bench: no " BENCH_BASELINE ", build with -DBENCH_RECORD to take one");
+    return false;
+  }
+  file = SD.open(BENCH_BASELINE);
+  int n = file ? file.read(csv, sizeof(csv) - 1) : -1;
+  file.close();
+  if(n < 0){
+    Serial.println("bench: error reading baseline");
+    return false;
+  }
+  csv[n] = 0;
+#endif
+
+  bool ok = true;
+  Serial.println("bench,stage,case,metric,value,baseline,result");
+  for(uint8_t i = 0; i < count; i++){
+    const bench_result_t* r = &results[i];
+    const bool host = r->kind == BENCH_HOST || r->kind == BENCH_HOST_RATE;
+    double base = 0;
+    const char* verdict = host ? "host" : "missing";
+    if(recording){
+      if(!host){
+        file.print(r->stage);
+        file.print(",");
+        file.print(r->name);
+        file.print(",");
+        file.print(r->metric);
+        file.print(",");
+        file.println(r->value, 6);
+        base = r->value;
+        verdict = "recorded";
+      }
+    } else if(baseline_value(csv, r, &base)){
+      verdict = within(r, base) ? "ok" : "regressed";
+      ok = ok && within(r, base);
+    } else if(!host){
+      ok = false;
+    }
+
+    Serial.print("bench,");
+    Serial.print(r->stage);
+    Serial.print(",");
+    Serial.print(r->name);
+    Serial.print(",");
+    Serial.print(r->metric);
+    Serial.print(",");
+    Serial.print(r->value, 3);
+    Serial.print(",");
+    Serial.print(base, 3);
+    Serial.print(",");
+    Serial.println(verdict);
+  }
+  if(recording){
+    file.close();
+  }
+  return ok;
+}
+
+/**
+ * Run every stage over the corpus and check the figures. The SD card,
+ * the DDS and the overlay text must be set up.
+**/
+void bench_run(){
+  Serial.println("Benchmark");
+  bool ran = bench_decode();
+  bench_overlay();
+  bench_freq();
+  ran = ran && bench_transmit();
+  SD.remove(BENCH_FRAME);
+
+  sim_check(ran, "bench corpus decoded and sent");
+  sim_check(bench_compare(), "bench figures within their baseline");
+}
+
+#endif
@@ -0,0 +1,75 @@
+#include "boot.h"
+
+struct boot_mark_t {
+  const char* phase;
+  unsigned long us;                 // micros() the phase ended
+};
+
+static boot_mark_t marks[BOOT_MARKS];
+static uint8_t count = 0;
+static unsigned long firstTone = 0;
+static bool reported = false;       // Marks after the report are dropped
+
+static void add(const char* phase, unsigned long us){
+  if(reported || count >= BOOT_MARKS){
+    return;
+  }
+  marks[count].phase = phase;
+  marks[count].us = us;
+  count++;
+}
+
+/**
+ * Mark the end of a boot phase
+ * @param const char* phase - name, a string constant
+**/
+void boot_mark(const char* phase){
+  add(phase, micros());
+}
+
+/**
+ * Mark the first tone. Only the first frame counts.
+ * @param unsigned long us - micros() of its first edge
+**/
+void boot_first_tone(unsigned long us){
+  if(firstTone != 0){
+    return;
+  }
+  firstTone = us;
+  add("First tone", us);
+}
+
+/**
+ * Print the phases in the order they ended and boot to first tone. Only the
+ * first call prints.
+**/
+void boot_report(){
+  if(reported){
+    return;
+  }
+  reported = true;
+
+  Serial.println("Boot phases (ms since reset, ms taken):");
+  unsigned long prev = 0;
+  bool used[BOOT_MARKS] = { false };
+  for(uint8_t n = 0; n < count; n++){
+    int8_t next = -1;
+    for(uint8_t i = 0; i < count; i++){
+      if(!used[i] && (next < 0 || marks[i].us < marks[next].us)){
+        next = i;
+      }
+    }
+    used[next] = true;
+    Serial.print("  ");
+    Serial.print(marks[next].phase);
+    Serial.print(" ");
+    Serial.print(marks[next].us / 1000.0, 1);
+    Serial.print(" ");
+    Serial.println((marks[next].us - prev) / 1000.0, 1);
+    prev = marks[next].us;
+  }
+
+  Serial.print("Boot to first tone: ");
+  Serial.print(firstTone / 1000.0, 1);
+  Serial.println(" ms");
+}
@@ -0,0 +1,463 @@
+#include "cam_capture.h"
+#include "sd_writer.h"
+#include "arena.h"
+#include "gps.h"
+
+#define CAM_SERIAL 0x00           // Camera serial number in every frame
+#define CAM_READ_DELAY 10         // READ_FBUF gap before the data, 0.01 ms
+#define CAM_QUIET_MS 10           // Line idle this long after a bad reply
+
+#define VC0706_GEN_VERSION 0x11
+#define VC0706_SET_PORT 0x24
+#define VC0706_READ_DATA 0x30
+#define VC0706_WRITE_DATA 0x31
+#define VC0706_READ_FBUF 0x32
+#define VC0706_GET_FBUF_LEN 0x34
+#define VC0706_FBUF_CTRL 0x36
+
+// Link bring-up, one command per cam_begin_step()
+#define LINK_PORT 0               // Asking for the next faster rate
+#define LINK_ANSWER 1             // Checking the camera answers at it
+#define LINK_GET_SIZE 2           // Reading the picture size
+#define LINK_SET_SIZE 3           // Writing CAM_SIZE
+#define LINK_CHECK_SIZE 4         // Reading it back
+#define LINK_DONE 5
+#define LINK_TRIES 3              // Answers at a new rate, or size writes, tried
+
+// Rates tried, fastest first, with their SET_PORT codes
+static const unsigned long bauds[] = { 115200, 57600, CAM_BAUD };
+static const uint16_t baudCodes[] = { 0x0DA6, 0x1C4C, 0x2AF2 };
+
+static unsigned long baud = CAM_BAUD;
+static bool linked = false;              // The camera answered since power on
+static uint8_t linkStage = LINK_DONE;
+static uint8_t linkRate;                 // Index in bauds being tried
+static uint8_t linkTries;
+static bool sized;                       // The camera reports CAM_SIZE
+static uint16_t chunk = CAM_CHUNK_MAX;   // Largest chunk that came back whole this capture
+static unsigned long settleFrom;         // millis() of the size change
+
+static byte* chunkBuf[2];               // From the arena
+static const byte* pendingData;          // Received chunk not written to SD yet
+static uint16_t pendingLeft = 0;
+
+// Capture in progress
+static uint32_t len;                     // Frame bytes
+static uint32_t offset;                  // Next byte to ask for
+static uint8_t cur;                      // chunkBuf received into next
+static uint16_t retries;
+static bool ok;                          // No chunk given up on
+static unsigned long start;              // millis() the first chunk was asked for
+
+/**
+ * Send a command frame, dropping anything left over in the receive buffer
+ * @param uint8_t cmd - command id
+ * @param const uint8_t* args - arguments
+ * @param uint8_t n - argument bytes
+**/
+static void cam_send(uint8_t cmd, const uint8_t* args, uint8_t n){
+  while(Serial1.available()){
+    Serial1.read();
+  }
+  Serial1.write((uint8_t)0x56);
+  Serial1.write((uint8_t)CAM_SERIAL);
+  Serial1.write(cmd);
+  Serial1.write(n);
+  Serial1.write(args, n);
+}
+
+/**
+ * Read bytes from the camera
+ * @param byte* dst - n bytes
+ * @param uint16_t n - count
+ * @param unsigned long deadline - millis() to give up at
+ * @return bool - false on timeout
+**/
+static bool cam_read(byte* dst, uint16_t n, unsigned long deadline){
+  uint16_t got = 0;
+  while(got < n){
+    int c = Serial1.read();
+    if(c >= 0){
+      dst[got++] = c;
+    } else if((long)(millis() - deadline) > 0){
+      return false;
+    } else {
+      gps_poll();
+    }
+  }
+  return true;
+}
+
+/**
+ * Send a command and check its reply
+ * @param uint8_t cmd - command id
+ * @param const uint8_t* args - arguments
+ * @param uint8_t n - argument bytes
+ * @param byte* data - reply data
+ * @param uint8_t dataLen - reply data bytes expected
+ * @return bool - false on timeout or an error status
+**/
+static bool cam_command(uint8_t cmd, const uint8_t* args, uint8_t n, byte* data, uint8_t dataLen){
+  byte head[5];
+  cam_send(cmd, args, n);
+
+  unsigned long deadline = millis() + CAM_TIMEOUT_MS;
+  if(!cam_read(head, 5, deadline)){
+    return false;
+  }
+  if(head[0] != 0x76 || head[1] != CAM_SERIAL || head[2] != cmd || head[3] != 0 || head[4] != dataLen){
+    return false;
+  }
+  return cam_read(data, dataLen, deadline);
+}
+
+static bool cam_version(){
+  byte version[11];
+  return cam_command(VC0706_GEN_VERSION, 0, 0, version, sizeof(version));
+}
+
+/**
+ * Read the picture size
+ * @param byte* size - gets VC0706_320x240...
+ * @return bool - false if the camera did not answer
+**/
+static bool cam_get_size(byte* size){
+  uint8_t get[] = { 0x04, 0x01, 0x00, 0x19 };
+  return cam_command(VC0706_READ_DATA, get, sizeof(get), size, 1);
+}
+
+/**
+ * Ask the camera once at its power-on rate whether it is up. Does not wait
+ * for it, so it can be polled while it boots.
+ * @return bool - true if it answered
+**/
+bool cam_answers(){
+  baud = CAM_BAUD;
+  Serial1.begin(baud);
+  return cam_version();
+}
+
+/**
+ * Find the camera and bring its link up with cam_begin_start(),
+ * cam_begin_step() and cam_begin_finish() in one go. A camera found before
+ * may have stopped answering without a power cycle, so it is asked at the
+ * faster rates first.
+ * @return bool - false if no camera answers
+**/
+bool cam_begin(){
+  bool found = false;
+  for(uint8_t i = 0; linked && bauds[i] != CAM_BAUD && !found; i++){
+    baud = bauds[i];
+    Serial1.begin(baud);
+    found = cam_version();
+  }
+  for(uint8_t tries = 0; tries < 3 && !found; tries++){
+    found = cam_answers();
+  }
+  if(!found){
+    return false;
+  }
+
+  cam_begin_start();
+  while(cam_begin_step());
+  return cam_begin_finish();
+}
+
+/**
+ * Go on to the next faster rate than the link has, or to the picture size
+ * once there is none
+**/
+static void next_rate(){
+  linkRate++;
+  linkTries = 0;
+  linkStage = bauds[linkRate] > baud ? LINK_PORT : LINK_GET_SIZE;
+}
+
+/**
+ * Start bringing up the link of a camera that just answered, for
+ * cam_begin_step() to do
+**/
+void cam_begin_start(){
+  linked = true;
+  sized = false;
+  linkRate = 0;
+  linkTries = 0;
+  linkStage = bauds[0] > baud ? LINK_PORT : LINK_GET_SIZE;
+}
+
+/**
+ * Send one command of the link bring-up: move to the fastest rate the camera
+ * acks and then answers at (if it does not, the old rate is restored), then
+ * set CAM_SIZE and read it back, unless the camera already reports it. A
+ * step takes one reply, CAM_TIMEOUT_MS at most.
+ * @return bool - false once the link is up or the camera gave up
+**/
+bool cam_begin_step(){
+  uint8_t size[] = { 0x04, 0x01, 0x00, 0x19, CAM_SIZE };
+  byte now;
+
+  switch(linkStage){
+    case LINK_PORT: {
+      uint8_t args[] = { 0x01, (uint8_t)(baudCodes[linkRate] >> 8), (uint8_t)baudCodes[linkRate] };
+      if(cam_command(VC0706_SET_PORT, args, sizeof(args), 0, 0)){
+        Serial1.begin(bauds[linkRate]);
+        linkStage = LINK_ANSWER;
+      } else {
+        next_rate();
+      }
+      return true;
+    }
+
+    case LINK_ANSWER:
+      if(cam_version()){
+        baud = bauds[linkRate];
+        linkTries = 0;
+        linkStage = LINK_GET_SIZE;
+      } else if(++linkTries == LINK_TRIES){
+        Serial1.begin(baud);
+        next_rate();
+      }
+      return true;
+
+    case LINK_GET_SIZE:
+      if(cam_get_size(&now) && now == CAM_SIZE){
+        sized = true;
+        settleFrom = 0;
+        linkStage = LINK_DONE;
+      } else {
+        linkStage = LINK_SET_SIZE;
+      }
+      return true;
+
+    case LINK_SET_SIZE:
+      settleFrom = millis();
+      if(cam_command(VC0706_WRITE_DATA, size, sizeof(size), 0, 0)){
+        linkStage = LINK_CHECK_SIZE;
+      } else if(++linkTries == LINK_TRIES){
+        linkStage = LINK_DONE;
+      }
+      return true;
+
+    case LINK_CHECK_SIZE:
+      if(cam_get_size(&now) && now == CAM_SIZE){
+        sized = true;
+        settleFrom = millis();
+        linkStage = LINK_DONE;
+      } else {
+        linkStage = ++linkTries == LINK_TRIES ? LINK_DONE : LINK_SET_SIZE;
+      }
+      return true;
+  }
+  return false;
+}
+
+/**
+ * Report the link cam_begin_step() brought up
+ * @return bool - true if the camera takes pictures of CAM_SIZE
+**/
+bool cam_begin_finish(){
+  Serial.print("Camera link: ");
+  Serial.print(baud);
+  Serial.println(" baud");
+  return sized;
+}
+
+/**
+ * Write one sector of the chunk waiting for SD
+**/
+static void write_pending(){
+  uint16_t n = min(pendingLeft, (uint16_t)SD_WRITER_SECTOR);
+  sd_writer_write(pendingData, n);
+  pendingData += n;
+  pendingLeft -= n;
+}
+
+/**
+ * Ask for a chunk of the frozen frame
+ * @param uint32_t offset - first byte
+ * @param uint16_t n - bytes
+**/
+static void request_chunk(uint32_t offset, uint16_t n){
+  uint8_t args[] = {
+    0x00, 0x0A,
+    (uint8_t)(offset >> 24), (uint8_t)(offset >> 16), (uint8_t)(offset >> 8), (uint8_t)offset,
+    0x00, 0x00, (uint8_t)(n >> 8), (uint8_t)n,
+    CAM_READ_DELAY >> 8, CAM_READ_DELAY & 0xFF
+  };
+  cam_send(VC0706_READ_FBUF, args, sizeof(args));
+}
+
+/**
+ * Receive a READ_FBUF reply, writing the previous chunk to SD a sector at a
+ * time whenever the UART has nothing to give
+ * @param byte* dst - n bytes
+ * @param uint16_t n - chunk bytes
+ * @return bool - false if it timed out or the frame marks are wrong
+**/
+static bool receive_chunk(byte* dst, uint16_t n){
+  static const byte mark[] = { 0x76, CAM_SERIAL, VC0706_READ_FBUF, 0x00, 0x00 };
+  uint16_t total = n + 2 * sizeof(mark);
+  uint16_t got = 0;
+  bool ok = true;
+
+  // Wire time at 10 bits per byte on top of the reply latency
+  unsigned long deadline = millis() + CAM_TIMEOUT_MS + total * 10000UL / baud;
+  while(got < total){
+    int c = Serial1.read();
+    if(c >= 0){
+      if(got < sizeof(mark)){
+        ok = ok && c == mark[got];
+      } else if(got < sizeof(mark) + n){
+        dst[got - sizeof(mark)] = c;
+      } else {
+        ok = ok && c == mark[got - sizeof(mark) - n];
+      }
+      got++;
+    } else if(pendingLeft > 0){
+      write_pending();
+    } else if((long)(millis() - deadline) > 0){
+      return false;
+    } else {
+      gps_poll();
+    }
+  }
+  return ok;
+}
+
+/**
+ * Wait for the line to go quiet after a bad reply, dropping what comes in
+**/
+static void drain_line(){
+  unsigned long quiet = millis();
+  while((long)(millis() - quiet) < CAM_QUIET_MS){
+    if(Serial1.read() >= 0){
+      quiet = millis();
+    }
+  }
+}
+
+/**
+ * Whether the exposure has settled since the size change, or since power on
+ * if the size was already set
+**/
+bool cam_ready(){
+  return millis() - settleFrom >= CAM_SETTLE_MS;
+}
+
+/**
+ * Freeze the frame and open its file, for cam_capture_step() to read
+ * @param const char* filename - file on the SD card, replaced if it exists
+ * @return bool - false if the camera or the card failed
+**/
+bool cam_capture_start(const char* filename){
+  uint8_t stop[] = { 0x00 };
+  byte lenBytes[4];
+  if(!cam_command(VC0706_FBUF_CTRL, stop, 1, 0, 0) ||
+     !cam_command(VC0706_GET_FBUF_LEN, stop, 1, lenBytes, 4)){
+    return false;
+  }
+  len = (uint32_t)lenBytes[0] << 24 | (uint32_t)lenBytes[1] << 16 | lenBytes[2] << 8 | lenBytes[3];
+
+  if(!sd_writer_open(filename)){
+    return false;
+  }
+  chunkBuf[0] = (byte*)arena_alloc(CAM_CHUNK_MAX);
+  chunkBuf[1] = (byte*)arena_alloc(CAM_CHUNK_MAX);
+
+  start = millis();
+  offset = 0;
+  cur = 0;
+  chunk = CAM_CHUNK_MAX;
+  retries = 0;
+  ok = true;
+  pendingLeft = 0;
+  return true;
+}
+
+/**
+ * Read the next chunk, writing the one before to SD while it comes in. A
+ * step takes about one chunk's wire time.
+ * @return bool - false once the frame is read or the capture failed
+**/
+bool cam_capture_step(){
+  if(!ok || offset >= len){
+    return false;
+  }
+
+  uint16_t n = min((uint32_t)chunk, len - offset);
+  request_chunk(offset, n);
+  if(receive_chunk(chunkBuf[cur], n)){
+    while(pendingLeft > 0){  // Its buffer is the next one received into
+      write_pending();
+    }
+    pendingData = chunkBuf[cur];
+    pendingLeft = n;
+    cur ^= 1;
+    offset += n;
+  } else {
+    retries++;
+    drain_line();
+    if(chunk / 2 < CAM_CHUNK_MIN){
+      ok = false;
+    } else {
+      chunk /= 2;
+    }
+  }
+  return true;
+}
+
+/**
+ * Write the rest of the frame, close the file and let the camera run again
+ * @return bool - false if the camera or the card failed
+**/
+bool cam_capture_finish(){
+  uint8_t resume[] = { 0x03 };
+  while(pendingLeft > 0){
+    write_pending();
+  }
+  unsigned long took = millis() - start;
+
+  cam_command(VC0706_FBUF_CTRL, resume, 1, 0, 0);
+  ok = sd_writer_close("Capture") && ok;
+
+  Serial.print("Camera: ");
+  Serial.print(len);
+  Serial.print(" bytes in ");
+  Serial.print(took);
+  Serial.print(" ms at ");
+  Serial.print(baud);
+  Serial.print(" baud, ");
+  Serial.print(took ? len / (float)took : 0.0, 1);
+  Serial.print(" KB/s, chunk ");
+  Serial.print(chunk);
+  Serial.print(", retries ");
+  Serial.println(retries);
+  return ok;
+}
+
+/**
+ * Size of the last picture captured
+ * @return uint32_t - JPEG bytes
+**/
+uint32_t cam_capture_bytes(){
+  return len;
+}
+
+/**
+ * Snap a picture and save the JPEG, once the exposure has settled
+ * @param const char* filename - file on the SD card, replaced if it exists
+ * @return bool - false if the camera or the card failed
+**/
+bool cam_capture(const char* filename){
+  while(!cam_ready()){
+    if(!gps_poll()){
+      yield();
+    }
+  }
+
+  if(!cam_capture_start(filename)){
+    return false;
+  }
+  while(cam_capture_step());
+  return cam_capture_finish();
+}
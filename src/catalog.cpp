@@ -0,0 +1,166 @@
+#include "catalog.h"
+#include <SD.h>
+
+static File file;                   // CATALOG_FILE, kept open
+static catalog_entry_t ring[CATALOG_ENTRIES];
+static uint32_t next = 1;           // Number of the next capture
+
+/**
+ * Write one record back to the file
+ * @param catalog_entry_t* e - record in the ring
+**/
+static void save(const catalog_entry_t* e){
+  uint32_t at = sizeof(catalog_header_t) + (e - ring) * sizeof(catalog_entry_t);
+  if(!file.seek(at) || file.write((const uint8_t*)e, sizeof(catalog_entry_t)) != sizeof(catalog_entry_t)){
+    Serial.println("error writing catalog");
+  }
+  file.flush();
+}
+
+/**
+ * Record of a capture still in the ring
+ * @return catalog_entry_t* - 0 if it was retired or never taken
+**/
+static catalog_entry_t* entry(uint32_t seq){
+  catalog_entry_t* e = &ring[seq % CATALOG_ENTRIES];
+  return seq != 0 && e->seq == seq ? e : 0;
+}
+
+/**
+ * Open the catalog and read its ring, or start an empty one. Call once the
+ * SD card is up.
+**/
+void catalog_begin(){
+  catalog_header_t h;
+
+  file = SD.open(CATALOG_FILE, O_RDWR | O_CREAT);
+  bool ok = file && file.seek(0) && file.read(&h, sizeof(h)) == sizeof(h) &&
+            memcmp(h.magic, CATALOG_MAGIC, 4) == 0 && h.version == CATALOG_VERSION &&
+            h.entries == CATALOG_ENTRIES && file.read(ring, sizeof(ring)) == sizeof(ring);
+  if(!ok){
+    memcpy(h.magic, CATALOG_MAGIC, 4);
+    h.version = CATALOG_VERSION;
+    h.entries = CATALOG_ENTRIES;
+    h.reserved = 0;
+    memset(ring, 0, sizeof(ring));
+    if(!file || !file.seek(0) || file.write((const uint8_t*)&h, sizeof(h)) != sizeof(h) ||
+       file.write((const uint8_t*)ring, sizeof(ring)) != sizeof(ring)){
+      Serial.println("error writing catalog");
+    }
+    file.flush();
+  }
+
+  uint8_t n = 0;
+  next = 1;
+  for(uint8_t i = 0; i < CATALOG_ENTRIES; i++){
+    if(ring[i].seq != 0){
+      n++;
+      next = max(next, ring[i].seq + 1);
+    }
+  }
+
+  char jpg[CATALOG_NAME];
+  catalog_name(next, jpg);
+  Serial.print("Catalog: ");
+  Serial.print(n);
+  Serial.print(" captures, next ");
+  Serial.println(jpg);
+}
+
+/**
+ * Give out the next capture number and its JPEG name, retiring the capture
+ * whose record it takes
+ * @param char* jpg - CATALOG_NAME bytes, gets the name to capture to
+ * @return uint32_t - capture number
+**/
+uint32_t catalog_new(char* jpg){
+  uint32_t seq = next++;
+  catalog_entry_t* e = &ring[seq % CATALOG_ENTRIES];
+
+  if(e->seq != 0){
+    catalog_name(e->seq, jpg);
+    SD.remove(jpg);
+  }
+  memset(e, 0, sizeof(*e));
+  e->seq = seq;
+  e->status = CATALOG_CAPTURING;
+  save(e);
+
+  catalog_name(seq, jpg);
+  return seq;
+}
+
+/**
+ * JPEG name of a capture: IMG and the last five digits of its number
+ * @param uint32_t seq - capture number
+ * @param char* jpg - CATALOG_NAME bytes
+**/
+void catalog_name(uint32_t seq, char* jpg){
+  strcpy(jpg, "IMG00000.JPG");
+  for(int8_t i = 7; i >= 3; i--){
+    jpg[i] = '0' + seq % 10;
+    seq /= 10;
+  }
+}
+
+/**
+ * Look a capture up
+ * @param uint32_t seq - capture number
+ * @return const catalog_entry_t* - 0 if it is no longer on the card
+**/
+const catalog_entry_t* catalog_find(uint32_t seq){
+  return entry(seq);
+}
+
+/**
+ * The JPEG of a capture is complete
+ * @param uint32_t seq - from catalog_new()
+ * @param uint32_t bytes - its size
+**/
+void catalog_captured(uint32_t seq, uint32_t bytes){
+  catalog_entry_t* e = entry(seq);
+  if(e){
+    e->jpgBytes = bytes;
+    e->status = CATALOG_CAPTURED;
+    save(e);
+  }
+}
+
+/**
+ * The frame file of a capture is in the frame cache
+ * @param uint32_t seq - from catalog_new()
+ * @param uint32_t key - its frame cache key
+**/
+void catalog_decoded(uint32_t seq, uint32_t key){
+  catalog_entry_t* e = entry(seq);
+  if(e){
+    e->key = key;
+    e->status = CATALOG_DECODED;
+    save(e);
+  }
+}
+
+/**
+ * A capture went on the air
+ * @param uint32_t seq - from catalog_new()
+**/
+void catalog_sent(uint32_t seq){
+  catalog_entry_t* e = entry(seq);
+  if(e){
+    e->sent++;
+    e->status = CATALOG_SENT;
+    save(e);
+  }
+}
+
+/**
+ * Capturing or decoding a capture failed
+ * @param uint32_t seq - from catalog_new()
+**/
+void catalog_failed(uint32_t seq){
+  catalog_entry_t* e = entry(seq);
+  if(e){
+    e->status = CATALOG_FAILED;
+    save(e);
+  }
+}
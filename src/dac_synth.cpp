@@ -0,0 +1,317 @@
+#include "dac_synth.h"
+
+#ifdef DDS_DAC
+#ifdef SSTV_NATIVE
+#include "sim_clock.h"
+#include "sim_dac.h"
+#endif
+
+#define DAC_SINE_SIZE (1 << DAC_SINE_BITS)
+#define DAC_SILENT_BUFFERS 2        // Made after dac_down() before the clock stops
+
+static uint16_t sine[DAC_SINE_SIZE];
+static uint16_t buf[2][DAC_BLOCK];
+
+// Oscillator
+static uint32_t phase = 0;
+static volatile uint32_t tuning = 0;  // Phase step per sample
+static volatile bool muted = true;  // Holding DAC_MID until the next word
+
+// Clock
+static void (*handler)() = 0;
+static uint32_t tick = 0;           // Transmit clock tick of the next sample made
+static volatile uint32_t armedTick;
+static volatile bool armed = false;
+static volatile bool running = false;
+static bool filling = false;        // Inside fill(), edges are taken as it goes
+static uint8_t silent = 0;          // Silent buffers made since dac_down()
+static uint16_t late = 0;           // Buffers not refilled before the other was converted
+
+/**
+ * Sine table at full scale around DAC_MID
+**/
+static void sine_init(){
+  for(uint16_t i = 0; i < DAC_SINE_SIZE; i++){
+    sine[i] = DAC_MID + (int16_t)lround(DAC_AMPLITUDE * sin(2 * M_PI * i / DAC_SINE_SIZE));
+  }
+}
+
+/**
+ * Run the oscillator
+ * @param uint16_t* dst - samples to make
+ * @param uint16_t count - how many
+**/
+static void synth(uint16_t* dst, uint16_t count){
+  if(muted){
+    for(uint16_t i = 0; i < count; i++){
+      dst[i] = DAC_MID;
+    }
+    return;
+  }
+  uint32_t p = phase;
+  uint32_t w = tuning;
+  for(uint16_t i = 0; i < count; i++){
+    dst[i] = sine[p >> (32 - DAC_SINE_BITS)];
+    p += w;
+  }
+  phase = p;
+}
+
+/**
+ * Make a buffer, calling the edge handler at the sample boundary nearest to
+ * every edge armed on the way
+ * @param uint16_t* dst - DAC_BLOCK samples
+**/
+static void fill(uint16_t* dst){
+  filling = true;
+  uint16_t n = 0;
+  while(n < DAC_BLOCK){
+    uint16_t run = DAC_BLOCK - n;
+    if(armed){
+      int32_t ahead = (int32_t)(armedTick - tick);
+      int32_t samples = ahead > 0 ? (ahead + DAC_SAMPLE_TICKS / 2) / DAC_SAMPLE_TICKS : 0;
+      if(samples == 0){
+        armed = false;
+        handler();
+        continue;
+      }
+      if(samples < run){
+        run = samples;
+      }
+    }
+    synth(dst + n, run);
+    n += run;
+    tick += run * DAC_SAMPLE_TICKS;
+  }
+#ifdef SSTV_NATIVE
+  sim_advance((uint64_t)DAC_BLOCK * sim_cost.dac_sample);
+#endif
+  filling = false;
+}
+
+static void start();
+static void stop();
+
+/**
+ * The PDC is done with a buffer and converts the other one: make the next
+ * one in its place, or stop once the silence after dac_down() is out
+ * @param uint8_t done - buffer converted
+**/
+static void buffer_done(uint8_t done){
+  if(muted && silent >= DAC_SILENT_BUFFERS){
+    stop();
+    return;
+  }
+  if(muted){
+    silent++;
+  }
+  fill(buf[done]);
+}
+
+#ifdef SSTV_NATIVE
+
+static int sim_id = -1;
+static uint8_t playing;             // Buffer being converted
+static uint64_t playStart;          // Simulated time its first sample was converted
+
+/**
+ * PDC stand-in: a buffer has been converted, hand it to the DAC model. The
+ * one made in its place is late if the other one ran out first.
+**/
+static void sim_endtx(){
+  uint8_t done = playing;
+  sim_dac_play(buf[done], DAC_BLOCK, playStart, DAC_SAMPLE_NS);
+  playStart += (uint64_t)DAC_BLOCK * DAC_SAMPLE_NS;
+  playing ^= 1;
+  buffer_done(done);
+  if(running && sim_now_ns() > playStart + (uint64_t)DAC_BLOCK * DAC_SAMPLE_NS){
+    late++;
+  }
+}
+
+/**
+ * Fill the sine table and hold the output at DAC_MID
+**/
+void dac_begin(){
+  sine_init();
+  if(sim_id < 0){
+    sim_id = sim_timer_add(sim_endtx);
+  }
+}
+
+static void start(){
+  running = true;
+  silent = 0;
+  fill(buf[0]);
+  fill(buf[1]);
+  playing = 0;
+  playStart = sim_now_ns();
+  sim_timer_start(sim_id, (uint64_t)DAC_BLOCK * DAC_SAMPLE_NS);
+}
+
+static void stop(){
+  sim_timer_stop(sim_id);
+  running = false;
+}
+
+/**
+ * Samples made that the DAC has not converted yet
+**/
+uint32_t dac_queued(){
+  if(!running){
+    return 0;
+  }
+  uint64_t converted = (sim_now_ns() - playStart) / DAC_SAMPLE_NS;
+  return 2 * DAC_BLOCK - (uint32_t)min(converted, (uint64_t)DAC_BLOCK);
+}
+
+#else
+
+#define DAC_TC TC0
+#define DAC_CHANNEL 1               // TIOA1 triggers the DACC
+#define DAC_TRGSEL 2                // TIO output of TC0 channel 1
+
+/**
+ * Fill the sine table, set DAC0 up to convert on the sample clock and hold
+ * the output at DAC_MID
+**/
+void dac_begin(){
+  sine_init();
+
+  pmc_set_writeprotect(false);
+  pmc_enable_periph_clk(ID_DACC);
+  DACC->DACC_CR = DACC_CR_SWRST;
+  DACC->DACC_MR = DACC_MR_TRGEN_EN | DACC_MR_TRGSEL(DAC_TRGSEL) | DACC_MR_WORD_HALF |
+                  DACC_MR_USER_SEL_CHANNEL0 | DACC_MR_REFRESH(1) | DACC_MR_STARTUP_8;
+  DACC->DACC_IDR = 0xFFFFFFFF;
+  DACC->DACC_CHER = DACC_CHER_CH0;
+  DACC->DACC_CDR = DAC_MID;
+
+  // Sample clock: TIOA1 rises every DAC_SAMPLE_TICKS
+  pmc_enable_periph_clk(ID_TC1);
+  TC_Configure(DAC_TC, DAC_CHANNEL, TC_CMR_TCCLKS_TIMER_CLOCK1 | TC_CMR_WAVE | TC_CMR_WAVSEL_UP_RC |
+                                    TC_CMR_ACPA_CLEAR | TC_CMR_ACPC_SET);
+  TC_SetRC(DAC_TC, DAC_CHANNEL, DAC_SAMPLE_TICKS);
+  TC_SetRA(DAC_TC, DAC_CHANNEL, DAC_SAMPLE_TICKS / 2);
+
+  NVIC_ClearPendingIRQ(DACC_IRQn);
+  NVIC_SetPriority(DACC_IRQn, 0);
+  NVIC_EnableIRQ(DACC_IRQn);
+}
+
+static void start(){
+  running = true;
+  silent = 0;
+  fill(buf[0]);
+  fill(buf[1]);
+  DACC->DACC_TPR = (uint32_t)buf[0];
+  DACC->DACC_TCR = DAC_BLOCK;
+  DACC->DACC_TNPR = (uint32_t)buf[1];
+  DACC->DACC_TNCR = DAC_BLOCK;
+  DACC->DACC_PTCR = PERIPH_PTCR_TXTEN;
+  DACC->DACC_IER = DACC_IER_ENDTX;
+  TC_Start(DAC_TC, DAC_CHANNEL);
+}
+
+static void stop(){
+  TC_Stop(DAC_TC, DAC_CHANNEL);
+  DACC->DACC_IDR = DACC_IDR_ENDTX;
+  DACC->DACC_PTCR = PERIPH_PTCR_TXTDIS;
+  running = false;
+}
+
+/**
+ * Samples made that the DAC has not converted yet
+**/
+uint32_t dac_queued(){
+  if(!running){
+    return 0;
+  }
+  return DACC->DACC_TCR + DACC->DACC_TNCR;
+}
+
+/**
+ * ENDTX: the PDC has moved on to the next buffer; the one it was converting
+ * becomes the one after. Should it have run dry too, the output held the
+ * last sample in between and the buffer is counted late.
+**/
+void DACC_Handler(){
+  uint32_t status = DACC->DACC_ISR;
+  if(!(status & DACC_ISR_ENDTX)){
+    return;
+  }
+  if(status & DACC_ISR_TXBUFE){
+    late++;
+  }
+  uint32_t tpr = DACC->DACC_TPR;    // Inside the buffer now converted
+  uint8_t done = tpr >= (uint32_t)buf[1] && tpr <= (uint32_t)(buf[1] + DAC_BLOCK) ? 0 : 1;
+  buffer_done(done);
+  if(running){
+    DACC->DACC_TNPR = (uint32_t)buf[done];
+    DACC->DACC_TNCR = DAC_BLOCK;
+  }
+}
+
+#endif
+
+/**
+ * Take the transmit clock role
+ * @param void (*edge)() - called at every edge armed with dac_arm()
+**/
+void dac_clock(void (*edge)()){
+  handler = edge;
+}
+
+/**
+ * Transmit clock tick of the next sample made. Within the edge handler it
+ * is where the edge went out.
+**/
+uint32_t dac_tick(){
+  return tick;
+}
+
+/**
+ * Call the edge handler at the sample nearest to tick. Starts the clock if
+ * it is stopped: the first two buffers are made right away.
+ * @param uint32_t tick - absolute tick, wraps every 102 s
+**/
+void dac_arm(uint32_t at){
+  armedTick = at;
+  armed = true;
+  if(!running && !filling){
+    start();
+  }
+}
+
+/**
+ * Samples from now on come from a new tuning word, phase continuous
+ * @param uint32_t w - phase step per sample, dds_word()
+**/
+void dac_word(uint32_t w){
+  tuning = w;
+  muted = false;
+}
+
+/**
+ * Silence the output and stop the clock once everything made before has
+ * been converted
+**/
+void dac_down(){
+  muted = true;
+  while(running){
+    yield();
+  }
+}
+
+/**
+ * Print how many buffers were not made in time
+**/
+void dac_report(){
+  Serial.print("DAC buffers late: ");
+  Serial.println(late);
+#ifdef SSTV_NATIVE
+  sim_check(late == 0, "DAC buffers made before they were due");
+#endif
+}
+
+#endif
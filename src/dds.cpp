@@ -0,0 +1,164 @@
+#include <AD9850.h>
+#include "dds.h"
+#include "dds_stream.h"
+#include "trace.h"
+
+uint32_t dds_lut[256];    // Tuning word for each colour value
+
+#ifdef DDS_DAC
+
+void dds_begin(){
+  dac_begin();
+}
+
+#elif defined(SSTV_NATIVE)
+
+void dds_begin(){
+  DDS.begin(AD9850_CLK_PIN, AD9850_FQ_UPDATE_PIN, AD9850_DATA_PIN, AD9850_RST_PIN);
+}
+
+static inline void pin_set(uint8_t pin)   { sim_pin_write(pin, HIGH); }
+static inline void pin_clear(uint8_t pin) { sim_pin_write(pin, LOW); }
+
+#define DATA_SET()    pin_set(AD9850_DATA_PIN)
+#define DATA_CLEAR()  pin_clear(AD9850_DATA_PIN)
+#define CLK_PULSE()   do { pin_set(AD9850_CLK_PIN); pin_clear(AD9850_CLK_PIN); } while(0)
+#define FQ_UD_PULSE() do { pin_set(AD9850_FQ_UPDATE_PIN); pin_clear(AD9850_FQ_UPDATE_PIN); } while(0)
+
+#else
+
+static Pio* clk_port;
+static Pio* fq_ud_port;
+static Pio* data_port;
+static uint32_t clk_mask;
+static uint32_t fq_ud_mask;
+static uint32_t data_mask;
+
+void dds_begin(){
+  DDS.begin(AD9850_CLK_PIN, AD9850_FQ_UPDATE_PIN, AD9850_DATA_PIN, AD9850_RST_PIN);
+
+  clk_port = g_APinDescription[AD9850_CLK_PIN].pPort;
+  clk_mask = g_APinDescription[AD9850_CLK_PIN].ulPin;
+  fq_ud_port = g_APinDescription[AD9850_FQ_UPDATE_PIN].pPort;
+  fq_ud_mask = g_APinDescription[AD9850_FQ_UPDATE_PIN].ulPin;
+  data_port = g_APinDescription[AD9850_DATA_PIN].pPort;
+  data_mask = g_APinDescription[AD9850_DATA_PIN].ulPin;
+}
+
+#define DATA_SET()    (data_port->PIO_SODR = data_mask)
+#define DATA_CLEAR()  (data_port->PIO_CODR = data_mask)
+#define CLK_PULSE()   do { clk_port->PIO_SODR = clk_mask; clk_port->PIO_CODR = clk_mask; } while(0)
+#define FQ_UD_PULSE() do { fq_ud_port->PIO_SODR = fq_ud_mask; fq_ud_port->PIO_CODR = fq_ud_mask; } while(0)
+
+#endif
+
+/**
+ * Same tuning word DDS.setfreq() would load
+ * @param double freq - output frequency in Hz
+ * @return uint32_t - AD9850 frequency tuning word
+**/
+uint32_t dds_word(double freq){
+  return freq * 4294967296.0 / DDS_REF_CLK;
+}
+
+/**
+ * Fill the pixel table: colour c maps to base + c * step Hz
+ * @param double base - frequency of colour 0 (Hz)
+ * @param double step - Hz per colour step
+**/
+void dds_lut_init(double base, double step){
+  for(uint16_t c = 0; c < 256; c++){
+    dds_lut[c] = dds_word(base + c * step);
+  }
+}
+
+#ifdef DDS_DAC
+
+/**
+ * Change the synthesized tone from the next sample made on. Safe to call
+ * from the timer interrupt.
+ * @param uint32_t word - phase step per DAC sample
+**/
+void dds_write(uint32_t word){
+  uint32_t start = trace_now();
+  dac_word(word);
+  trace_span(TRACE_DDS_WRITE, start);
+}
+
+/**
+ * Silence the DAC once what was synthesized has gone out
+**/
+void dds_down(){
+  dac_down();
+}
+
+#elif defined(DDS_STREAM)
+
+static dds_stream_entry_t single[DDS_STREAM_ENTRIES(1)];
+
+/**
+ * Load one word once the scan in flight, if any, has latched its last word
+**/
+static void write_control(uint32_t word, uint8_t control){
+  dds_stream_finish();
+  dds_stream_append(single, word, control);
+  dds_stream_start_single(single);
+}
+
+/**
+ * Load a tuning word through the SPI stream (a few microseconds, does not
+ * wait for the latch)
+ * @param uint32_t word - frequency tuning word
+**/
+void dds_write(uint32_t word){
+  uint32_t start = trace_now();
+  write_control(word, 0);
+  trace_span(TRACE_DDS_WRITE, start);
+}
+
+/**
+ * Power the AD9850 down
+**/
+void dds_down(){
+  write_control(0, DDS_POWER_DOWN);
+}
+
+#else
+
+/**
+ * Shift a tuning word into the AD9850 (LSB first, phase 0, powered up) and
+ * latch it. Safe to call from the timer interrupt.
+ * @param uint32_t word - frequency tuning word
+**/
+void dds_write(uint32_t word){
+  uint32_t start = trace_now();
+#ifdef SSTV_NATIVE
+  sim_advance(sim_cost.dds_write);
+#endif
+  for(uint8_t i = 0; i < 32; i++, word >>= 1){
+    if(word & 1){
+      DATA_SET();
+    } else {
+      DATA_CLEAR();
+    }
+    CLK_PULSE();
+  }
+
+  // Control byte: phase 0, power down off, factory bits 0
+  DATA_CLEAR();
+  for(uint8_t i = 0; i < 8; i++){
+    CLK_PULSE();
+  }
+
+  FQ_UD_PULSE();
+  trace_span(TRACE_DDS_WRITE, start);
+}
+
+/**
+ * Power the AD9850 down
+**/
+void dds_down(){
+  DDS.down();
+}
+
+#endif
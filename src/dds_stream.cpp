@@ -0,0 +1,293 @@
+#include "dds.h"
+#include "dds_stream.h"
+
+#define TDR_PCS(npcs) ((uint32_t)((~(1u << (npcs))) & 0xF) << 16)
+#define TDR_LASTXFER (1u << 24)
+
+#define STREAM_MCK 84000000.0
+#define SINGLE_SCBR 8            // 10.5 MHz for one-off words, no pacing
+#define STREAM_DLYBCS 6          // MCK cycles FQ_UD stays high between words
+
+static volatile bool busy = false;
+static volatile unsigned long done_time = 0;
+static double period_us = 0;
+static uint8_t scbr = 255;       // SPCK = MCK / scbr
+static uint8_t dlybct = 0;       // 32 * dlybct MCK cycles after every byte
+
+static const uint8_t bitrev_nibble[16] = {
+  0x0, 0x8, 0x4, 0xC, 0x2, 0xA, 0x6, 0xE, 0x1, 0x9, 0x5, 0xD, 0x3, 0xB, 0x7, 0xF
+};
+
+static inline uint8_t bitrev(uint8_t b){
+  return (bitrev_nibble[b & 0xF] << 4) | bitrev_nibble[b >> 4];
+}
+
+/**
+ * Append one AD9850 word. The SPI shifts MSB first and the AD9850 wants the
+ * word LSB first, so every byte is stored bit reversed.
+ * @param dds_stream_entry_t* dst - first free entry
+ * @param uint32_t word - frequency tuning word
+ * @param uint8_t control - phase << 3 | power down << 2
+ * @return uint16_t - entries written
+**/
+uint16_t dds_stream_append(dds_stream_entry_t* dst, uint32_t word, uint8_t control){
+  uint64_t bits = ((uint64_t)control << 32) | word;
+  for(uint8_t k = 0; k < DDS_STREAM_BYTES_PER_WORD; k++){
+    dst[k] = bitrev((uint8_t)(bits >> (8 * k))) | TDR_PCS(DDS_STREAM_NPCS);
+  }
+  dst[DDS_STREAM_BYTES_PER_WORD - 1] |= TDR_LASTXFER;
+  return DDS_STREAM_BYTES_PER_WORD;
+}
+
+/**
+ * Encode a colour scan through the pixel table
+ * @param dds_stream_entry_t* dst - room for DDS_STREAM_ENTRIES(count)
+ * @param volatile byte* colors - colour values of the scan
+ * @param uint16_t count - pixels
+ * @return uint16_t - entries written
+**/
+uint16_t dds_stream_encode(dds_stream_entry_t* dst, const volatile byte* colors, uint16_t count){
+  dds_stream_entry_t* p = dst;
+  for(uint16_t i = 0; i < count; i++){
+    p += dds_stream_append(p, dds_lut[colors[i]], 0);
+  }
+  return p - dst;
+}
+
+/**
+ * Recover the 40 bit word (control << 32 | tuning word) an encoded word loads
+ * @param dds_stream_entry_t* entry - first of its DDS_STREAM_BYTES_PER_WORD entries
+**/
+uint64_t dds_stream_decode(const dds_stream_entry_t* entry){
+  uint64_t bits = 0;
+  for(uint8_t k = 0; k < DDS_STREAM_BYTES_PER_WORD; k++){
+    bits |= (uint64_t)bitrev((uint8_t)entry[k]) << (8 * k);
+  }
+  return bits;
+}
+
+/**
+ * Check a stream word by word against the word DDS.setfreq() loads for the
+ * same pixel, including the chip select and LASTXFER framing
+ * @return uint16_t - number of mismatching words (0 is a pass)
+**/
+uint16_t dds_stream_verify(const dds_stream_entry_t* entries, const volatile byte* colors,
+                           uint16_t count, double base, double step){
+  uint16_t errors = 0;
+  for(uint16_t i = 0; i < count; i++){
+    const dds_stream_entry_t* e = entries + DDS_STREAM_ENTRIES(i);
+    uint64_t expected = dds_word(base + colors[i] * step);
+    bool framed = true;
+    for(uint8_t k = 0; k < DDS_STREAM_BYTES_PER_WORD; k++){
+      uint32_t flags = e[k] & ~0xFFu;
+      uint32_t want = TDR_PCS(DDS_STREAM_NPCS) | (k == DDS_STREAM_BYTES_PER_WORD - 1 ? TDR_LASTXFER : 0);
+      framed = framed && flags == want;
+    }
+    if(!framed || dds_stream_decode(e) != expected){
+      errors++;
+    }
+  }
+  return errors;
+}
+
+/**
+ * Pick SCBR and DLYBCT so 5 byte transfers and the gap between chip selects
+ * last as close as possible to one word period:
+ * 5 * (8 * scbr + 32 * dlybct) + STREAM_DLYBCS MCK cycles
+**/
+static void choose_timing(double word_us){
+  double target = (word_us * STREAM_MCK / 1000000.0 - STREAM_DLYBCS) / DDS_STREAM_BYTES_PER_WORD;
+  double best = 1e12;
+  for(uint16_t d = 0; d < 256; d++){
+    double rest = target - 32.0 * d;
+    if(rest < 8.0){
+      break;
+    }
+    long s = (long)(rest / 8.0 + 0.5);
+    if(s < 1 || s > 255){
+      continue;
+    }
+    double err = fabs(rest - 8.0 * s);
+    if(err < best){
+      best = err;
+      scbr = s;
+      dlybct = d;
+    }
+  }
+  period_us = (DDS_STREAM_BYTES_PER_WORD * (8.0 * scbr + 32.0 * dlybct) + STREAM_DLYBCS) * 1000000.0 / STREAM_MCK;
+}
+
+/**
+ * Actual word period after quantisation to SPI clock settings
+**/
+double dds_stream_period_us(){
+  return period_us;
+}
+
+bool dds_stream_busy(){
+  return busy;
+}
+
+/**
+ * micros() when the last word of the previous stream was latched
+**/
+unsigned long dds_stream_done_time(){
+  return done_time;
+}
+
+#ifdef SSTV_NATIVE
+
+static const dds_stream_entry_t* cursor;
+static uint16_t remaining;
+static uint64_t wordAt;          // Simulated time the next word latches
+static uint64_t wordNs;
+static int sim_id = -1;
+
+/**
+ * One word period elapsed: clock the next word into the chip model
+**/
+static void sim_word(){
+  uint64_t bits = dds_stream_decode(cursor);
+  for(uint8_t i = 0; i < 40; i++, bits >>= 1){
+    sim_pin_write(AD9850_DATA_PIN, bits & 1);
+    sim_pin_write(AD9850_CLK_PIN, HIGH);
+    sim_pin_write(AD9850_CLK_PIN, LOW);
+  }
+  sim_pin_write(AD9850_FQ_UPDATE_PIN, LOW);
+  sim_pin_write(AD9850_FQ_UPDATE_PIN, HIGH);
+  cursor += DDS_STREAM_BYTES_PER_WORD;
+  wordAt += wordNs;
+  if(--remaining == 0){
+    sim_timer_stop(sim_id);
+    done_time = sim_now_ns() / 1000;
+    busy = false;
+  }
+}
+
+void dds_stream_begin(double word_period_us){
+  choose_timing(word_period_us);
+  if(sim_id < 0){
+    sim_id = sim_timer_add_hw(sim_word);
+  }
+  sim_pin_write(AD9850_FQ_UPDATE_PIN, HIGH);   // NPCS idles high
+}
+
+static void start(const dds_stream_entry_t* entries, uint16_t words, double word_us){
+  cursor = entries;
+  remaining = words;
+  busy = true;
+  wordNs = (uint64_t)(word_us * 1000.0 + 0.5);
+  wordAt = sim_now_ns() + wordNs;
+  sim_timer_start(sim_id, wordNs);
+}
+
+void dds_stream_start(const dds_stream_entry_t* entries, uint16_t words){
+  start(entries, words, period_us);
+}
+
+void dds_stream_start_single(const dds_stream_entry_t* entries){
+  start(entries, 1, DDS_STREAM_BYTES_PER_WORD * 8.0 * SINGLE_SCBR * 1000000.0 / STREAM_MCK);
+}
+
+void dds_stream_finish(){
+  while(busy){
+    uint64_t now = sim_now_ns();
+    if(now < wordAt){
+      sim_advance(wordAt - now);   // In the foreground the timer takes it
+      continue;
+    }
+    sim_word();
+  }
+}
+
+#else
+
+static uint32_t saved_mr;
+
+void dds_stream_begin(double word_period_us){
+  choose_timing(word_period_us);
+
+  pmc_enable_periph_clk(ID_SPI0);
+  PIO_Configure(PIOA, PIO_PERIPH_A,
+                PIO_PA26A_SPI0_MOSI | PIO_PA27A_SPI0_SPCK | PIO_PA29A_SPI0_NPCS1, PIO_DEFAULT);
+
+  NVIC_ClearPendingIRQ(SPI0_IRQn);
+  NVIC_SetPriority(SPI0_IRQn, 0);
+  NVIC_EnableIRQ(SPI0_IRQn);
+}
+
+static void start(const dds_stream_entry_t* entries, uint16_t words, uint32_t csr){
+  busy = true;
+  saved_mr = SPI0->SPI_MR;
+
+  SPI0->SPI_CSR[DDS_STREAM_NPCS] = csr;
+  SPI0->SPI_MR = SPI_MR_MSTR | SPI_MR_PS | SPI_MR_MODFDIS | SPI_MR_DLYBCS(STREAM_DLYBCS);
+  SPI0->SPI_CR = SPI_CR_SPIEN;
+
+  SPI0->SPI_TPR = (uint32_t)entries;
+  SPI0->SPI_TCR = DDS_STREAM_ENTRIES(words);
+  SPI0->SPI_IER = SPI_IER_ENDTX;
+  SPI0->SPI_PTCR = SPI_PTCR_TXTEN;
+}
+
+/**
+ * Hand SPI0 to the PDC and drain words paced by the SPI clock settings. The
+ * SD library's mode register is restored once the stream completes.
+ * @param dds_stream_entry_t* entries - encoded stream, must stay valid until done
+ * @param uint16_t words - AD9850 words in the stream
+**/
+void dds_stream_start(const dds_stream_entry_t* entries, uint16_t words){
+  // Mode 0, 8 bit, chip select held across the 5 bytes of a word
+  start(entries, words, SPI_CSR_NCPHA | SPI_CSR_CSAAT | SPI_CSR_BITS_8_BIT |
+                        SPI_CSR_SCBR(scbr) | SPI_CSR_DLYBCT(dlybct));
+}
+
+/**
+ * Load one word as fast as the AD9850 takes it (headers, porches)
+**/
+void dds_stream_start_single(const dds_stream_entry_t* entries){
+  start(entries, 1, SPI_CSR_NCPHA | SPI_CSR_CSAAT | SPI_CSR_BITS_8_BIT | SPI_CSR_SCBR(SINGLE_SCBR));
+}
+
+/**
+ * The last word is latched: give the bus back
+**/
+static void release(){
+  SPI0->SPI_PTCR = SPI_PTCR_TXTDIS;
+  SPI0->SPI_MR = saved_mr;
+  done_time = micros();
+  busy = false;
+}
+
+/**
+ * Wait for the stream in flight to latch its last word, on the SPI status
+ * rather than on SPI0_Handler, which cannot preempt the transmit interrupt
+ * this is called from
+**/
+void dds_stream_finish(){
+  if(!busy){
+    return;
+  }
+  SPI0->SPI_IDR = SPI_IDR_ENDTX | SPI_IDR_TXEMPTY;
+  while(SPI0->SPI_TCR != 0 || !(SPI0->SPI_SR & SPI_SR_TXEMPTY));
+  release();
+}
+
+/**
+ * ENDTX: the PDC has queued the last entry, wait for the shifter to empty.
+ * TXEMPTY: the last word is latched, give the bus back.
+**/
+void SPI0_Handler(){
+  uint32_t sr = SPI0->SPI_SR & SPI0->SPI_IMR;
+
+  if(sr & SPI_SR_ENDTX){
+    SPI0->SPI_IDR = SPI_IDR_ENDTX;
+    SPI0->SPI_IER = SPI_IER_TXEMPTY;
+  }
+  if(sr & SPI_SR_TXEMPTY){
+    SPI0->SPI_IDR = SPI_IDR_TXEMPTY;
+    release();
+  }
+}
+
+#endif
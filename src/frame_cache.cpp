@@ -0,0 +1,234 @@
+#include "frame_cache.h"
+#include <SD.h>
+#include "sstv_mode.h"
+#include "frame_file.h"
+#include "gps.h"
+
+// FNV-1a, 32 bit
+#define FNV_OFFSET 2166136261UL
+#define FNV_PRIME 16777619UL
+
+static frame_cache_index_t cache;
+static File hashFile;               // JPEG being hashed
+static uint32_t hash;
+
+static uint32_t fnv(uint32_t h, const byte* p, uint32_t n){
+  for(uint32_t i = 0; i < n; i++){
+    h = (h ^ p[i]) * FNV_PRIME;
+  }
+  return h;
+}
+
+/**
+ * Write the index back, replacing the old one
+**/
+static void index_save(){
+  if(SD.exists(FRAME_CACHE_INDEX)){
+    SD.remove(FRAME_CACHE_INDEX);
+  }
+  File f = SD.open(FRAME_CACHE_INDEX, FILE_WRITE);
+  if(!f || f.write((const uint8_t*)&cache, sizeof(cache)) != sizeof(cache)){
+    Serial.println("error writing frame cache index");
+  }
+  f.close();
+}
+
+/**
+ * Entry to drop first: the least recently used, never the last one used
+ * @return int8_t - -1 if there is none
+**/
+static int8_t oldest(){
+  int8_t pick = -1;
+  for(uint8_t i = 0; i < FRAME_CACHE_ENTRIES; i++){
+    const frame_cache_entry_t* e = &cache.entries[i];
+    if(e->key != 0 && e->used != cache.sequence && (pick < 0 || e->used < cache.entries[pick].used)){
+      pick = i;
+    }
+  }
+  return pick;
+}
+
+/**
+ * Remove an entry and its frame file
+**/
+static void drop(uint8_t i){
+  char path[FRAME_CACHE_PATH];
+  frame_cache_path(cache.entries[i].key, path);
+  SD.remove(path);
+  cache.entries[i].key = 0;
+  cache.entries[i].used = 0;
+  Serial.print("Frame cache: dropped ");
+  Serial.println(path);
+}
+
+/**
+ * Load the index, or start an empty one. Call once the SD card is up.
+**/
+void frame_cache_begin(){
+  SD.mkdir(FRAME_CACHE_DIR);
+  File f = SD.open(FRAME_CACHE_INDEX);
+  bool ok = f && f.read(&cache, sizeof(cache)) == sizeof(cache) &&
+            memcmp(cache.magic, FRAME_CACHE_MAGIC, 4) == 0 && cache.version == FRAME_CACHE_VERSION;
+  f.close();
+  if(!ok){
+    memset(&cache, 0, sizeof(cache));
+    memcpy(cache.magic, FRAME_CACHE_MAGIC, 4);
+    cache.version = FRAME_CACHE_VERSION;
+  }
+
+  uint8_t n = 0;
+  for(uint8_t i = 0; i < FRAME_CACHE_ENTRIES; i++){
+    n += cache.entries[i].key != 0;
+  }
+  Serial.print("Frame cache: ");
+  Serial.print(n);
+  Serial.print(" of ");
+  Serial.print(FRAME_CACHE_ENTRIES);
+  Serial.println(" entries");
+}
+
+/**
+ * Key of a JPEG in the mode of this build, hashing it in one go
+ * @param const char* jpg - JPEG on the SD card
+ * @return uint32_t - 0 if it could not be read
+**/
+uint32_t frame_cache_key(const char* jpg){
+  if(!frame_cache_hash_start(jpg)){
+    return 0;
+  }
+  while(frame_cache_hash_step()){
+    gps_poll();
+  }
+  return frame_cache_hash_finish();
+}
+
+/**
+ * Open a JPEG for hashing and hash the frame file format first
+ * @param const char* jpg - JPEG on the SD card
+ * @return bool - false if it could not be opened
+**/
+bool frame_cache_hash_start(const char* jpg){
+  const uint8_t format[] = {
+    FRAME_FILE_VERSION, Mode::vis, Mode::Layout::lines,
+    (uint8_t)Mode::Layout::bytes, (uint8_t)(Mode::Layout::bytes >> 8),
+    (uint8_t)SSTV_GROUP_STRIDE, (uint8_t)(SSTV_GROUP_STRIDE >> 8)
+  };
+  hash = fnv(FNV_OFFSET, format, sizeof(format));
+  hashFile = SD.open(jpg);
+  return hashFile;
+}
+
+/**
+ * Hash the next sector of the JPEG
+ * @return bool - false once all of it is hashed
+**/
+bool frame_cache_hash_step(){
+  byte buf[SSTV_SECTOR];
+  int n = hashFile.read(buf, SSTV_SECTOR);
+  if(n <= 0){
+    return false;
+  }
+  hash = fnv(hash, buf, n);
+  return n == SSTV_SECTOR;
+}
+
+/**
+ * Close the JPEG
+ * @return uint32_t - its key, never 0
+**/
+uint32_t frame_cache_hash_finish(){
+  hashFile.close();
+  return hash ? hash : 1;
+}
+
+/**
+ * Look a picture up and mark it used. An entry whose file is gone, or is not
+ * a whole frame file any more, is dropped.
+ * @param uint32_t key - from frame_cache_key()
+ * @param char* path - FRAME_CACHE_PATH bytes, gets the frame file on a hit
+ * @return bool - true on a hit
+**/
+bool frame_cache_find(uint32_t key, char* path){
+  if(key == 0){
+    return false;
+  }
+  for(uint8_t i = 0; i < FRAME_CACHE_ENTRIES; i++){
+    frame_cache_entry_t* e = &cache.entries[i];
+    if(e->key != key){
+      continue;
+    }
+    frame_cache_path(key, path);
+    if(!SD.exists(path)){
+      e->key = 0;
+      index_save();
+      return false;
+    }
+    File frame = SD.open(path);
+    bool whole = frame && frame_file_open(&frame);
+    frame.close();
+    if(!whole){
+      drop(i);
+      index_save();
+      return false;
+    }
+    e->used = ++cache.sequence;
+    index_save();
+    Serial.print("Frame cache hit: ");
+    Serial.println(path);
+    return true;
+  }
+  return false;
+}
+
+/**
+ * Frame file of a key, where a new entry is written before frame_cache_add()
+ * @param uint32_t key - from frame_cache_key()
+ * @param char* path - FRAME_CACHE_PATH bytes
+**/
+void frame_cache_path(uint32_t key, char* path){
+  static const char hex[] = "0123456789ABCDEF";
+  strcpy(path, FRAME_CACHE_DIR "/00000000.BIN");
+  for(uint8_t i = 0; i < 8; i++){
+    path[sizeof(FRAME_CACHE_DIR) + i] = hex[(key >> (28 - 4 * i)) & 0xF];
+  }
+}
+
+/**
+ * Add a frame file written at frame_cache_path() as the last one used,
+ * dropping the least recently used entry if the index is full
+ * @param uint32_t key - from frame_cache_key()
+**/
+void frame_cache_add(uint32_t key){
+  int8_t slot = -1;
+  for(uint8_t i = 0; i < FRAME_CACHE_ENTRIES && slot < 0; i++){
+    if(cache.entries[i].key == key){
+      slot = i;
+    }
+  }
+  for(uint8_t i = 0; i < FRAME_CACHE_ENTRIES && slot < 0; i++){
+    if(cache.entries[i].key == 0){
+      slot = i;
+    }
+  }
+  if(slot < 0){
+    slot = oldest();
+    drop(slot);
+  }
+  cache.entries[slot].key = key;
+  cache.entries[slot].used = ++cache.sequence;
+  index_save();
+}
+
+/**
+ * Drop the least recently used entry to make room on the card
+ * @return bool - false if there is nothing left to drop
+**/
+bool frame_cache_evict(){
+  int8_t i = oldest();
+  if(i < 0){
+    return false;
+  }
+  drop(i);
+  index_save();
+  return true;
+}
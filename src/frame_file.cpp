@@ -0,0 +1,148 @@
+#include "frame_file.h"
+#include "sd_writer.h"
+#include "arena.h"
+#include "trace.h"
+
+// FRAME_FILE_BYTES from the arena while a file is written
+static byte (*rows)[SSTV_RGB_LINE];  // Lines of the group being written
+static byte* group;                  // Group being written, padded
+static uint8_t rowCount = 0;      // Lines held in rows
+static uint16_t lineCount = 0;    // Lines written to the file
+
+static unsigned long readTime = FRAME_FILE_READ_US;
+static bool readMeasured = false; // readTime is still the first guess
+
+/**
+ * Start a frame file for the mode of this build with its header sector
+ * @param const char* filename - file on the SD card, replaced if it exists
+ * @return bool - false if it could not be created
+**/
+bool frame_file_create(const char* filename){
+  if(!sd_writer_open(filename)){
+    return false;
+  }
+  rows = (byte (*)[SSTV_RGB_LINE])arena_alloc(Mode::Layout::lines * SSTV_RGB_LINE);
+  group = (byte*)arena_alloc(SSTV_GROUP_STRIDE);
+
+  frame_file_header_t h;
+  memset(group, 0, SSTV_SECTOR);
+  memcpy(h.magic, FRAME_FILE_MAGIC, 4);
+  h.version = FRAME_FILE_VERSION;
+  h.vis = Mode::vis;
+  h.groupLines = Mode::Layout::lines;
+  h.reserved = 0;
+  h.width = SSTV_WIDTH;
+  h.lines = Mode::lines;
+  h.groupBytes = Mode::Layout::bytes;
+  h.stride = SSTV_GROUP_STRIDE;
+  memcpy(group, &h, sizeof(h));
+
+  rowCount = 0;
+  lineCount = 0;
+  sd_writer_write(group, SSTV_SECTOR);
+  return true;
+}
+
+/**
+ * Add the next line of the frame. Lines past the last one of the mode are
+ * dropped.
+ * @param const byte* rgb - 320 pixels, 3 bytes (R, G, B) each
+**/
+void frame_file_write_line(const byte* rgb){
+  if(lineCount >= Mode::lines){
+    return;
+  }
+  memcpy(rows[rowCount++], rgb, SSTV_RGB_LINE);
+  lineCount++;
+  if(rowCount < Mode::Layout::lines){
+    return;
+  }
+
+  const byte* groupRows[Mode::Layout::lines];
+  for(uint8_t i = 0; i < Mode::Layout::lines; i++){
+    groupRows[i] = rows[i];
+  }
+  memset(group + Mode::Layout::bytes, 0, SSTV_GROUP_STRIDE - Mode::Layout::bytes);
+  Mode::Layout::encode(group, groupRows);
+  sd_writer_write(group, SSTV_GROUP_STRIDE);
+  rowCount = 0;
+}
+
+/**
+ * Pad the frame with white lines up to the line count of the mode and close
+ * the file
+ * @param const char* stage - name the last writer stage is reported under
+ * @return bool - false if the file could not be written in full
+**/
+bool frame_file_finish(const char* stage){
+  byte white[SSTV_RGB_LINE];
+  memset(white, 0xFF, SSTV_RGB_LINE);
+  while(lineCount < Mode::lines){
+    frame_file_write_line(white);
+  }
+  return sd_writer_close(stage);
+}
+
+/**
+ * Check the header of a frame file and move to its first group
+ * @param File* src - file open for reading
+ * @return bool - false if it is not a whole frame file for the mode of this
+ *                build
+**/
+bool frame_file_open(File* src){
+  frame_file_header_t h;
+  if(src->read(&h, sizeof(h)) != sizeof(h) || memcmp(h.magic, FRAME_FILE_MAGIC, 4) != 0){
+    Serial.println("Not a frame file");
+    return false;
+  }
+  if(h.version != FRAME_FILE_VERSION || h.vis != Mode::vis || h.width != SSTV_WIDTH ||
+     h.groupLines != Mode::Layout::lines || h.groupBytes != Mode::Layout::bytes ||
+     h.stride != SSTV_GROUP_STRIDE){
+    Serial.print("Frame file is for VIS ");
+    Serial.print(h.vis);
+    Serial.print(", this build sends VIS ");
+    Serial.println(Mode::vis);
+    return false;
+  }
+  if(h.lines != Mode::lines){
+    Serial.print("Frame file has ");
+    Serial.print(h.lines);
+    Serial.print(" lines, this build sends ");
+    Serial.println(Mode::lines);
+    return false;
+  }
+  const uint16_t groups = (Mode::lines + Mode::Layout::lines - 1) / Mode::Layout::lines;
+  if(src->size() < SSTV_SECTOR + (uint32_t)groups * SSTV_GROUP_STRIDE){
+    Serial.println("Frame file is cut short");
+    return false;
+  }
+  return src->seek(SSTV_SECTOR);
+}
+
+/**
+ * Read the next group, padding included, straight into a line ring slot.
+ * Keeps the slowest read time for frame_file_read_us().
+ * @param File* src - file positioned by frame_file_open()
+ * @param byte* slot - SSTV_GROUP_STRIDE bytes
+ * @return bool - false past the end of the file
+**/
+bool frame_file_read_group(File* src, byte* slot){
+  unsigned long start = micros();
+  uint32_t cycles = trace_now();
+  bool ok = src->read(slot, SSTV_GROUP_STRIDE) == SSTV_GROUP_STRIDE;
+  trace_span(TRACE_SD_READ, cycles);
+
+  unsigned long took = micros() - start;
+  if(!readMeasured || took > readTime){
+    readTime = took;
+    readMeasured = true;
+  }
+  return ok;
+}
+
+/**
+ * Slowest group read so far, FRAME_FILE_READ_US before the first one
+**/
+unsigned long frame_file_read_us(){
+  return readTime;
+}
@@ -0,0 +1,463 @@
+#include "gps.h"
+
+#ifdef SSTV_NATIVE
+#include "sim_clock.h"
+#define GPS_BARRIER() __sync_synchronize()
+#else
+#define GPS_BARRIER() __DMB()
+#endif
+
+#define HALF (GPS_RING_BYTES / 2)
+
+// GGA fields
+#define GGA_TIME 1
+#define GGA_LAT 2
+#define GGA_NS 3
+#define GGA_LON 4
+#define GGA_EW 5
+#define GGA_QUALITY 6
+#define GGA_SATS 7
+#define GGA_ALT 9
+
+// Parser states
+#define NMEA_IDLE 0               // Waiting for '$'
+#define NMEA_BODY 1               // Between '$' and '*'
+#define NMEA_SUM_HI 2             // Checksum digits
+#define NMEA_SUM_LO 3
+
+static byte ring[GPS_RING_BYTES];
+static uint32_t base = 0;         // Bytes in the halves the PDC has finished
+static uint8_t half = 0;          // Half the PDC receives into
+static bool nextArmed = false;    // The other half is queued after it
+static uint32_t consumed = 0;     // Bytes parsed
+
+static uint8_t state = NMEA_IDLE;
+static uint8_t sum;               // XOR of the characters after '$'
+static uint8_t given;             // Checksum at the end of the sentence
+static uint8_t field;             // Field being read
+static bool gga;                  // Sentence is a GGA
+static char text[GPS_FIELD];      // Field being read
+static uint8_t textLen;
+static gps_fix_t work;            // Fix the sentence is read into
+
+static volatile uint32_t seq = 0; // Odd while latest is being written
+static gps_fix_t latest;
+
+// Stats since the last report
+static uint32_t sentences = 0;
+static uint32_t fixes = 0;
+static uint32_t badSums = 0;
+static uint32_t overruns = 0;
+
+#ifdef SSTV_NATIVE
+
+// PDC stand-in: takes each byte off the simulated UART as it arrives
+static byte* rpr;
+static volatile uint16_t rcr = 0;
+static byte* rnpr;
+static volatile uint16_t rncr = 0;
+static volatile bool ovre = false;
+static int sim_id = -1;
+
+static void sim_rx(){
+  while(Serial2.available()){
+    int c = Serial2.read();
+    if(rcr == 0 && rncr != 0){
+      rpr = rnpr;
+      rcr = rncr;
+      rncr = 0;
+    }
+    if(rcr == 0){
+      ovre = true;
+      continue;
+    }
+    *rpr++ = c;
+    rcr--;
+  }
+}
+
+static void pdc_start(){
+  Serial2.begin(GPS_BAUD);
+  rpr = ring;
+  rcr = HALF;
+  rnpr = ring + HALF;
+  rncr = HALF;
+  if(sim_id < 0){
+    sim_id = sim_timer_add_hw(sim_rx);
+  }
+  sim_timer_start(sim_id, 10 * 1000000000ULL / GPS_BAUD);
+}
+
+static uint16_t pdc_rcr(){
+  return rcr;
+}
+
+static uint16_t pdc_rncr(){
+  return rncr;
+}
+
+static void pdc_queue(byte* p){
+  rnpr = p;
+  rncr = HALF;
+}
+
+static bool pdc_overrun(){
+  bool o = ovre;
+  ovre = false;
+  return o;
+}
+
+#else
+
+static void pdc_start(){
+  Serial2.begin(GPS_BAUD);          // Pins, clock and frame format
+  USART1->US_IDR = 0xFFFFFFFF;      // The core's receive interrupt would take the bytes
+  USART1->US_RPR = (uint32_t)ring;
+  USART1->US_RCR = HALF;
+  USART1->US_RNPR = (uint32_t)(ring + HALF);
+  USART1->US_RNCR = HALF;
+  USART1->US_PTCR = US_PTCR_RXTEN;
+}
+
+static uint16_t pdc_rcr(){
+  return USART1->US_RCR;
+}
+
+static uint16_t pdc_rncr(){
+  return USART1->US_RNCR;
+}
+
+/**
+ * Queue a half after the one being received into. If that one is already
+ * full the PDC starts on this one straight away.
+**/
+static void pdc_queue(byte* p){
+  USART1->US_RNPR = (uint32_t)p;
+  USART1->US_RNCR = HALF;
+}
+
+/**
+ * Whether a byte came in with nowhere to go since the last call
+**/
+static bool pdc_overrun(){
+  if(USART1->US_CSR & US_CSR_OVRE){
+    USART1->US_CR = US_CR_RSTSTA;
+    return true;
+  }
+  return false;
+}
+
+#endif
+
+/**
+ * Start receiving on Serial2. Call once; the first fix takes as long as the
+ * receiver needs.
+**/
+void gps_begin(){
+  base = 0;
+  half = 0;
+  nextArmed = true;
+  consumed = 0;
+  state = NMEA_IDLE;
+  pdc_start();
+}
+
+/**
+ * Bytes the PDC has written since gps_begin(). Once it has moved on to the
+ * queued half, that half becomes the current one.
+**/
+static uint32_t received(){
+  uint16_t cur, next;
+  do {
+    next = pdc_rncr();
+    cur = pdc_rcr();
+  } while(next != pdc_rncr());     // Switched halves between the two reads
+
+  if(nextArmed && next == 0){
+    base += HALF;
+    half ^= 1;
+    nextArmed = false;
+  }
+  return base + HALF - cur;
+}
+
+/**
+ * Value of a decimal field in fixed point, extra decimals dropped
+ * @param uint8_t decimals - digits kept after the point
+ * @return int32_t - value * 10^decimals, 0 for an empty field
+**/
+static int32_t fixed(uint8_t decimals){
+  int32_t v = 0;
+  bool negative = false;
+  bool point = false;
+  for(uint8_t i = 0; i < textLen; i++){
+    char c = text[i];
+    if(c == '-'){
+      negative = true;
+    } else if(c == '.'){
+      point = true;
+    } else if(c >= '0' && c <= '9' && (!point || decimals > 0)){
+      v = v * 10 + (c - '0');
+      if(point){
+        decimals--;
+      }
+    }
+  }
+  while(decimals-- > 0){
+    v *= 10;
+  }
+  return negative ? -v : v;
+}
+
+/**
+ * NMEA ddmm.mmmm or dddmm.mmmm
+ * @return int32_t - 1/10000 minute
+**/
+static int32_t minutes(){
+  int32_t v = fixed(4);
+  return v / 1000000 * 600000 + v % 1000000;
+}
+
+static void end_field(){
+  if(field == 0){
+    gga = textLen == 5 && text[2] == 'G' && text[3] == 'G' && text[4] == 'A';
+  } else if(gga){
+    bool south = textLen > 0 && text[0] == 'S';
+    bool west = textLen > 0 && text[0] == 'W';
+    switch(field){
+      case GGA_TIME:    work.time = fixed(0); break;
+      case GGA_LAT:     work.lat = minutes(); break;
+      case GGA_NS:      work.lat = south ? -work.lat : work.lat; break;
+      case GGA_LON:     work.lon = minutes(); break;
+      case GGA_EW:      work.lon = west ? -work.lon : work.lon; break;
+      case GGA_QUALITY: work.quality = fixed(0); break;
+      case GGA_SATS:    work.sats = fixed(0); break;
+      case GGA_ALT:     work.alt = fixed(1); break;
+    }
+  }
+  field++;
+  textLen = 0;
+}
+
+/**
+ * Make the fix just read the latest one
+**/
+static void publish(){
+  seq++;
+  GPS_BARRIER();
+  latest = work;
+  GPS_BARRIER();
+  seq++;
+}
+
+static void end_sentence(){
+  sentences++;
+  if(sum != given){
+    badSums++;
+  } else if(gga && field > GGA_ALT && work.quality > 0){
+    work.at = millis();
+    publish();
+    fixes++;
+  }
+}
+
+static int8_t hex(char c){
+  if(c >= '0' && c <= '9'){
+    return c - '0';
+  }
+  if(c >= 'A' && c <= 'F'){
+    return c - 'A' + 10;
+  }
+  return -1;
+}
+
+/**
+ * Feed one character of the stream to the parser
+**/
+static void nmea_char(char c){
+  if(c == '$'){
+    state = NMEA_BODY;
+    sum = 0;
+    given = 0;
+    field = 0;
+    textLen = 0;
+    gga = false;
+    return;
+  }
+
+  switch(state){
+    case NMEA_BODY:
+      if(c == '*'){
+        end_field();
+        state = NMEA_SUM_HI;
+      } else if(c == '\r' || c == '\n'){
+        state = NMEA_IDLE;         // No checksum, not trusted
+      } else {
+        sum ^= c;
+        if(c == ','){
+          end_field();
+        } else if(textLen < GPS_FIELD){
+          text[textLen++] = c;
+        } else {
+          state = NMEA_IDLE;       // Not NMEA, wait for the next '$'
+        }
+      }
+      break;
+
+    case NMEA_SUM_HI:
+    case NMEA_SUM_LO: {
+      int8_t d = hex(c);
+      if(d < 0){
+        badSums++;
+        state = NMEA_IDLE;
+        break;
+      }
+      given = given << 4 | d;
+      if(state++ == NMEA_SUM_LO){
+        end_sentence();
+        state = NMEA_IDLE;
+      }
+      break;
+    }
+  }
+}
+
+/**
+ * Parse up to GPS_SLICE_BYTES of what came in, and hand the PDC back the
+ * half once it has been read. A few microseconds on the Due, so it can run
+ * between line groups.
+ * @return bool - false if there was nothing to parse
+**/
+bool gps_poll(){
+  uint32_t end = received();
+  if(pdc_overrun()){
+    overruns++;
+  }
+
+  uint16_t n = min(end - consumed, (uint32_t)GPS_SLICE_BYTES);
+  for(uint16_t i = 0; i < n; i++){
+    nmea_char(ring[consumed++ % GPS_RING_BYTES]);
+  }
+
+  if(!nextArmed && consumed >= base){  // Nothing left to read in the other half
+    nextArmed = true;
+    pdc_queue(ring + (half ^ 1) * HALF);
+  }
+  return n > 0;
+}
+
+/**
+ * Copy the latest fix, consistent even if a new one is published meanwhile
+ * @param gps_fix_t* fix - gets the fix
+ * @return bool - false if there has been no fix yet
+**/
+bool gps_fix(gps_fix_t* fix){
+  uint32_t s;
+  do {
+    s = seq;
+    GPS_BARRIER();
+    *fix = latest;
+    GPS_BARRIER();
+  } while((s & 1) || s != seq);
+  return s != 0;
+}
+
+static char* put(char* p, const char* s){
+  while(*s){
+    *p++ = *s++;
+  }
+  return p;
+}
+
+/**
+ * Write a number in decimal
+ * @param uint8_t digits - zero padded to this many, 0 for as many as it takes
+**/
+static char* put_num(char* p, uint32_t v, uint8_t digits){
+  char d[10];
+  uint8_t n = 0;
+  do {
+    d[n++] = '0' + v % 10;
+    v /= 10;
+  } while(v > 0 || n < digits);
+  while(n > 0){
+    *p++ = d[--n];
+  }
+  return p;
+}
+
+static char* put_coord(char* p, int32_t v, uint8_t degDigits, char pos, char neg){
+  uint32_t a = v < 0 ? -v : v;
+  p = put_num(p, a / 600000, degDigits);
+  p = put_num(p, a % 600000 / 10000, 2);
+  *p++ = '.';
+  p = put_num(p, a % 10000, 4);
+  *p++ = v < 0 ? neg : pos;
+  return p;
+}
+
+/**
+ * Write the latest fix as footer text, in the layout of the placeholder:
+ * "LAT: ddmm.mmmmN   LONG: dddmm.mmmmE   ALT:m"
+ * @param char* text - size bytes, the rest after the text is zeroed
+ * @param uint8_t size - bytes of text
+ * @return bool - false, leaving text alone, if there has been no fix yet
+**/
+bool gps_footer(char* text, uint8_t size){
+  gps_fix_t f;
+  if(!gps_fix(&f)){
+    return false;
+  }
+
+  char line[64];
+  char* p = put(line, "LAT: ");
+  p = put_coord(p, f.lat, 2, 'N', 'S');
+  p = put(p, "   LONG: ");
+  p = put_coord(p, f.lon, 3, 'E', 'W');
+  p = put(p, "   ALT:");
+  if(f.alt < 0){
+    *p++ = '-';
+  }
+  p = put_num(p, (f.alt < 0 ? -f.alt : f.alt) / 10, 0);
+
+  uint8_t n = min((uint8_t)(p - line), (uint8_t)(size - 1));
+  memcpy(text, line, n);
+  memset(text + n, 0, size - n);
+  return true;
+}
+
+/**
+ * Print what came in since the last report, and the latest fix
+**/
+void gps_report(){
+  Serial.print("GPS: ");
+  Serial.print(sentences);
+  Serial.print(" sentences, ");
+  Serial.print(fixes);
+  Serial.print(" fixes, ");
+  Serial.print(badSums);
+  Serial.print(" bad checksums, ");
+  Serial.print(overruns);
+  Serial.println(" overruns");
+
+  gps_fix_t f;
+  if(gps_fix(&f)){
+    char utc[7];
+    *put_num(utc, f.time, 6) = '\0';
+    Serial.print("Last fix: ");
+    Serial.print(utc);
+    Serial.print(" UTC, ");
+    Serial.print(f.sats);
+    Serial.print(" satellites, ");
+    Serial.print((millis() - f.at) / 1000.0, 1);
+    Serial.println(" s ago");
+  }
+
+#ifdef SSTV_NATIVE
+  sim_check(overruns == 0 && badSums == 0, "GPS nothing lost, every checksum good");
+#endif
+  sentences = 0;
+  fixes = 0;
+  badSums = 0;
+  overruns = 0;
+}
@@ -0,0 +1,274 @@
+#include <SD.h>
+#include <JPEGDecoder.h>
+#include "jpeg_scale.h"
+#include "arena.h"
+
+#ifdef SSTV_NATIVE
+#include "sim_reference.h"
+#include "sim_clock.h"
+#endif
+
+#define ROW_BYTES (3 * JPEG_SCALE_WIDTH)
+
+// JPEG_SCALE_BYTES from the arena
+static byte (*rows)[ROW_BYTES];   // MCU row, scaled to 320 pixels
+
+static uint16_t srcWidth;         // Decoded pixels per line
+static uint16_t srcHeight;        // Decoded lines
+static uint8_t step = 1;          // Picture pixels per decoded pixel
+static uint16_t weightIn;         // Weight of a decoded pixel, 320
+static uint16_t weightOut;        // Weight of an output pixel, srcWidth
+static uint16_t linesMax;         // Output lines wanted
+static uint16_t linesOut;         // Output lines made
+static bool more = false;         // Decoder has MCUs left
+
+// Horizontal: the output pixel in progress on each line of the MCU row
+static uint32_t (*hSum)[3];
+static uint16_t* hFill;
+static uint16_t* hOut;
+
+// Vertical: the output line in progress
+static uint32_t* vSum;
+static uint16_t vFill;
+static uint8_t rowsReady = 0;     // Lines of rows complete
+static uint8_t rowNext = 0;       // Next of them to take from
+static uint16_t rowLeft;          // Weight of it not taken yet
+
+/**
+ * Read the picture size from its frame header, before the decoder is set up
+ * @param char* filename - JPEG on the SD card
+ * @param uint16_t* width - pixels
+ * @param uint16_t* height - lines
+ * @return bool - false if the file has no frame header
+**/
+static bool probe_size(char* filename, uint16_t* width, uint16_t* height){
+  File f = SD.open(filename);
+  if(!f){
+    return false;
+  }
+
+  bool found = false;
+  byte seg[5];
+  if(f.read() == 0xFF && f.read() == 0xD8){
+    while(f.read() == 0xFF){
+      int m;
+      while((m = f.read()) == 0xFF);  // Fill bytes
+      if(m < 0 || m == 0xD9 || m == 0xDA || f.read(seg, 2) != 2){
+        break;
+      }
+      uint16_t len = seg[0] << 8 | seg[1];
+      if(m >= 0xC0 && m <= 0xCF && m != 0xC4 && m != 0xC8 && m != 0xCC){ // SOFn
+        found = f.read(seg, 5) == 5;
+        *height = seg[1] << 8 | seg[2];
+        *width = seg[3] << 8 | seg[4];
+        break;
+      }
+      if(!f.seek(f.position() + len - 2)){
+        break;
+      }
+    }
+  }
+  f.close();
+  return found && *width > 0;
+}
+
+/**
+ * Open a JPEG, choosing the IDCT size and scale for its width
+ * @param char* filename - JPEG on the SD card
+ * @param uint16_t lines - most output lines wanted
+ * @return bool - false if it could not be opened
+**/
+bool jpeg_scale_open(char* filename, uint16_t lines){
+  uint16_t width, height;
+  if(!probe_size(filename, &width, &height)){
+    return false;
+  }
+
+  step = width >= JPEG_SCALE_REDUCE * JPEG_SCALE_WIDTH ? JPEG_SCALE_REDUCE : 1;
+  if(JpegDec.decode(filename, step > 1) < 0){
+    return false;
+  }
+#ifdef SSTV_NATIVE
+  sim_frame_source(filename);   // For the loopback receiver
+#endif
+  rows = (byte (*)[ROW_BYTES])arena_alloc(JPEG_SCALE_MCU_LINES * ROW_BYTES);
+  vSum = (uint32_t*)arena_alloc(ROW_BYTES * sizeof(uint32_t));
+  hSum = (uint32_t (*)[3])arena_alloc(JPEG_SCALE_MCU_LINES * 3 * sizeof(uint32_t));
+  hFill = (uint16_t*)arena_alloc(JPEG_SCALE_MCU_LINES * sizeof(uint16_t));
+  hOut = (uint16_t*)arena_alloc(JPEG_SCALE_MCU_LINES * sizeof(uint16_t));
+
+  srcWidth = (width + step - 1) / step;
+  srcHeight = (height + step - 1) / step;
+  weightIn = JPEG_SCALE_WIDTH;
+  weightOut = srcWidth;
+  linesMax = min((uint32_t)lines, ((uint32_t)srcHeight * JPEG_SCALE_WIDTH + srcWidth - 1) / srcWidth);
+  linesOut = 0;
+
+  memset(vSum, 0, ROW_BYTES * sizeof(uint32_t));
+  vFill = 0;
+  rowsReady = 0;
+  rowNext = 0;
+  rowLeft = weightIn;
+  more = true;
+  return true;
+}
+
+/**
+ * Output lines the picture gives, at most the lines asked for on open
+**/
+uint16_t jpeg_scale_lines(){
+  return linesMax;
+}
+
+/**
+ * Add a decoded pixel to a line of the MCU row, writing every output pixel
+ * it completes
+ * @param uint8_t r - line of the MCU row
+ * @param const byte* px - decoded pixel
+ * @param uint8_t g - offset of green in px, 0 for grayscale
+ * @param uint8_t b - offset of blue in px, 0 for grayscale
+**/
+static void scale_pixel(uint8_t r, const byte* px, uint8_t g, uint8_t b){
+  uint16_t left = weightIn;
+  while(left > 0 && hOut[r] < JPEG_SCALE_WIDTH){
+    uint16_t take = min(left, (uint16_t)(weightOut - hFill[r]));
+    left -= take;
+    byte* dst = rows[r] + 3 * hOut[r];
+
+    if(take == weightOut){ // The whole output pixel is this one
+      dst[0] = px[0];
+      dst[1] = px[g];
+      dst[2] = px[b];
+      hOut[r]++;
+      continue;
+    }
+
+    uint32_t* sum = hSum[r];
+    sum[0] += take * px[0];
+    sum[1] += take * px[g];
+    sum[2] += take * px[b];
+    hFill[r] += take;
+    if(hFill[r] == weightOut){
+      for(uint8_t c = 0; c < 3; c++){
+        dst[c] = (sum[c] + weightOut / 2) / weightOut;
+        sum[c] = 0;
+      }
+      hFill[r] = 0;
+      hOut[r]++;
+    }
+  }
+}
+
+/**
+ * Write the output line in progress
+ * @param byte* dst - 320 pixels
+**/
+static void finish_line(byte* dst){
+  for(uint16_t i = 0; i < ROW_BYTES; i++){
+    dst[i] = (vSum[i] + vFill / 2) / vFill;
+    vSum[i] = 0;
+  }
+  vFill = 0;
+  linesOut++;
+}
+
+/**
+ * Next output line, if the MCUs decoded so far cover it. At the bottom of
+ * the picture the last line is made from whatever lines are left.
+ * @param byte* dst - 320 pixels, 3 bytes (R, G, B) each
+ * @return bool - false if another MCU is needed first, or no line is left
+**/
+bool jpeg_scale_line(byte* dst){
+  if(linesOut >= linesMax){
+    return false;
+  }
+
+  while(rowNext < rowsReady){
+    const byte* src = rows[rowNext];
+    uint16_t take = min(rowLeft, (uint16_t)(weightOut - vFill));
+    rowLeft -= take;
+    if(rowLeft == 0){
+      rowNext++;
+      rowLeft = weightIn;
+    }
+
+    if(take == weightOut){ // The whole output line is this one
+      memcpy(dst, src, ROW_BYTES);
+      linesOut++;
+      return true;
+    }
+
+    for(uint16_t i = 0; i < ROW_BYTES; i++){
+      vSum[i] += take * src[i];
+    }
+    vFill += take;
+    if(vFill == weightOut){
+      finish_line(dst);
+      return true;
+    }
+  }
+
+  if(!more && vFill > 0){
+    finish_line(dst);
+    return true;
+  }
+  return false;
+}
+
+/**
+ * Decode one MCU and scale it into the MCU row. The lines of the previous
+ * MCU row must have been taken by jpeg_scale_line() first. Once all the
+ * output lines are made, MCUs are decoded and dropped so the decoder still
+ * reaches the end of the file.
+ * @return bool - false once the picture has nothing left to give
+**/
+bool jpeg_scale_mcu(){
+  if(!more){
+    return false;
+  }
+  if(!JpegDec.read()){
+    more = false;
+    return vFill > 0 && linesOut < linesMax;  // Bottom line still to come
+  }
+#ifdef SSTV_NATIVE
+  // The decoder library is plain C and charges nothing itself
+  sim_advance(step > 1 ? sim_cost.jpeg_mcu_dc
+                       : (uint64_t)JpegDec.MCUWidth * JpegDec.MCUHeight * sim_cost.jpeg_mcu_px);
+#endif
+  if(linesOut >= linesMax){
+    return true;
+  }
+
+  uint8_t comps = JpegDec.comps;
+  uint8_t g = comps == 1 ? 0 : 1;
+  uint8_t b = comps == 1 ? 0 : 2;
+  uint8_t mcuWidth = JpegDec.MCUWidth / step;
+  uint8_t mcuHeight = JpegDec.MCUHeight / step;
+  uint16_t x0 = JpegDec.MCUx * mcuWidth;
+  uint16_t y0 = JpegDec.MCUy * mcuHeight;
+  uint8_t height = min((int)mcuHeight, srcHeight - y0);
+  uint8_t width = min((int)mcuWidth, srcWidth - x0);
+
+  if(JpegDec.MCUx == 0){ // New MCU row
+    memset(hSum, 0, JPEG_SCALE_MCU_LINES * 3 * sizeof(uint32_t));
+    memset(hFill, 0, JPEG_SCALE_MCU_LINES * sizeof(uint16_t));
+    memset(hOut, 0, JPEG_SCALE_MCU_LINES * sizeof(uint16_t));
+    rowsReady = 0;
+    rowNext = 0;
+  }
+
+  // The decoder copies every 8x8 block to its place in a full size MCU;
+  // reduced, only the first pixel of each block is decoded
+  for(uint8_t by = 0; by < height; by++){
+    const byte* px = JpegDec.pImage + by * step * JpegDec.MCUWidth * comps;
+    for(uint8_t bx = 0; bx < width; bx++){
+      scale_pixel(by, px, g, b);
+      px += step * comps;
+    }
+  }
+
+  if(JpegDec.MCUx == JpegDec.MCUSPerRow - 1){ // MCU row complete
+    rowsReady = height;
+  }
+  return true;
+}
@@ -0,0 +1,197 @@
+#include "jpeg_stream.h"
+#include "jpeg_scale.h"
+#include "overlay.h"
+#include "arena.h"
+#include "sstv_mode.h"
+
+#define BAND_BYTES (JPEG_STREAM_WIDTH * JPEG_STREAM_BAND_LINES * 3)
+
+static byte (*bands)[BAND_BYTES];   // JPEG_STREAM_BYTES from the arena
+static uint8_t bandLines[JPEG_STREAM_BANDS];   // Lines held by each complete band
+
+static uint8_t head = 0;          // Band being read
+static uint8_t fill = 0;          // Band being decoded into
+static uint8_t ready = 0;         // Complete bands waiting to be read
+static uint8_t spent = 0;         // Read bands whose lines may still be in use
+static uint8_t lineInBand = 0;    // Next line to read from the head band
+static uint8_t fillLines = 0;     // Lines in the band being decoded into
+static uint16_t delivered = 0;    // Lines handed out this frame
+
+static bool decoding = false;     // JPEG still has MCUs to give
+static uint16_t pictureLines = 0; // Picture lines that fit under the overlay
+static uint16_t decodedLines = 0; // Picture lines put in bands so far
+static unsigned long mcuTime = JPEG_STREAM_MCU_US;
+static bool mcuMeasured = false;  // mcuTime is still the first guess
+
+/**
+ * Start a frame: white overlay bands go in the ring first, the picture
+ * follows. The overlay text is drawn later, see overlay.h.
+ * @param char* filename - JPEG on the SD card
+ * @return bool - false if the JPEG could not be opened
+**/
+bool jpeg_stream_open(char* filename){
+  if(!jpeg_scale_open(filename, Mode::lines - OVERLAY_LINES)){
+    return false;
+  }
+  bands = (byte (*)[BAND_BYTES])arena_alloc(JPEG_STREAM_BYTES);
+
+  memset(bands[0], 0xFF, 3 * JPEG_STREAM_WIDTH * OVERLAY_HEADER_LINES);
+  bandLines[0] = OVERLAY_HEADER_LINES;
+  memset(bands[1], 0xFF, 3 * JPEG_STREAM_WIDTH * OVERLAY_FOOTER_LINES);
+  bandLines[1] = OVERLAY_FOOTER_LINES;
+
+  head = 0;
+  fill = 0;
+  ready = 2;
+  spent = 0;
+  lineInBand = 0;
+  delivered = 0;
+
+  decoding = true;
+  pictureLines = jpeg_scale_lines();
+  decodedLines = 0;
+  fillLines = 0;
+  return true;
+}
+
+/**
+ * One decode step: make a scaled line in the band being filled, or decode
+ * an MCU if the scaler needs one first. A band is complete when it is full
+ * or the picture ends. Past the picture the rest of the file is decoded and
+ * dropped.
+**/
+static void complete_band(){
+  bandLines[fill] = fillLines;
+  fill = (fill + 1) % JPEG_STREAM_BANDS;
+  fillLines = 0;
+  ready++;
+}
+
+static void decode_step(){
+  if(decodedLines < pictureLines){
+    if(jpeg_scale_line(bands[fill] + 3 * JPEG_STREAM_WIDTH * fillLines)){
+      decodedLines++;
+      if(++fillLines == JPEG_STREAM_BAND_LINES || decodedLines == pictureLines){
+        complete_band();
+      }
+      return;
+    }
+  }
+
+  if(!jpeg_scale_mcu()){
+    decoding = false;
+    if(decodedLines < pictureLines){ // File ended early
+      pictureLines = decodedLines;
+      if(fillLines > 0){
+        complete_band();
+      }
+    }
+  }
+}
+
+/**
+ * decode_step() keeping mcuTime at the slowest step seen. The first measurement
+ * replaces the JPEG_STREAM_MCU_US guess, which may not fit short gaps at all.
+**/
+static void timed_decode_step(){
+  unsigned long start = micros();
+  decode_step();
+
+  unsigned long took = micros() - start;
+  if(!mcuMeasured || took > mcuTime){
+    mcuTime = took;
+    mcuMeasured = true;
+  }
+}
+
+/**
+ * Do one decode step if a band is free and it can finish before the deadline
+ * @param unsigned long deadline - micros() by which the caller needs the CPU back
+ * @return bool - true if a step was done
+**/
+bool jpeg_stream_pump(unsigned long deadline){
+  if(!decoding || (ready + spent == JPEG_STREAM_BANDS && decodedLines < pictureLines)){
+    return false;
+  }
+
+  if((long)(deadline - micros()) < (long)mcuTime){
+    return false;
+  }
+
+  timed_decode_step();
+  return true;
+}
+
+/**
+ * Whether jpeg_stream_line() can return without decoding
+**/
+bool jpeg_stream_ready(){
+  return delivered >= Mode::lines || ready > 0 || !decoding || decodedLines >= pictureLines;
+}
+
+/**
+ * Move past the next line of the head band, which must be ready
+ * @return const byte* - the line
+**/
+static const byte* take_line(){
+  const byte* line = bands[head] + 3 * lineInBand * JPEG_STREAM_WIDTH;
+
+  if(++lineInBand == bandLines[head]){
+    lineInBand = 0;
+    head = (head + 1) % JPEG_STREAM_BANDS;
+    ready--;
+    spent++;
+  }
+  delivered++;
+  return line;
+}
+
+/**
+ * Next line of the frame, read in place from its band, decoding right now if
+ * the pump has not kept up. The line stays valid until jpeg_stream_release().
+ * @return const byte* - 320 pixels, 3 bytes (R, G, B) each, 0 once the frame
+ *                       has no more lines
+**/
+const byte* jpeg_stream_line(){
+  if(delivered >= Mode::lines){
+    return 0;
+  }
+  while(ready == 0){
+    if(!decoding || decodedLines >= pictureLines || spent == JPEG_STREAM_BANDS){
+      return 0;
+    }
+    timed_decode_step();
+  }
+
+  return take_line();
+}
+
+/**
+ * Drop the decoded lines before a line of the frame. Nothing more is decoded
+ * here: the pump does that in the spare time, and the caller asks again.
+ * @param uint16_t line - frame line the next jpeg_stream_line() is to give
+ * @return bool - true once it will, or the picture has no lines left
+**/
+bool jpeg_stream_skip(uint16_t line){
+  while(delivered < line && ready > 0){
+    take_line();
+  }
+  spent = 0;                      // None of the dropped lines is in use
+  return delivered >= line || !decoding || decodedLines >= pictureLines;
+}
+
+/**
+ * Let the decoder reuse the bands of every line handed out so far
+**/
+void jpeg_stream_release(){
+  spent = 0;
+}
+
+/**
+ * Finish the frame, letting the decoder run to the end of the file
+**/
+void jpeg_stream_close(){
+  while(decoding){
+    decode_step();
+  }
+}
@@ -0,0 +1,105 @@
+#include "line_ring.h"
+#include "arena.h"
+
+// Orders the slot contents against the counter that hands the slot over
+#ifdef SSTV_NATIVE
+#include "sim_demod.h"
+#define LINE_RING_BARRIER() __sync_synchronize()
+#else
+#define LINE_RING_BARRIER() __DMB()
+#endif
+
+static byte (*slots)[LINE_RING_SLOT_BYTES];   // LINE_RING_BYTES from the arena
+static volatile uint16_t head;      // Slots published, written by the producer only
+static volatile uint16_t tail;      // Slots taken, written by the consumer only
+
+// Stats, each written by one side only
+static uint16_t maxDepth;           // Most slots queued ahead at a publish
+static uint16_t minDepth;           // Fewest slots queued ahead at a take
+static volatile uint16_t underruns; // Takes that found nothing published
+
+/**
+ * Take the slots for a frame, empty the ring and clear the stats. Only while
+ * neither side runs, once per transmit stage.
+**/
+void line_ring_reset(){
+  slots = (byte (*)[LINE_RING_SLOT_BYTES])arena_alloc(LINE_RING_BYTES);
+  head = 0;
+  tail = 0;
+  maxDepth = 0;
+  minDepth = LINE_RING_SLOTS;
+  underruns = 0;
+}
+
+/**
+ * Producer: slot to lay the next group out in
+ * @return byte* - LINE_RING_SLOT_BYTES to fill, 0 while the ring is full
+**/
+byte* line_ring_claim(){
+  uint16_t h = head;
+  uint16_t t = tail;
+  LINE_RING_BARRIER();              // Consumer is done with the slot before it is reused
+  if((uint16_t)(h - t) >= LINE_RING_SLOTS - LINE_RING_HELD){
+    return 0;
+  }
+  return slots[h % LINE_RING_SLOTS];
+}
+
+/**
+ * Producer: hand the slot returned by line_ring_claim() to the consumer
+**/
+void line_ring_publish(){
+#ifdef SSTV_NATIVE
+  sim_frame_group(slots[head % LINE_RING_SLOTS]);   // For the loopback receiver
+#endif
+  LINE_RING_BARRIER();              // Slot contents before the counter
+  uint16_t h = head + 1;
+  head = h;
+
+  uint16_t depth = h - tail;
+  if(depth > maxDepth){
+    maxDepth = depth;
+  }
+}
+
+/**
+ * Consumer: next published slot. The slot stays readable until
+ * LINE_RING_HELD more have been taken.
+ * @return byte* - slot, 0 if nothing is published yet
+**/
+byte* line_ring_take(){
+  uint16_t t = tail;
+  uint16_t depth = head - t;
+  if(depth == 0){
+    underruns++;
+    return 0;
+  }
+  LINE_RING_BARRIER();              // Counter before the slot contents
+  if(depth - 1 < minDepth){
+    minDepth = depth - 1;
+  }
+  tail = t + 1;
+  return slots[t % LINE_RING_SLOTS];
+}
+
+uint16_t line_ring_published(){
+  return head;
+}
+
+uint16_t line_ring_taken(){
+  return tail;
+}
+
+/**
+ * Print how far ahead the producer ran
+**/
+void line_ring_report(){
+  Serial.print("Line ring: ");
+  Serial.print(LINE_RING_SLOTS);
+  Serial.print(" slots, most queued ahead ");
+  Serial.print(maxDepth);
+  Serial.print(", fewest left at a take ");
+  Serial.print(minDepth == LINE_RING_SLOTS ? 0 : minDepth);
+  Serial.print(", underruns ");
+  Serial.println(underruns);
+}
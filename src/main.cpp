@@ -9,26 +9,22 @@
 #include <SD.h>
 #include <AD9850.h>
 #include <JPEGDecoder.h>
-#include <Adafruit_VC0706.h>
-#include <DueTimer.h>
-#include <Adafruit_GPS.h>
-
-// Scottie 1 properties
-#define COLORCORRECTION 3.1372549
-
-// Scottie 1 mode
-#define COLORSCANTIMEPERLINE 138.240        //ms
-#define COLORSCANPERPIXEL 432               //microseconds
-#define SEPARATORPULSETIME 1.5              //ms
-#define SEPARATORPULSEFREQ 1500             //ms
-#define SYNCPULSETIME 9                     //ms
-#define SYNCPULSEFREQ 1200                  //Hz
-
-// AD9850 consts
-#define AD9850_CLK_PIN 51         //Working clock output pin
-#define AD9850_FQ_UPDATE_PIN 49   //Frequency update
-#define AD9850_DATA_PIN 47        //Serial data output pin
-#define AD9850_RST_PIN 45         //Reset output pin
+#include "dds.h"
+#include "overlay.h"
+#include "jpeg_scale.h"
+#include "jpeg_stream.h"
+#include "sstv_mode.h"
+#include "tx_engine.h"
+#include "frame_file.h"
+#include "frame_cache.h"
+#include "catalog.h"
+#include "sd_writer.h"
+#include "cam_capture.h"
+#include "arena.h"
+#include "trace.h"
+#include "boot.h"
+#include "gps.h"
+#include "bench.h"
 
 // Sd consts
 #define SD_SLAVE_PIN 53
@@ -39,157 +35,162 @@
 // Other stuff
 #define BUILT_IN_PIN 13
 
-volatile uint8_t phase = 0;
-
-char pic_filename[13];
-char pic_decoded_filename[13];
-
-uint8_t frameBuf[81920]; //320*256
+#if defined(DDS_STREAM) && !defined(DECODE_TO_BIN)
+// Only the gaps between scans leave the bus to the SD card, some 13 ms a
+// line: a frame file group fits, the MCUs of a 640 pixel JPEG do not
+#error "The SPI stream backend leaves the SD card too little time to decode while sending, build it with -DDECODE_TO_BIN"
+#endif
+
+#ifdef BEACON
+#ifdef DDS_STREAM
+#error "BEACON writes the SD card while transmitting, the SPI stream backend leaves it no time"
+#endif
+#ifndef DECODE_TO_BIN
+#error "BEACON sends frame files, build it with -DDECODE_TO_BIN"
+#endif
+
+// Preparation of the next beacon frame
+#define PREP_SETTLE 0             // Waiting for the exposure to settle
+#define PREP_CAPTURE 1            // Reading the picture from the camera
+#define PREP_HASH 2               // Looking it up in the frame cache
+#define PREP_DECODE 3             // Writing its frame file into the cache
+#define PREP_READY 4              // Frame file complete
+#define PREP_FAILED 5             // Nothing new, the last frame goes again
+
+#define BEACON_CAMERA_RETRY_MS 60000  // A lost camera is looked for again after this, off the air
+#define BEACON_WHITE "WHITE.BIN"      // Overlay only frame, sent until there is a picture
+#endif
+
+#ifdef FAST_BOOT
+#ifdef DDS_STREAM
+#error "FAST_BOOT captures while transmitting, the SPI stream backend leaves the SD card no time"
+#endif
+#ifdef DECODE_TO_BIN
+#error "FAST_BOOT sends the first picture as it is decoded, build it without -DDECODE_TO_BIN"
+#endif
+#ifdef BEACON
+#error "BEACON already prepares its frames on the air, build it without -DFAST_BOOT"
+#endif
+
+// Bringing up the first picture while the first frame is on the air
+#define BOOT_SD 0                 // Card not started yet
+#define BOOT_CAMERA 1             // Waiting for the camera to answer
+#define BOOT_LINK 2               // Moving its link to a faster rate and setting the size
+#define BOOT_SETTLE 3             // Waiting for the exposure to settle
+#define BOOT_CAPTURE 4            // Reading the picture from the camera
+#define BOOT_SKIPPING 5           // Dropping the picture lines sent white
+#define BOOT_STREAMING 6          // Picture lines come from the decoder
+#define BOOT_FAILED 7             // No picture, the frame is finished white
+#endif
+
+#if defined(BENCH) && (defined(BEACON) || defined(FAST_BOOT))
+#error "BENCH runs every stage on its own, build it without -DBEACON and -DFAST_BOOT"
+#endif
+
+#if defined(DDS_DAC) && defined(DDS_STREAM)
+#error "DDS_DAC synthesizes the tones itself, there is no AD9850 to stream to"
+#endif
 
-volatile byte buffE[320]; // Buffer conintating Red values after torch
-volatile byte buffR[320]; // Buffer conintating Red values of the line
-volatile byte buffG[320]; // Buffer conintating Green values of the line
-volatile byte buffB[320]; // Buffer conintating Blue values of the line
+volatile uint8_t phase = 0;
 
-volatile byte sEm = 0;    // State of Emition
-                    // 0 not emitting
-                    // 1 emitting line (NOT HEADER OR VOX)
-                    // 2 Change Color
+char pic_filename[CATALOG_NAME];
+uint32_t picSeq = 0;     // Catalog number of the picture
+char pic_decoded_filename[FRAME_CACHE_PATH];
 
-volatile byte sCol = 0;   // Transmitting color Green
-                    // Transmitting color Blue
-                    // Transmitting color Red
+const byte* groupRows[Mode::Layout::lines];  // JPEG lines of the next group, read in place
+uint8_t groupLines = 0;                     // Lines of it read so far
+uint16_t groupNum = 0;                      // Groups queued so far
+byte* whiteLine;                            // Sent past the end of the picture
+byte* decodeLine;                           // Line between the decoder and the frame file
 
-volatile int tp = 0;     // Index of pixel while transmitting with timer
-volatile int line;
+File txFile;             // Frame file being transmitted
+bool txStream = false;   // Lines come straight from the JPEG decoder
+unsigned long captureTime;
 
 // Camera stuff
-Adafruit_VC0706 cam = Adafruit_VC0706(&Serial1);
+bool camFound = false;
+
+#ifdef BEACON
+// Two frames in turn: one is sent while the other is prepared
+uint32_t beaconSeq[2];                      // Catalog numbers of their captures
+char beaconJpg[2][CATALOG_NAME];
+char beaconBin[2][FRAME_CACHE_PATH];        // Their frame files in the cache
+uint32_t prepKey;                           // Frame cache key of the next frame
+uint8_t prepStage = PREP_SETTLE;
+uint8_t prepSlot = 0;                       // Files the next frame is prepared in
+int8_t airSlot = -1;                        // Files of the last frame sent, -1 before the first
+uint32_t beaconFrames = 0;
+unsigned long beaconStart;                  // millis() the first frame started
+unsigned long beaconEnd;                    // millis() the last frame ended
+unsigned long camTried = 0;                 // millis() the camera was last looked for
+#endif
+
+#ifdef FAST_BOOT
+uint8_t bootStage = BOOT_SD;
+#endif
 
 
 uint16_t playPixel(long pixel);
 uint16_t scottie_freq(uint8_t c);
-void vox_tone();
-void scottie1_calibrationHeader();
-void transmit_micro(int freq, float duration);
-void transmit_mili(int freq, float duration);
-void scottie1_transmit_file(char* filename);
+bool line_available();
+const byte* read_line();
+void fill_queue();
+void sstv_transmit();
+bool sstv_transmit_file(char* filename);
+bool sstv_transmit_jpeg(char* filename);
 void shot_pic();
-void jpeg_decode(char* filename, char* fileout);
-//void writeFooter(File* dst, nmea_float_t latitude, char lat, nmea_float_t longitude, char lon, nmea_float_t altitude);    //Write 16 lines with values
-void writeFooter(File* dst);
+bool jpeg_decode(char* filename, char* fileout, uint32_t key);
+bool decode_start(char* filename, char* fileout);
+bool decode_step();
+bool decode_finish();
+bool prep_step();
+char* white_frame();
+void beacon_frame();
+bool boot_step();
+void fast_boot_transmit();
 
 char charId[13] = "EA4RCT-SSTV-"; // ***** INFORMATION HEADER: MAX 12 CAHARCTERS *****
-volatile long syncTime;
-
-//FONTS
-const uint8_t b_fonts[43][11] = {
-        {0x00, 0x18, 0x24, 0x62, 0x62, 0x62, 0x7E, 0x62, 0x62, 0x62, 0x00}, //00: A
-        {0x00, 0x7C, 0x32, 0x32, 0x32, 0x3C, 0x32, 0x32, 0x32, 0x7C, 0x00}, //01: B
-        {0x00, 0x3C, 0x62, 0x62, 0x60, 0x60, 0x60, 0x62, 0x62, 0x3C, 0x00}, //02: C
-        {0x00, 0x7C, 0x32, 0x32, 0x32, 0x32, 0x32, 0x32, 0x32, 0x7C, 0x00}, //03: D
-        {0x00, 0x7E, 0x60, 0x60, 0x60, 0x7C, 0x60, 0x60, 0x60, 0x7E, 0x00}, //04: E
-        {0x00, 0x7E, 0x60, 0x60, 0x60, 0x7C, 0x60, 0x60, 0x60, 0x60, 0x00}, //05: F
-        {0x00, 0x3C, 0x62, 0x62, 0x60, 0x60, 0x66, 0x62, 0x62, 0x3C, 0x00}, //06: G
-        {0x00, 0x62, 0x62, 0x62, 0x62, 0x7E, 0x62, 0x62, 0x62, 0x62, 0x00}, //07: H
-        {0x00, 0x3C, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x3C, 0x00}, //08: I
-        {0x00, 0x1E, 0x0C, 0x0C, 0x0C, 0x0C, 0x4C, 0x4C, 0x4C, 0x38, 0x00}, //09: J
-        {0x00, 0x62, 0x64, 0x68, 0x70, 0x68, 0x64, 0x62, 0x62, 0x62, 0x00}, //10: K
-        {0x00, 0x60, 0x60, 0x60, 0x60, 0x60, 0x60, 0x60, 0x60, 0x7E, 0x00}, //11: L
-        {0x00, 0x42, 0x62, 0x76, 0x6A, 0x62, 0x62, 0x62, 0x62, 0x62, 0x00}, //12: M
-        {0x00, 0x42, 0x62, 0x72, 0x6A, 0x66, 0x62, 0x62, 0x62, 0x62, 0x00}, //13: N
-        {0x00, 0x3C, 0x62, 0x62, 0x62, 0x62, 0x62, 0x62, 0x62, 0x3C, 0x00}, //14: O
-        {0x00, 0x7C, 0x62, 0x62, 0x62, 0x7C, 0x60, 0x60, 0x60, 0x60, 0x00}, //15: P
-        {0x00, 0x3C, 0x62, 0x62, 0x62, 0x62, 0x62, 0x6A, 0x6A, 0x3C, 0x08}, //16: Q
-        {0x00, 0x7C, 0x62, 0x62, 0x62, 0x7C, 0x68, 0x64, 0x62, 0x62, 0x00}, //17: R
-        {0x00, 0x3C, 0x62, 0x60, 0x60, 0x3C, 0x06, 0x06, 0x46, 0x3C, 0x00}, //18: S
-        {0x00, 0x7E, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x00}, //19: T
-        {0x00, 0x62, 0x62, 0x62, 0x62, 0x62, 0x62, 0x62, 0x62, 0x3C, 0x00}, //20: U
-        {0x00, 0x62, 0x62, 0x62, 0x62, 0x62, 0x62, 0x22, 0x14, 0x08, 0x00}, //21: V
-        {0x00, 0x62, 0x62, 0x62, 0x62, 0x62, 0x6A, 0x76, 0x62, 0x42, 0x00}, //22: W
-        {0x00, 0x42, 0x62, 0x74, 0x38, 0x1C, 0x2E, 0x46, 0x42, 0x42, 0x00}, //23: X
-        {0x00, 0x42, 0x62, 0x74, 0x38, 0x18, 0x18, 0x18, 0x18, 0x18, 0x00}, //24: Y
-        {0x00, 0x7E, 0x06, 0x0E, 0x0C, 0x18, 0x30, 0x70, 0x60, 0x7E, 0x00}, //25: Z
-        {0x00, 0x3C, 0x62, 0x62, 0x66, 0x6A, 0x72, 0x62, 0x62, 0x3C, 0x00}, //26: 0
-        {0x00, 0x38, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x00}, //27: 1
-        {0x00, 0x3C, 0x46, 0x06, 0x06, 0x1C, 0x20, 0x60, 0x60, 0x7E, 0x00}, //28: 2
-        {0x00, 0x3C, 0x46, 0x06, 0x06, 0x1C, 0x06, 0x06, 0x46, 0x3C, 0x00}, //29: 3
-        {0x00, 0x0C, 0x1C, 0x2C, 0x4C, 0x4C, 0x7E, 0x0C, 0x0C, 0x0C, 0x00}, //30: 4
-        {0x00, 0x7E, 0x60, 0x60, 0x60, 0x7C, 0x06, 0x06, 0x46, 0x3C, 0x00}, //31: 5
-        {0x00, 0x3C, 0x62, 0x60, 0x60, 0x7C, 0x62, 0x62, 0x62, 0x3C, 0x00}, //32: 6
-        {0x00, 0x7E, 0x06, 0x0C, 0x18, 0x30, 0x30, 0x30, 0x30, 0x30, 0x00}, //33: 7
-        {0x00, 0x3C, 0x62, 0x62, 0x62, 0x3C, 0x62, 0x62, 0x62, 0x3C, 0x00}, //34: 8
-        {0x00, 0x3C, 0x46, 0x46, 0x46, 0x3E, 0x06, 0x06, 0x46, 0x3C, 0x00}, //35: 9
-        {0x00, 0x00, 0x02, 0x06, 0x0E, 0x1C, 0x38, 0x70, 0x60, 0x40, 0x00}, //36: /
-        {0x00, 0x00, 0x00, 0x00, 0x00, 0x7E, 0x7E, 0x00, 0x00, 0x00, 0x00}, //37: -
-        {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x06, 0x06, 0x00}, //38: .
-        {0x00, 0x3C, 0x46, 0x06, 0x06, 0x0C, 0x10, 0x00, 0x30, 0x30, 0x00}, //39: ?
-        {0x00, 0x18, 0x18, 0x18, 0x18, 0x10, 0x10, 0x00, 0x18, 0x18, 0x00}, //40: !
-        {0x00, 0x00, 0x00, 0x18, 0x18, 0x00, 0x00, 0x18, 0x18, 0x00, 0x00}, //41: :
-        {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00}  //42: space
-};
-
-// Nibble font table
-const uint8_t l_fonts[23][5] = {
-  { 0xE2, 0xA6, 0xA2, 0xA2, 0xE2 }, // 0: 01
-  { 0xEE, 0x22, 0xE6, 0x82, 0xEE }, // 1: 23
-  { 0xAE, 0xA8, 0xEE, 0x22, 0x2E }, // 2: 45
-  { 0x8E, 0x82, 0xE2, 0xA2, 0xE2 }, // 3: 67
-  { 0xEE, 0xAA, 0xEE, 0xA2, 0xE2 }, // 4: 89
-  { 0x00, 0x22, 0x00, 0x22, 0x04 }, // 5: :;
-  { 0x20, 0x4E, 0x80, 0x4E, 0x20 }, // 6: <=
-  { 0x8E, 0x42, 0x26, 0x40, 0x84 }, // 7: >?
-  { 0x64, 0x9A, 0xBE, 0x8A, 0x7A }, // 8: @A
-  { 0xC6, 0xA8, 0xC8, 0xA8, 0xC6 }, // 9: BC
-  { 0xCE, 0xA8, 0xAC, 0xA8, 0xCE }, // 10: DE
-  { 0xE6, 0x88, 0xCE, 0x8A, 0x86 }, // 11: FG
-  { 0xA4, 0xA4, 0xE4, 0xA4, 0xA4 }, // 12: HI
-  { 0x69, 0x2A, 0x2C, 0x2A, 0x49 }, // 13: JK
-  { 0x8A, 0x8E, 0x8E, 0x8A, 0xEA }, // 14: LM
-  { 0x04, 0x9A, 0xDA, 0xBA, 0x94 }, // 15: NO
-  { 0xC4, 0xAA, 0xCA, 0x8E, 0x86 }, // 16: PQ
-  { 0xC6, 0xA8, 0xC4, 0xA2, 0xAC }, // 17: RS
-  { 0xE0, 0x4A, 0x4A, 0x4A, 0x44 }, // 18: TU
-  { 0x09, 0xA9, 0xA9, 0x6F, 0x26 }, // 19: vW (sort of..)
-  { 0x0A, 0xAA, 0x46, 0xA2, 0x04 }, // 20: XY
-  { 0xE6, 0x24, 0x44, 0x84, 0xE6 }, // 21: Z[
-  { 0x00, 0x00, 0x00, 0x00, 0x00 }  // 22: SPACE
-};
-
-void timer1_interrupt(){
-  if (sEm == 1){
-    if(tp < 320){  // Transmitting pixels
-      if(sCol == 0){  // Transmitting color Green
-        DDS.setfreq(1500 + 3.13 * buffG[tp], phase);
-      } else if(sCol == 1){ // Transmitting color Blue
-        DDS.setfreq(1500 + 3.13 * buffB[tp], phase);
-      } else if(sCol == 2){ // Transmitting color Red
-        DDS.setfreq(1500 + 3.13 * buffE[tp], phase);
-      }
-    } else if(tp == 320){
-      if(sCol == 0){  // Separator pulse after transmit Green
-        DDS.setfreq(1500, phase);
-      } else if(sCol == 1){ // Sync porch
-        DDS.setfreq(1200, phase);
-      } else if(sCol == 2){ // // Separator pulse after transmit Red
-        DDS.setfreq(1500, phase);
-      }
-      syncTime = micros();
-      sEm = 2;    // State when change color
-    }
-    tp++;
-  }
-}
+char footerText[51] = "LAT: 1234.1234N     LONG: 1234.1234W     ALT:10000";
 
 void setup() {
+  arena_paint_stack();
+#ifndef FAST_BOOT
   delay(5000);
+  boot_mark("Power-on wait");
+#endif
   pinMode(BUILT_IN_PIN, OUTPUT);
   pinMode(SD_SLAVE_PIN, OUTPUT);
   Serial.begin(9600);
   Serial.println("Starting");
 
   // AD9850 initilize
-  DDS.begin(AD9850_CLK_PIN, AD9850_FQ_UPDATE_PIN, AD9850_DATA_PIN, AD9850_RST_PIN);
+  dds_begin();
+  dds_lut_init(SSTV_BLACK_FREQ, SSTV_COLOR_STEP);  // Pixel tuning words, same mapping as scottie_freq()
+  tx_begin();  // Transmit clock, SPI stream backend
+  trace_begin();
+  gps_begin();
+  boot_mark("DDS");
+
+#ifdef BENCH
+  // Every stage over the corpus on the card instead of a picture
+  if (!SD.begin(SD_SLAVE_PIN)) {
+    Serial.println("initialization failed!");
+    while (1);
+  }
+  overlay_set_header(charId);
+  overlay_set_footer(footerText, sizeof(footerText));
+  bench_run();
+  arena_report();
+#elif defined(FAST_BOOT)
+  // The frame starts now, SD card and camera come up under its first lines
+  overlay_set_header(charId);
+  overlay_set_footer(footerText, sizeof(footerText));
+  fast_boot_transmit();
+  arena_report();
+#else
+  // Camera link and picture size first, its exposure settles during SD setup
+  camFound = cam_begin();
+  boot_mark("Camera");
 
   // Sd initialize
   Serial.print("Initializing SD card...");
@@ -198,33 +199,63 @@ void setup() {
     while (1);
   }
   Serial.println("initialization done.");
-
-  // Setup Timer with the emision interval
-  Timer1.attachInterrupt(timer1_interrupt).start(430); // ***** 354(uS/px) +/- SLANT ADJUST *****
-  delay(100);
-
+  boot_mark("SD");
+
+  overlay_set_header(charId);
+  overlay_set_footer(footerText, sizeof(footerText));
+  catalog_begin();
+#ifdef DECODE_TO_BIN
+  frame_cache_begin();
+#endif
+
+#ifdef BEACON
+  Serial.println("Beacon: sending frames until powered off");
+#else
+  arena_begin(ARENA_CAPTURE);
   shot_pic();
+  boot_mark("Capture");
 
   Serial.print("Picture taken saved on:");
   Serial.println(pic_filename);
 
-  strcpy(pic_decoded_filename, pic_filename);
-  pic_decoded_filename[8] = 'B';
-  pic_decoded_filename[9] = 'I';
-  pic_decoded_filename[10] = 'N';
+  captureTime = millis();
 
-  Serial.print("Writting on: ");
-  Serial.println(pic_decoded_filename);
+#ifdef DECODE_TO_BIN
+  uint32_t key = frame_cache_key(pic_filename);
+  bool decoded = frame_cache_find(key, pic_decoded_filename);
+  if (!decoded) {
+    frame_cache_path(key, pic_decoded_filename);
+    Serial.print("Writting on: ");
+    Serial.println(pic_decoded_filename);
 
-  jpeg_decode(pic_filename, pic_decoded_filename);
+    decoded = jpeg_decode(pic_filename, pic_decoded_filename, key);
+  }
+  boot_mark("Decode");
+  if (decoded) {
+    catalog_decoded(picSeq, key);
+  } else {
+    catalog_failed(picSeq);
+  }
 
-  scottie1_transmit_file(pic_decoded_filename);
+  if (sstv_transmit_file(pic_decoded_filename)) {
+    catalog_sent(picSeq);
+  }
+#else
+  if (sstv_transmit_jpeg(pic_filename)) {
+    catalog_sent(picSeq);
+  }
+#endif
+
+  arena_report();
+#endif
+#endif
 }
 
 void loop() {
-  // put your main code here, to run repeatedly:
-
-
+  gps_poll();
+#ifdef BEACON
+  beacon_frame();
+#endif
 }
 
 /**
@@ -233,224 +264,269 @@ void loop() {
  * @return uint16_t - scottie1 frequency
 **/
 uint16_t scottie_freq(uint8_t c){
-  return 1500 + (c * COLORCORRECTION);
+  return SSTV_BLACK_FREQ + (c * SSTV_COLOR_STEP);
 }
 
-void vox_tone(){
-  /** VOX TONE (OPTIONAL) **/
-  transmit_mili(1900, 100);
-  transmit_mili(1500, 100);
-  transmit_mili(1900, 100);
-  transmit_mili(1500, 100);
-  transmit_mili(2300, 100);
-  transmit_mili(1500, 100);
-  transmit_mili(2300, 100);
-  transmit_mili(1500, 100);
+/**
+ * Whether the next line or group can be read now. With the SPI stream
+ * backend the SD card may only be used in the gaps the transmitter leaves on
+ * the bus.
+**/
+bool line_available(){
+#ifdef DDS_STREAM
+  if(txStream){
+    return jpeg_stream_ready();
+  }
+  return (long)(tx_bus_free_until() - micros()) > (long)frame_file_read_us();
+#else
+  return true;
+#endif
 }
 
-void scottie1_calibrationHeader(){
-  /** CALIBRATION HEADER **/
-  transmit_mili(1900, 300);
-  transmit_mili(1200, 10);
-  transmit_mili(1900, 300);
-  transmit_mili(1200, 30);
-  transmit_mili(1300, 30);    // 0
-  transmit_mili(1300, 30);    // 0
-  transmit_mili(1100, 30);    // 1
-  transmit_mili(1100, 30);    // 1
-  transmit_mili(1100, 30);    // 1
-  transmit_mili(1100, 30);    // 1
-  transmit_mili(1300, 30);    // 0
-  transmit_mili(1300, 30);    // Even parity
-  transmit_mili(1200, 30);    // VIS stop bit
+/**
+ * Read the next JPEG line in place from the decoder. Lines past the end of
+ * the picture are white.
+ * @return const byte* - 320 pixels, 3 bytes (R, G, B) each
+**/
+const byte* read_line(){
+  const byte* row = jpeg_stream_line();
+  return row ? row : whiteLine;
 }
 
 /**
- * Set a frequency for a certain amount of time
- * @param int freq - Frequency
- * @param float duration - duration in microseconds
- */
-void transmit_micro(int freq, float duration){
-  DDS.setfreq(freq, phase);
-  delayMicroseconds(duration);
+ * Lay a white group out in a line ring slot
+ * @param byte* slot - from tx_queue_slot()
+**/
+void white_group(byte* slot){
+  for(uint8_t i = 0; i < Mode::Layout::lines; i++){
+    groupRows[i] = whiteLine;
+  }
+  Mode::Layout::encode(slot, groupRows);
 }
 
+#ifdef FAST_BOOT
 /**
- * Set a frequency for a certain amount of time
- * @param int freq - Frequency
- * @param float duration - duration in milliseconds
- */
-void transmit_mili(int freq, float duration){
-  DDS.setfreq(freq, phase);
-  delay(duration);
+ * Whether a white group goes out while the first picture is not ready. The
+ * overlay groups are white anyway; past them one is only sent when the
+ * transmitter would otherwise run dry, and the picture loses those lines.
+**/
+bool boot_white_due(){
+  return (groupNum + 1) * Mode::Layout::lines <= OVERLAY_LINES ||
+         bootStage == BOOT_FAILED || tx_queue_depth() == 0;
 }
+#endif
 
-void scottie1_transmit_file(char* filename){
-  /*
-  Be aware that you have to read variables on sync torch due its 9 ms instead 1.5 ms of the sync Pulse
-  */
-
-  bool head;
-  Serial.println("Transmitting picture");
-
-  File myFile = SD.open(filename);
-  if (myFile) {
-    head = true;
-
-    /** TRANSMIT EACH LINE **/
-    while(myFile.available() || line == 255){
-      if(head == true){ // Header
-        /** VOX TONE (OPTIONAL) **/
-        vox_tone();
-
-        /** CALIBRATION HEADER **/
-        scottie1_calibrationHeader();
-
-        // Configure syncTime
-        syncTime = micros();
-
-        // Read line and store color values in the buffer
-        for(uint16_t i = 0; i < 320; i++){
-          buffR[i] = myFile.read();
-          buffG[i] = myFile.read();
-          buffB[i] = myFile.read();
-        }
-
-        //Serial.println("++");
-        //Serial.println(micros() - syncTime); //Cheak reading time
-
-        while(micros() - syncTime < 9000 - 10){}
-
-        // Separator pulse
-        DDS.setfreq(1500, phase);
-        syncTime = micros();  // Configure syncTime
-
-        line = 0;
-        head = false;
+/**
+ * Fill the free line ring slots: frame file groups are read straight in,
+ * JPEG lines are laid out from the decoder bands. Groups past the end of the
+ * picture are sent white. The overlay text goes on last.
+**/
+void fill_queue(){
+  byte* slot;
+#ifdef FAST_BOOT
+  if(bootStage == BOOT_SKIPPING && jpeg_stream_skip(groupNum * Mode::Layout::lines)){
+    bootStage = BOOT_STREAMING;
+    Serial.print("Picture from line ");
+    Serial.println(groupNum * Mode::Layout::lines);
+  }
+#endif
+  while((slot = tx_queue_slot()) != 0){
+#ifdef FAST_BOOT
+    if(bootStage != BOOT_STREAMING){
+      if(!boot_white_due()){
+        return;
       }
-
-      while(micros() - syncTime < 1500 - 10){} // Separator pulse
-
-      // Green Scan
-      tp = 0; sCol = 0; sEm = 1;
-      while(sEm == 1){};
-
-      // Separator Pulse
-      DDS.setfreq(1500, phase);
-      while(micros() - syncTime < 1500 - 10){}
-
-      // Blue Scan
-      tp = 0; sCol = 1; sEm = 1;
-      while(sEm == 1){};
-
-      //Evacuate
-      for(uint16_t i = 0; i < 320; i++){
-        buffE[i] = buffR[i];
+      white_group(slot);
+      overlay_group(slot, groupNum++);
+      tx_queue_push();
+      continue;
+    }
+#endif
+    if(!txStream){
+      if(!line_available()){
+        return;
       }
-
-      if(line != 255){
-        // Read line and store color values in the buffer
-        for(uint16_t i = 0; i < 320; i++){
-          buffR[i] = myFile.read();
-          buffG[i] = myFile.read();
-          buffB[i] = myFile.read();
-        }
+      if(!frame_file_read_group(&txFile, slot)){
+        white_group(slot);
       }
+      overlay_group(slot, groupNum++);
+      tx_queue_push();
+      continue;
+    }
 
-      //Serial.println("--");
-      //Serial.println(micros() - syncTime); //Cheak reading time
+    while(groupLines < Mode::Layout::lines){
+      if(!line_available()){
+        return;
+      }
+      groupRows[groupLines++] = read_line();
+    }
+    Mode::Layout::encode(slot, groupRows);
+    overlay_group(slot, groupNum++);
+    tx_queue_push();
+    groupLines = 0;
+    jpeg_stream_release();
+  }
+}
 
-      //Sync pulse
-      while(micros() - syncTime < 9000 - 10){}
+/**
+ * Send VOX, calibration header and every line given by read_line() in the
+ * mode selected at build time. The transmit interrupt does all the timing;
+ * this only keeps its line queue full and decodes ahead in the spare time.
+**/
+void sstv_transmit(){
+  Serial.print("Transmitting picture, VIS ");
+  Serial.println(Mode::vis);
+#ifndef FAST_BOOT
+  Serial.print("Capture to first tone: ");
+  Serial.print(millis() - captureTime);
+  Serial.println(" ms");
+#endif
+
+  while(gps_poll());  // Position as of the start of the frame
+  if(gps_footer(footerText, sizeof(footerText))){
+    overlay_set_footer(footerText, sizeof(footerText));
+  }
 
-      // Sync porch
-      DDS.setfreq(1500, phase);
-      syncTime = micros();
-      while(micros() - syncTime < 1500 - 10){}
+  groupLines = 0;
+  groupNum = 0;
+  whiteLine = (byte*)arena_alloc(SSTV_RGB_LINE);
+  memset(whiteLine, 0xFF, SSTV_RGB_LINE);
+  tx_start();
+  boot_first_tone(tx_started_at());
+#if defined(BEACON) || defined(FAST_BOOT)
+  arena_hold();  // The next picture is prepared above the transmit buffers
+#endif
+
+  while(tx_busy()){
+    fill_queue();
+    tx_service();
+    gps_poll();
+#ifdef BEACON
+    if(prep_step()){
+      continue;
+    }
+#endif
+#ifdef FAST_BOOT
+    if(boot_step()){
+      continue;
+    }
+#endif
+    if(!txStream || !jpeg_stream_pump(tx_bus_free_until())){
+      yield();
+    }
+  }
 
-      // Red Scan
-      tp = 0; sCol = 2; sEm = 1;
-      while(sEm == 1){};
+  Serial.println("Finish");
+  dds_down();
+#if defined(BEACON) || defined(FAST_BOOT)
+  arena_release();
+#endif
+
+  tx_report();
+  trace_report();
+  boot_report();
+  gps_report();
+  if(!txStream){
+    Serial.print("Slowest group read: ");
+    Serial.print(frame_file_read_us());
+    Serial.println(" us");
+  }
+}
 
-      line++;
-      if(line == 256){
-        Serial.println("Finish");
-        DDS.setfreq(2, phase);
-        DDS.down();
-        sEm = 0;
-      }
-      else {
-        // Separator pulse
-        DDS.setfreq(1500, phase);
-        syncTime = micros();
-        sEm = 2;
-      }
-    }
+/**
+ * Transmit a frame file previously written by jpeg_decode()
+ * @param char* filename - .BIN frame file on the SD card
+ * @return bool - false if it could not be opened
+**/
+bool sstv_transmit_file(char* filename){
+  arena_begin(ARENA_TRANSMIT);
+  txFile = SD.open(filename);
+  if (txFile && frame_file_open(&txFile)) {
+    txStream = false;
+    sstv_transmit();
     // close the file:
-    myFile.close();
-  } else {
-    // if the file didn't open, print an error:
-    Serial.println("error opening test.txt");
+    txFile.close();
+    return true;
   }
+  // if the file didn't open, print an error:
+  Serial.println("error opening frame file");
+  return false;
 }
 
-void jpeg_decode(char* filename, char* fileout){
-  uint8 *pImg;
-  int x,y,bx,by;
-  byte sortBuf[15360]; //320(px)*16(lines)*3(bytes) // Header buffer
-  int i,j,k;
-  int pxSkip;
+/**
+ * Transmit a JPEG decoding it on the fly, without writing anything to SD
+ * @param char* filename - JPEG file on the SD card
+ * @return bool - false if it could not be opened
+**/
+bool sstv_transmit_jpeg(char* filename){
+  arena_begin(ARENA_TRANSMIT);
+  if (jpeg_stream_open(filename)) {
+    txStream = true;
+    sstv_transmit();
+    txStream = false;
+    jpeg_stream_close();
+    return true;
+  }
+  Serial.println("error opening JPEG");
+  return false;
+}
 
-  // Open the file for writing
-  File imgFile = SD.open(fileout, FILE_WRITE);
-
-  for(i = 0; i < 15360; i++){ // Cleaning Header Buffer array
-    sortBuf[i] = 0xFF;
-  }
-
-  for(i = 0; i < 12; i++){
-    byte fontNumber;
-    char ch;
-    ch = charId[i];
-    for(y = 0; y < 11; y++){
-      for(x = 0; x < 8; x++){
-        pxSkip = 16 + (320 * (y + 3)) + (3 * 8 * i) + (3 * x); //Width: x3
-
-        uint8_t mask;
-        mask = pow(2, 7 - x);
-
-        if(ch >= 65 && ch <= 90){ // A to Z
-                fontNumber = ch - 65;
-        }
-        else if(ch >= 48 && ch <= 57){ //0 to 9
-                fontNumber = ch - 22;
-        }
-        else if(ch == '/'){fontNumber = 36;}
-        else if(ch == '-'){fontNumber = 37;}
-        else if(ch == '.'){fontNumber = 38;}
-        else if(ch == '?'){fontNumber = 39;}
-        else if(ch == '!'){fontNumber = 40;}
-        else if(ch == ':'){fontNumber = 41;}
-        else if(ch == ' '){fontNumber = 42;}
-        else              {fontNumber = 42;}
-
-        if((b_fonts[fontNumber][y] & mask) != 0){
-          for(j = 0; j < 9; j++){
-                  sortBuf[(3 * pxSkip) + j] = 0x00;
-          }
-        }
-      }
+/**
+ * Decode a JPEG to a frame file for the mode of this build: white lines
+ * for the overlay, then the picture scaled to 320 pixels wide, laid out as
+ * it will be sent. The file goes into the frame cache; while the card is too
+ * full for it, older cache entries are dropped and it is written again.
+ * @param char* filename - JPEG on the SD card
+ * @param char* fileout - frame file to write, from frame_cache_path()
+ * @param uint32_t key - frame cache key of the JPEG
+ * @return bool - false if no frame file was written
+**/
+bool jpeg_decode(char* filename, char* fileout, uint32_t key){
+  do {
+    if (!decode_start(filename, fileout)) {
+      return false;
+    }
+    while(decode_step()){
+      gps_poll();
+    }
+    if (decode_finish()) {
+      frame_cache_add(key);
+      return true;
     }
+  } while(frame_cache_evict());
+  SD.remove(fileout);
+  return false;
+}
+
+/**
+ * Open a JPEG and start its frame file with the white overlay lines
+ * @param char* filename - JPEG on the SD card
+ * @param char* fileout - frame file to write, replaced if it exists
+ * @return bool - false if either could not be opened
+**/
+bool decode_start(char* filename, char* fileout){
+  int k;
+
+  arena_begin(ARENA_DECODE);
+
+  // Decoding start
+  if (!jpeg_scale_open(filename, Mode::lines - OVERLAY_LINES)) {
+    Serial.println("error opening JPEG");
+    return false;
   }
 
-  for(k = 0; k < 15360; k++){  // Adding header to the binary file
-    imgFile.write(sortBuf[k]);
+  // Open the file for writing
+  if (!frame_file_create(fileout)) {
+    Serial.println("error writing frame file");
+    return false;
   }
 
-  writeFooter(&imgFile);  //Writing first 10560 bytes (11*320*3)
+  decodeLine = (byte*)arena_alloc(SSTV_RGB_LINE);
+  memset(decodeLine, 0xFF, SSTV_RGB_LINE);
+  for(k = 0; k < OVERLAY_LINES; k++){  // Header and footer, text goes on at transmit time
+    frame_file_write_line(decodeLine);
+  }
 
-  // Decoding start
-  JpegDec.decode(filename,0);
   // Image Information
   Serial.print("Width     :");
   Serial.println(JpegDec.width);
@@ -468,167 +544,333 @@ void jpeg_decode(char* filename, char* fileout){
   Serial.println(JpegDec.MCUWidth);
   Serial.print("MCU height:");
   Serial.println(JpegDec.MCUHeight);
+  Serial.print("Lines     :");
+  Serial.println(jpeg_scale_lines());
   Serial.println("");
 
-  Serial.println("Writting bin to SD");
-
-  i = 0;
-  j = 0;
-  while(JpegDec.read()){
-    pImg = JpegDec.pImage ;
-    for(by=0; by<JpegDec.MCUHeight; by++){
-      for(bx=0; bx<JpegDec.MCUWidth; bx++){
-        x = JpegDec.MCUx * JpegDec.MCUWidth + bx;
-        y = JpegDec.MCUy * JpegDec.MCUHeight + by;
-        if(x<JpegDec.width && y<JpegDec.height){
-          if(JpegDec.comps == 1){ // Grayscale
-            //sprintf(str,"%u", pImg[0]);
-            imgFile.write(pImg, 1);
-          }else{ // RGB
-            // When saving to the SD, write 16 lines on one time
-            // First we write on the array 16 lines and then we save to SD
-            pxSkip = ((y - (16 * j)) * 320) + x;
-            sortBuf[(3 * pxSkip) + 0] = pImg[0];
-            sortBuf[(3 * pxSkip) + 1] = pImg[1];
-            sortBuf[(3 * pxSkip) + 2] = pImg[2];
-
-            i++;
-            if(i == 5120){ //320(px)x16(lines)
-              for(k = 0; k < 15360; k++){
-                imgFile.write(sortBuf[k]);
-              }
-              i = 0;
-              j++; //15(sections)
-            }
-          }
-        }
-        pImg += JpegDec.comps ;
-      }
-    }
+  Serial.println("Writting frame file to SD");
+  return true;
+}
+
+/**
+ * Write the next line of the frame file, or decode one more MCU for it
+ * @return bool - false once the whole picture is written
+**/
+bool decode_step(){
+  if(jpeg_scale_line(decodeLine)){
+    frame_file_write_line(decodeLine);
+    return true;
   }
+  return jpeg_scale_mcu();
+}
 
-  Serial.println("Bin has been written on SD");
-  imgFile.close();
+/**
+ * Pad and close the frame file
+ * @return bool - false if it could not be written in full
+**/
+bool decode_finish(){
+  if (frame_file_finish("Decode")) {
+    Serial.println("Frame file has been written on SD");
+    return true;
+  }
+  Serial.println("error writing frame file");
+  return false;
 }
 
 void shot_pic(){
   // Try to locate the camera
-  if (cam.begin()) {
+  if (camFound) {
     Serial.println("Camera Found:");
   } else {
     Serial.println("No camera found?");
     return;
   }
 
-  for (int i = 0; i <= 10; i++){
-    cam.setImageSize(VC0706_320x240);
-  }
-
-  Serial.println("Snap in 3 secs...");
-  delay(3000);
+  // Next IMGxxxxx.JPG from the catalog, the oldest capture makes room
+  picSeq = catalog_new(pic_filename);
 
-  if (! cam.takePicture())
+  Serial.println("Snap once the exposure has settled...");
+  int32_t time = millis();
+  if (! cam_capture(pic_filename)) {
     Serial.println("Failed to snap!");
-  else
+    catalog_failed(picSeq);
+  } else {
     Serial.println("Picture taken!");
+    catalog_captured(picSeq, cam_capture_bytes());
+  }
 
-  // Create an image with the name IMAGExx.JPG`
-  strcpy(pic_filename, "IMAGE00.JPG");
-  for (int i = 0; i < 100; i++) {
-    pic_filename[5] = '0' + i/10;
-    pic_filename[6] = '0' + i%10;
-    // create if does not exist, do not open existing, write, sync after write
-    if (! SD.exists(pic_filename)) {
-      break;
-    }
+  time = millis() - time;
+  Serial.print(time); Serial.println(" ms elapsed");
+}
+
+#ifdef BEACON
+
+/**
+ * Do one step of preparing the next beacon frame: a camera chunk, a sector
+ * of the JPEG hashed for the frame cache, a decoded MCU or a frame file
+ * line. Each takes well under the time the line ring holds, so the
+ * transmitter never runs dry.
+ * @return bool - false if there was nothing to do
+**/
+bool prep_step(){
+  switch(prepStage){
+    case PREP_SETTLE:
+      if(!cam_ready()){
+        return false;
+      }
+      arena_begin(ARENA_CAPTURE);
+      if(!camFound){              // Looked for again by beacon_frame()
+        beaconSeq[prepSlot] = 0;  // Nothing in the catalog
+        prepStage = PREP_FAILED;
+        return true;
+      }
+      beaconSeq[prepSlot] = catalog_new(beaconJpg[prepSlot]);
+      prepStage = PREP_CAPTURE;
+      if(!cam_capture_start(beaconJpg[prepSlot])){
+        Serial.println("Failed to snap!");
+        camFound = false;
+        camTried = millis();
+        prepStage = PREP_FAILED;
+      }
+      return true;
+
+    case PREP_CAPTURE:
+      if(cam_capture_step()){
+        return true;
+      }
+      if(!cam_capture_finish()){
+        Serial.println("Failed to snap!");
+        camFound = false;
+        camTried = millis();
+        prepStage = PREP_FAILED;
+        return true;
+      }
+      catalog_captured(beaconSeq[prepSlot], cam_capture_bytes());
+      captureTime = millis();
+      prepStage = frame_cache_hash_start(beaconJpg[prepSlot]) ? PREP_HASH : PREP_FAILED;
+      return true;
+
+    case PREP_HASH:
+      if(frame_cache_hash_step()){
+        return true;
+      }
+      prepKey = frame_cache_hash_finish();
+      if(frame_cache_find(prepKey, beaconBin[prepSlot])){
+        catalog_decoded(beaconSeq[prepSlot], prepKey);
+        prepStage = PREP_READY;  // Sent before, no decode
+        return true;
+      }
+      frame_cache_path(prepKey, beaconBin[prepSlot]);
+      prepStage = decode_start(beaconJpg[prepSlot], beaconBin[prepSlot]) ? PREP_DECODE : PREP_FAILED;
+      return true;
+
+    case PREP_DECODE:
+      if(decode_step()){
+        return true;
+      }
+      if(decode_finish()){
+        frame_cache_add(prepKey);
+        catalog_decoded(beaconSeq[prepSlot], prepKey);
+        prepStage = PREP_READY;
+      } else if(!frame_cache_evict() || !decode_start(beaconJpg[prepSlot], beaconBin[prepSlot])){
+        SD.remove(beaconBin[prepSlot]);
+        prepStage = PREP_FAILED;
+      }  // Otherwise written again with room made
+      return true;
   }
+  return false;
+}
 
-  // Open the file for writing
-  File imgFile = SD.open(pic_filename, FILE_WRITE);
+/**
+ * Frame with the overlay alone, for the beacon to send while it has no
+ * picture. Written once per run.
+ * @return char* - its file, 0 if it could not be written
+**/
+char* white_frame(){
+  static char filename[] = BEACON_WHITE;
+  static bool written = false;
+  if(!written){
+    arena_begin(ARENA_DECODE);
+    written = frame_file_create(filename) && frame_file_finish("White");
+  }
+  return written ? filename : 0;
+}
 
-  // Get the size of the image (frame) taken
-  uint16_t jpglen = cam.frameLength();
-  Serial.print("Storing ");
-  Serial.print(jpglen, DEC);
-  Serial.print(" byte image.");
+/**
+ * Send the next beacon frame, preparing the one after it while it is on the
+ * air. If that was not done in time it is finished first, off the air. A
+ * camera that failed is looked for again at most every
+ * BEACON_CAMERA_RETRY_MS, between frames; until the first picture the
+ * overlay goes out on white.
+**/
+void beacon_frame(){
+  if(!camFound && millis() - camTried >= BEACON_CAMERA_RETRY_MS){
+    camTried = millis();
+    Serial.println("Beacon: looking for the camera");
+    camFound = cam_begin();
+  }
 
-  int32_t time = millis();
-  pinMode(8, OUTPUT);
-  // Read all the data up to # bytes!
-  byte wCount = 0; // For counting # of writes
-  while (jpglen > 0) {
-    // read 32 bytes at a time;
-    uint8_t *buffer;
-    uint8_t bytesToRead = min(32, jpglen); // change 32 to 64 for a speedup but may not work with all setups!
-    buffer = cam.readPicture(bytesToRead);
-    imgFile.write(buffer, bytesToRead);
-    if(++wCount >= 64) { // Every 2K, give a little feedback so it doesn't appear locked up
-      Serial.print('.');
-      wCount = 0;
+  while(prepStage != PREP_READY && prepStage != PREP_FAILED){
+    gps_poll();
+    if(!prep_step()){
+      yield();
     }
-    //Serial.print("Read ");  Serial.print(bytesToRead, DEC); Serial.println(" bytes");
-    jpglen -= bytesToRead;
   }
-  imgFile.close();
 
-  time = millis() - time;
-  Serial.println("done!");
-  Serial.print(time); Serial.println(" ms elapsed");
+  if(prepStage == PREP_READY){
+    airSlot = prepSlot;
+    prepSlot ^= 1;
+  } else {
+    catalog_failed(beaconSeq[prepSlot]);
+  }
+  prepStage = PREP_SETTLE;
+
+  char* frame = airSlot >= 0 ? beaconBin[airSlot] : white_frame();
+  if(!frame){       // Not even the white frame, the card is failing
+    delay(BEACON_CAMERA_RETRY_MS);
+    return;
+  }
+  if(airSlot < 0){
+    Serial.println("Beacon: no picture yet, sending the overlay alone");
+  }
+
+  unsigned long start = millis();
+  unsigned long offAir = beaconFrames > 0 ? start - beaconEnd : 0;
+  if(beaconFrames == 0){
+    beaconStart = start;
+  }
+
+  if(sstv_transmit_file(frame) && airSlot >= 0){
+    catalog_sent(beaconSeq[airSlot]);
+  }
+  beaconEnd = millis();
+  beaconFrames++;
+
+  Serial.print("Beacon frame ");
+  Serial.print(beaconFrames);
+  Serial.print(": ");
+  Serial.print(beaconEnd - start);
+  Serial.print(" ms on air, ");
+  Serial.print(offAir);
+  Serial.print(" ms off air before it, ");
+  Serial.print(beaconFrames * 3600000.0 / (beaconEnd - beaconStart), 2);
+  Serial.print(" frames/hour of ");
+  Serial.print(3600000.0 / (beaconEnd - start), 2);
+  Serial.println(" by airtime");
+
+  if(beaconFrames == 1){
+    arena_report();
+  }
+#ifdef SSTV_NATIVE
+  sim_check(prepStage == PREP_READY || !camFound, "next beacon frame ready on air");
+#endif
 }
 
-/**     Write on a file with 11 lines the values of the GPS
- * @param dst Given an opened File stream then write data to dst.
- * @param latitude Floating point latitude value in degrees/min as received from the GPS (DDMM.MMMM)
- * @param lat N/S
- * @param longitude Floating point longitude value in degrees/min as received from the GPS (DDMM.MMMM)
- * @param lon E/W
- * @param altitude Altitude in meters above MSL
- */
-
-//void writeFooter(File* dst, nmea_float_t latitude, char lat, nmea_float_t longitude, char lon, nmea_float_t altitude){    //Write 16 lines with values
-void writeFooter(File* dst){
-  int x,y;
-  byte sortBuf[10560]; //320(px)*11(lines)*3(bytes) // Header buffer
-  int i,j,k;
-  int pxSkip;
-
-  char res[51] = "LAT: 1234.1234N     LONG: 1234.1234W     ALT:10000";
-
-  for(i = 0; i < 10560; i++){ // Cleaning Header Buffer array
-    sortBuf[i] = 0xFF;
-  }
-
-  for(i = 0; i < sizeof(res); i++){
-    byte fontNumber;
-    char ch;
-    ch = res[i];
-    for(y = 0; y < 5; y++){
-      for(x = 0; x < 4; x++){
-        //pxSkip = HORIZONTALOFFSET + VERSTICALOFFSET + (BITSPERWORD * i);
-        //pxSkip = 16 + (320 * (y + 3)) + (4 * 2 * i) + (2 * x); Width: x2
-        pxSkip = 16 + (320 * (y + 3)) + (4 * i) + x;
-
-        // If ch is pair mask is: 11110000, if no 00001111
-        uint8_t sl = (ch % 2)? 3 : 7 ;
-        uint8_t mask = pow(2, sl - x);
-
-        if(ch >= 48 && ch <=91){
-          fontNumber = (ch-48)/2;
-        }
-        else {
-          fontNumber = 22;
-        }
-
-        if((l_fonts[fontNumber][y] & mask) != 0){
-          for(j = 0; j < 3; j++){
-                  sortBuf[(3 * pxSkip) + j] = 0x00;
-          }
-        }
-      }
-    }
+#endif
+
+#ifdef FAST_BOOT
+
+/**
+ * Send the first frame straight after power on. The SD card, the camera and
+ * the capture are brought up by boot_step() while the header and the white
+ * overlay lines are on the air, and the picture is decoded as it is sent.
+**/
+void fast_boot_transmit(){
+  arena_begin(ARENA_TRANSMIT);
+  txStream = true;
+  bootStage = BOOT_SD;
+  sstv_transmit();
+  txStream = false;
+
+  if(bootStage == BOOT_SKIPPING || bootStage == BOOT_STREAMING){
+    jpeg_stream_close();
+  }
+  if(bootStage == BOOT_STREAMING){
+    catalog_sent(picSeq);
+  } else {
+    catalog_failed(picSeq);
   }
+}
 
-  for(k = 0; k < 10560; k++){  // Adding header to the binary file
-    dst->write(sortBuf[k]);
+/**
+ * Do one step of bringing up the first picture: start the SD card, poll the
+ * camera, send it one command of its link bring-up, start the capture once
+ * the exposure has settled, read a camera chunk, or open the JPEG for
+ * streaming. Each takes well under the time the line ring holds.
+ * @return bool - false if there was nothing to do
+**/
+bool boot_step(){
+  switch(bootStage){
+    case BOOT_SD:
+      Serial.print("Initializing SD card...");
+      if (!SD.begin(SD_SLAVE_PIN)) {
+        Serial.println("initialization failed!");
+        bootStage = BOOT_FAILED;
+        return true;
+      }
+      Serial.println("initialization done.");
+      catalog_begin();
+      boot_mark("SD");
+      bootStage = BOOT_CAMERA;
+      return true;
+
+    case BOOT_CAMERA:
+      if(cam_answers()){
+        cam_begin_start();
+        bootStage = BOOT_LINK;
+      } else if(millis() > CAM_BOOT_MS){
+        Serial.println("No camera found?");
+        bootStage = BOOT_FAILED;
+      }
+      return true;
+
+    case BOOT_LINK:
+      if(cam_begin_step()){
+        return true;
+      }
+      camFound = cam_begin_finish();
+      boot_mark("Camera");
+      bootStage = camFound ? BOOT_SETTLE : BOOT_FAILED;
+      if(!camFound){
+        Serial.println("No camera found?");
+      }
+      return true;
+
+    case BOOT_SETTLE:
+      if(!cam_ready()){
+        return false;
+      }
+      boot_mark("Exposure");
+      arena_begin(ARENA_CAPTURE);
+      picSeq = catalog_new(pic_filename);
+      bootStage = BOOT_CAPTURE;
+      if(!cam_capture_start(pic_filename)){
+        Serial.println("Failed to snap!");
+        bootStage = BOOT_FAILED;
+      }
+      return true;
+
+    case BOOT_CAPTURE:
+      if(cam_capture_step()){
+        return true;
+      }
+      bootStage = BOOT_FAILED;
+      if(!cam_capture_finish()){
+        Serial.println("Failed to snap!");
+        return true;
+      }
+      catalog_captured(picSeq, cam_capture_bytes());
+      boot_mark("Capture");
+
+      arena_begin(ARENA_TRANSMIT);
+      if(!jpeg_stream_open(pic_filename)){
+        Serial.println("error opening JPEG");
+        return true;
+      }
+      bootStage = BOOT_SKIPPING;  // Its first lines went out white already
+      return true;
   }
+  return false;
 }
+
+#endif
@@ -0,0 +1,234 @@
+#include "overlay.h"
+#include "sstv_mode.h"
+
+#ifdef SSTV_NATIVE
+#include "sim_reference.h"
+#endif
+
+//FONTS
+constexpr uint8_t b_fonts[43][11] = {
+        {0x00, 0x18, 0x24, 0x62, 0x62, 0x62, 0x7E, 0x62, 0x62, 0x62, 0x00}, //00: A
+        {0x00, 0x7C, 0x32, 0x32, 0x32, 0x3C, 0x32, 0x32, 0x32, 0x7C, 0x00}, //01: B
+        {0x00, 0x3C, 0x62, 0x62, 0x60, 0x60, 0x60, 0x62, 0x62, 0x3C, 0x00}, //02: C
+        {0x00, 0x7C, 0x32, 0x32, 0x32, 0x32, 0x32, 0x32, 0x32, 0x7C, 0x00}, //03: D
+        {0x00, 0x7E, 0x60, 0x60, 0x60, 0x7C, 0x60, 0x60, 0x60, 0x7E, 0x00}, //04: E
+        {0x00, 0x7E, 0x60, 0x60, 0x60, 0x7C, 0x60, 0x60, 0x60, 0x60, 0x00}, //05: F
+        {0x00, 0x3C, 0x62, 0x62, 0x60, 0x60, 0x66, 0x62, 0x62, 0x3C, 0x00}, //06: G
+        {0x00, 0x62, 0x62, 0x62, 0x62, 0x7E, 0x62, 0x62, 0x62, 0x62, 0x00}, //07: H
+        {0x00, 0x3C, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x3C, 0x00}, //08: I
+        {0x00, 0x1E, 0x0C, 0x0C, 0x0C, 0x0C, 0x4C, 0x4C, 0x4C, 0x38, 0x00}, //09: J
+        {0x00, 0x62, 0x64, 0x68, 0x70, 0x68, 0x64, 0x62, 0x62, 0x62, 0x00}, //10: K
+        {0x00, 0x60, 0x60, 0x60, 0x60, 0x60, 0x60, 0x60, 0x60, 0x7E, 0x00}, //11: L
+        {0x00, 0x42, 0x62, 0x76, 0x6A, 0x62, 0x62, 0x62, 0x62, 0x62, 0x00}, //12: M
+        {0x00, 0x42, 0x62, 0x72, 0x6A, 0x66, 0x62, 0x62, 0x62, 0x62, 0x00}, //13: N
+        {0x00, 0x3C, 0x62, 0x62, 0x62, 0x62, 0x62, 0x62, 0x62, 0x3C, 0x00}, //14: O
+        {0x00, 0x7C, 0x62, 0x62, 0x62, 0x7C, 0x60, 0x60, 0x60, 0x60, 0x00}, //15: P
+        {0x00, 0x3C, 0x62, 0x62, 0x62, 0x62, 0x62, 0x6A, 0x6A, 0x3C, 0x08}, //16: Q
+        {0x00, 0x7C, 0x62, 0x62, 0x62, 0x7C, 0x68, 0x64, 0x62, 0x62, 0x00}, //17: R
+        {0x00, 0x3C, 0x62, 0x60, 0x60, 0x3C, 0x06, 0x06, 0x46, 0x3C, 0x00}, //18: S
+        {0x00, 0x7E, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x00}, //19: T
+        {0x00, 0x62, 0x62, 0x62, 0x62, 0x62, 0x62, 0x62, 0x62, 0x3C, 0x00}, //20: U
+        {0x00, 0x62, 0x62, 0x62, 0x62, 0x62, 0x62, 0x22, 0x14, 0x08, 0x00}, //21: V
+        {0x00, 0x62, 0x62, 0x62, 0x62, 0x62, 0x6A, 0x76, 0x62, 0x42, 0x00}, //22: W
+        {0x00, 0x42, 0x62, 0x74, 0x38, 0x1C, 0x2E, 0x46, 0x42, 0x42, 0x00}, //23: X
+        {0x00, 0x42, 0x62, 0x74, 0x38, 0x18, 0x18, 0x18, 0x18, 0x18, 0x00}, //24: Y
+        {0x00, 0x7E, 0x06, 0x0E, 0x0C, 0x18, 0x30, 0x70, 0x60, 0x7E, 0x00}, //25: Z
+        {0x00, 0x3C, 0x62, 0x62, 0x66, 0x6A, 0x72, 0x62, 0x62, 0x3C, 0x00}, //26: 0
+        {0x00, 0x38, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x00}, //27: 1
+        {0x00, 0x3C, 0x46, 0x06, 0x06, 0x1C, 0x20, 0x60, 0x60, 0x7E, 0x00}, //28: 2
+        {0x00, 0x3C, 0x46, 0x06, 0x06, 0x1C, 0x06, 0x06, 0x46, 0x3C, 0x00}, //29: 3
+        {0x00, 0x0C, 0x1C, 0x2C, 0x4C, 0x4C, 0x7E, 0x0C, 0x0C, 0x0C, 0x00}, //30: 4
+        {0x00, 0x7E, 0x60, 0x60, 0x60, 0x7C, 0x06, 0x06, 0x46, 0x3C, 0x00}, //31: 5
+        {0x00, 0x3C, 0x62, 0x60, 0x60, 0x7C, 0x62, 0x62, 0x62, 0x3C, 0x00}, //32: 6
+        {0x00, 0x7E, 0x06, 0x0C, 0x18, 0x30, 0x30, 0x30, 0x30, 0x30, 0x00}, //33: 7
+        {0x00, 0x3C, 0x62, 0x62, 0x62, 0x3C, 0x62, 0x62, 0x62, 0x3C, 0x00}, //34: 8
+        {0x00, 0x3C, 0x46, 0x46, 0x46, 0x3E, 0x06, 0x06, 0x46, 0x3C, 0x00}, //35: 9
+        {0x00, 0x00, 0x02, 0x06, 0x0E, 0x1C, 0x38, 0x70, 0x60, 0x40, 0x00}, //36: /
+        {0x00, 0x00, 0x00, 0x00, 0x00, 0x7E, 0x7E, 0x00, 0x00, 0x00, 0x00}, //37: -
+        {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x06, 0x06, 0x00}, //38: .
+        {0x00, 0x3C, 0x46, 0x06, 0x06, 0x0C, 0x10, 0x00, 0x30, 0x30, 0x00}, //39: ?
+        {0x00, 0x18, 0x18, 0x18, 0x18, 0x10, 0x10, 0x00, 0x18, 0x18, 0x00}, //40: !
+        {0x00, 0x00, 0x00, 0x18, 0x18, 0x00, 0x00, 0x18, 0x18, 0x00, 0x00}, //41: :
+        {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00}  //42: space
+};
+
+// Nibble font table
+constexpr uint8_t l_fonts[23][5] = {
+  { 0xE2, 0xA6, 0xA2, 0xA2, 0xE2 }, // 0: 01
+  { 0xEE, 0x22, 0xE6, 0x82, 0xEE }, // 1: 23
+  { 0xAE, 0xA8, 0xEE, 0x22, 0x2E }, // 2: 45
+  { 0x8E, 0x82, 0xE2, 0xA2, 0xE2 }, // 3: 67
+  { 0xEE, 0xAA, 0xEE, 0xA2, 0xE2 }, // 4: 89
+  { 0x00, 0x22, 0x00, 0x22, 0x04 }, // 5: :;
+  { 0x20, 0x4E, 0x80, 0x4E, 0x20 }, // 6: <=
+  { 0x8E, 0x42, 0x26, 0x40, 0x84 }, // 7: >?
+  { 0x64, 0x9A, 0xBE, 0x8A, 0x7A }, // 8: @A
+  { 0xC6, 0xA8, 0xC8, 0xA8, 0xC6 }, // 9: BC
+  { 0xCE, 0xA8, 0xAC, 0xA8, 0xCE }, // 10: DE
+  { 0xE6, 0x88, 0xCE, 0x8A, 0x86 }, // 11: FG
+  { 0xA4, 0xA4, 0xE4, 0xA4, 0xA4 }, // 12: HI
+  { 0x69, 0x2A, 0x2C, 0x2A, 0x49 }, // 13: JK
+  { 0x8A, 0x8E, 0x8E, 0x8A, 0xEA }, // 14: LM
+  { 0x04, 0x9A, 0xDA, 0xBA, 0x94 }, // 15: NO
+  { 0xC4, 0xAA, 0xCA, 0x8E, 0x86 }, // 16: PQ
+  { 0xC6, 0xA8, 0xC4, 0xA2, 0xAC }, // 17: RS
+  { 0xE0, 0x4A, 0x4A, 0x4A, 0x44 }, // 18: TU
+  { 0x09, 0xA9, 0xA9, 0x6F, 0x26 }, // 19: vW (sort of..)
+  { 0x0A, 0xAA, 0x46, 0xA2, 0x04 }, // 20: XY
+  { 0xE6, 0x24, 0x44, 0x84, 0xE6 }, // 21: Z[
+  { 0x00, 0x00, 0x00, 0x00, 0x00 }  // 22: SPACE
+};
+
+#define ATLAS_FIRST 32            // Atlas covers ' ' to '_'
+#define ATLAS_CHARS 64
+#define HEADER_ROWS 11
+#define FOOTER_ROWS 5
+#define TEXT_LEFT 16              // First pixel column of the text
+#define TEXT_TOP 3                // First line of the text in its band
+
+/**
+ * Header font of a character, same mapping the header loop used
+ * @param char ch - character
+ * @return uint8_t - row in b_fonts
+**/
+constexpr uint8_t header_font(char ch){
+  return ch >= 'A' && ch <= 'Z' ? ch - 65 :
+         ch >= '0' && ch <= '9' ? ch - 22 :
+         ch == '/' ? 36 : ch == '-' ? 37 : ch == '.' ? 38 :
+         ch == '?' ? 39 : ch == '!' ? 40 : ch == ':' ? 41 : 42;
+}
+
+/**
+ * Header font row widened to 3 pixels per bit
+ * @return uint32_t - bit n set when pixel n of the 24 is black
+**/
+constexpr uint32_t header_row(char ch, uint8_t y, uint8_t x = 0){
+  return x == 8 ? 0 :
+         ((b_fonts[header_font(ch)][y] >> (7 - x)) & 1 ? 7UL << (3 * x) : 0) | header_row(ch, y, x + 1);
+}
+
+/**
+ * Footer font row: the high nibble of l_fonts for even characters, the low
+ * one for odd, 1 pixel per bit
+ * @return uint8_t - bit n set when pixel n of the 4 is black
+**/
+constexpr uint8_t footer_row(char ch, uint8_t y, uint8_t x = 0){
+  return x == 4 ? 0 :
+         ((l_fonts[ch >= 48 && ch <= 91 ? (ch - 48) / 2 : 22][y] >> ((ch % 2 ? 3 : 7) - x)) & 1 ? 1 << x : 0) |
+         footer_row(ch, y, x + 1);
+}
+
+struct header_glyph_t {
+  uint32_t rows[HEADER_ROWS];
+};
+
+struct footer_glyph_t {
+  uint8_t rows[FOOTER_ROWS];
+};
+
+constexpr header_glyph_t header_glyph(char ch){
+  return header_glyph_t{{
+    header_row(ch, 0), header_row(ch, 1), header_row(ch, 2), header_row(ch, 3),
+    header_row(ch, 4), header_row(ch, 5), header_row(ch, 6), header_row(ch, 7),
+    header_row(ch, 8), header_row(ch, 9), header_row(ch, 10)
+  }};
+}
+
+constexpr footer_glyph_t footer_glyph(char ch){
+  return footer_glyph_t{{
+    footer_row(ch, 0), footer_row(ch, 1), footer_row(ch, 2), footer_row(ch, 3), footer_row(ch, 4)
+  }};
+}
+
+// Glyph atlas: every character of both fonts expanded to pixel masks at compile time
+template<uint8_t... I> struct Chars {};
+template<uint8_t N, uint8_t... I> struct MakeChars : MakeChars<N - 1, N - 1, I...> {};
+template<uint8_t... I> struct MakeChars<0, I...> {
+  typedef Chars<I...> type;
+};
+
+template<class C> struct Atlas;
+template<uint8_t... I> struct Atlas<Chars<I...>> {
+  static const header_glyph_t header[ATLAS_CHARS];
+  static const footer_glyph_t footer[ATLAS_CHARS];
+};
+template<uint8_t... I> const header_glyph_t Atlas<Chars<I...>>::header[ATLAS_CHARS] = {
+  header_glyph(ATLAS_FIRST + I)...
+};
+template<uint8_t... I> const footer_glyph_t Atlas<Chars<I...>>::footer[ATLAS_CHARS] = {
+  footer_glyph(ATLAS_FIRST + I)...
+};
+
+typedef Atlas<MakeChars<ATLAS_CHARS>::type> Glyphs;
+
+static char headerText[OVERLAY_HEADER_CHARS];
+static char footerText[OVERLAY_FOOTER_CHARS];
+static uint8_t footerLen = 0;
+
+static uint8_t atlas_index(char ch){
+  return ch >= ATLAS_FIRST && ch < ATLAS_FIRST + ATLAS_CHARS ? ch - ATLAS_FIRST : ' ' - ATLAS_FIRST;
+}
+
+/**
+ * Set the callsign drawn in the header, 8x11 font at 3 px per bit
+ * @param const char* id - text, OVERLAY_HEADER_CHARS characters
+**/
+void overlay_set_header(const char* id){
+  memcpy(headerText, id, OVERLAY_HEADER_CHARS);
+#ifdef SSTV_NATIVE
+  sim_frame_header(headerText, OVERLAY_HEADER_CHARS);
+#endif
+}
+
+/**
+ * Set the telemetry drawn in the footer, 4x5 nibble font
+ * @param const char* text - characters to draw
+ * @param uint8_t len - number of characters, at most OVERLAY_FOOTER_CHARS
+**/
+void overlay_set_footer(const char* text, uint8_t len){
+  footerLen = min(len, (uint8_t)OVERLAY_FOOTER_CHARS);
+  memcpy(footerText, text, footerLen);
+#ifdef SSTV_NATIVE
+  sim_frame_footer(text, len);
+#endif
+}
+
+/**
+ * Paint the black runs of a glyph row
+ * @param byte* slot - encoded line group
+ * @param uint8_t line - line of the group
+ * @param uint16_t x - first pixel column of the glyph
+ * @param uint32_t mask - bit n set when pixel x + n is black
+**/
+static void draw_runs(byte* slot, uint8_t line, uint16_t x, uint32_t mask){
+  while(mask != 0){
+    uint8_t first = __builtin_ctz(mask);
+    uint8_t n = __builtin_ctz(~(mask >> first));
+    Mode::Layout::black(slot, line, x + first, n);
+    mask &= ~(((1UL << n) - 1) << first);
+  }
+}
+
+/**
+ * Draw the header and footer text over a line group just before it is sent.
+ * Overlay lines arrive white, so only the black pixels of the text are
+ * painted, straight into the layout the mode sends.
+ * @param byte* slot - group laid out by Mode::Layout
+ * @param uint16_t group - group number in the frame
+**/
+void overlay_group(byte* slot, uint16_t group){
+  for(uint8_t i = 0; i < Mode::Layout::lines; i++){
+    uint16_t line = group * Mode::Layout::lines + i;
+    if(line >= TEXT_TOP && line < TEXT_TOP + HEADER_ROWS){
+      uint8_t y = line - TEXT_TOP;
+      for(uint8_t c = 0; c < OVERLAY_HEADER_CHARS; c++){
+        draw_runs(slot, i, TEXT_LEFT + 24 * c, Glyphs::header[atlas_index(headerText[c])].rows[y]);
+      }
+    } else if(line >= OVERLAY_HEADER_LINES + TEXT_TOP && line < OVERLAY_HEADER_LINES + TEXT_TOP + FOOTER_ROWS){
+      uint8_t y = line - OVERLAY_HEADER_LINES - TEXT_TOP;
+      for(uint8_t c = 0; c < footerLen; c++){
+        draw_runs(slot, i, TEXT_LEFT + 4 * c, Glyphs::footer[atlas_index(footerText[c])].rows[y]);
+      }
+    }
+  }
+}
@@ -0,0 +1,109 @@
+#include "sd_writer.h"
+#include "arena.h"
+
+static File file;
+static byte* buf;                   // SD_WRITER_BYTES from the arena
+static uint16_t fill = 0;           // Bytes waiting in buf
+static bool failed = false;         // A write came back short
+
+// Stats of the current stage
+static uint32_t stageBytes;
+static uint16_t stageCalls;         // SD library write calls
+static unsigned long stageSdUs;     // Time spent inside them
+static unsigned long stageStart;    // micros() the stage began
+
+static void stage_reset(){
+  stageBytes = 0;
+  stageCalls = 0;
+  stageSdUs = 0;
+  stageStart = micros();
+}
+
+/**
+ * Hand the buffered bytes to the SD library in one call
+**/
+static void flush_buf(){
+  if(fill == 0){
+    return;
+  }
+  unsigned long start = micros();
+  if(file.write(buf, fill) != fill){
+    failed = true;
+  }
+  stageSdUs += micros() - start;
+  stageCalls++;
+  fill = 0;
+}
+
+/**
+ * Create a file for writing, replacing an old one
+ * @param const char* filename - file on the SD card
+ * @return bool - false if it could not be created
+**/
+bool sd_writer_open(const char* filename){
+  if(SD.exists(filename)){
+    SD.remove(filename);
+  }
+  file = SD.open(filename, FILE_WRITE);
+  buf = (byte*)arena_alloc(SD_WRITER_BYTES);
+  fill = 0;
+  failed = false;
+  stage_reset();
+  return file;
+}
+
+/**
+ * Append bytes, writing to the card each time the buffer fills
+ * @param const void* data - bytes to append
+ * @param uint32_t len - count
+**/
+void sd_writer_write(const void* data, uint32_t len){
+  const byte* src = (const byte*)data;
+  stageBytes += len;
+  while(len > 0){
+    uint32_t n = min(len, (uint32_t)(SD_WRITER_BYTES - fill));
+    memcpy(buf + fill, src, n);
+    fill += n;
+    src += n;
+    len -= n;
+    if(fill == SD_WRITER_BYTES){
+      flush_buf();
+    }
+  }
+}
+
+/**
+ * Print the throughput of the stage written since the last call (or the
+ * open) and start a new one
+ * @param const char* name - stage name
+**/
+void sd_writer_stage(const char* name){
+  unsigned long elapsed = micros() - stageStart;
+
+  Serial.print(name);
+  Serial.print(": ");
+  Serial.print(stageBytes);
+  Serial.print(" bytes in ");
+  Serial.print(stageCalls);
+  Serial.print(" SD writes, ");
+  Serial.print(stageSdUs / 1000.0, 1);
+  Serial.print(" ms writing of ");
+  Serial.print(elapsed / 1000.0, 1);
+  Serial.print(" ms, ");
+  Serial.print(stageSdUs ? stageBytes * 1000.0 / stageSdUs : 0.0, 1);
+  Serial.println(" KB/s");
+
+  stage_reset();
+}
+
+/**
+ * Write what is left in the buffer, close the file and report the last stage
+ * @param const char* name - last stage name
+ * @return bool - false if any write came back short
+**/
+bool sd_writer_close(const char* name){
+  flush_buf();
+  file.close();
+  sd_writer_stage(name);
+  return !failed;
+}
@@ -0,0 +1,124 @@
+/**
+ * Line buffer layouts of the SSTV modes, see sstv_mode.h
+**/
+
+#include "sstv_mode.h"
+
+#define LUMA_BLACK 16
+
+// ITU-R BT.601 studio range, 8 bit fixed point
+static inline byte luma(const byte* p){
+  return ((66 * p[0] + 129 * p[1] + 25 * p[2] + 128) >> 8) + 16;
+}
+
+static inline byte chroma_r(int r, int g, int b){
+  return ((112 * r - 94 * g - 18 * b + 128) >> 8) + 128;
+}
+
+static inline byte chroma_b(int r, int g, int b){
+  return ((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128;
+}
+
+/**
+ * Store one line as planar green, blue, red
+ * @param byte* dst - SSTV_RGB_LINE bytes
+ * @param const byte* const* rows - one line, 3 bytes (R, G, B) per pixel
+**/
+void RGBLayout::encode(byte* dst, const byte* const* rows){
+  const byte* rgb = rows[0];
+
+  for(uint16_t i = 0; i < SSTV_WIDTH; i++){
+    dst[i] = rgb[1];
+    dst[SSTV_WIDTH + i] = rgb[2];
+    dst[2 * SSTV_WIDTH + i] = rgb[0];
+    rgb += 3;
+  }
+}
+
+/**
+ * Paint black pixels over an encoded line
+ * @param byte* dst - encoded group
+ * @param uint8_t line - line of the group
+ * @param uint16_t x - first pixel
+ * @param uint16_t n - pixels
+**/
+void RGBLayout::black(byte* dst, uint8_t /*line*/, uint16_t x, uint16_t n){
+  memset(dst + x, 0, n);
+  memset(dst + SSTV_WIDTH + x, 0, n);
+  memset(dst + 2 * SSTV_WIDTH + x, 0, n);
+}
+
+/**
+ * Store a line pair as Y0, R-Y, B-Y, Y1
+ * @param byte* dst - 4 * SSTV_WIDTH bytes
+ * @param const byte* const* rows - two lines, 3 bytes (R, G, B) per pixel
+**/
+void PDLayout::encode(byte* dst, const byte* const* rows){
+  const byte* rgb = rows[0];
+  const byte* next = rows[1];
+
+  for(uint16_t i = 0; i < SSTV_WIDTH; i++){
+    int r = (rgb[0] + next[0] + 1) >> 1;
+    int g = (rgb[1] + next[1] + 1) >> 1;
+    int b = (rgb[2] + next[2] + 1) >> 1;
+
+    dst[i] = luma(rgb);
+    dst[SSTV_WIDTH + i] = chroma_r(r, g, b);
+    dst[2 * SSTV_WIDTH + i] = chroma_b(r, g, b);
+    dst[3 * SSTV_WIDTH + i] = luma(next);
+    rgb += 3;
+    next += 3;
+  }
+}
+
+/**
+ * Paint black pixels over an encoded line on white. Black and white have
+ * the same (neutral) chroma, so only luma changes.
+ * @param byte* dst - encoded group
+ * @param uint8_t line - line of the group
+ * @param uint16_t x - first pixel
+ * @param uint16_t n - pixels
+**/
+void PDLayout::black(byte* dst, uint8_t line, uint16_t x, uint16_t n){
+  memset(dst + (line ? 3 * SSTV_WIDTH : 0) + x, LUMA_BLACK, n);
+}
+
+/**
+ * Store a line pair as Y0, R-Y, Y1, B-Y with 160 chroma samples each
+ * @param byte* dst - 3 * SSTV_WIDTH bytes
+ * @param const byte* const* rows - two lines, 3 bytes (R, G, B) per pixel
+**/
+void Robot36Layout::encode(byte* dst, const byte* const* rows){
+  const byte* rgb = rows[0];
+  const byte* next = rows[1];
+  byte* y0 = dst;
+  byte* ry = dst + SSTV_WIDTH;
+  byte* y1 = dst + 3 * SSTV_WIDTH / 2;
+  byte* by = dst + 5 * SSTV_WIDTH / 2;
+
+  for(uint16_t i = 0; i < SSTV_WIDTH / 2; i++){
+    int r = (rgb[0] + rgb[3] + next[0] + next[3] + 2) >> 2;
+    int g = (rgb[1] + rgb[4] + next[1] + next[4] + 2) >> 2;
+    int b = (rgb[2] + rgb[5] + next[2] + next[5] + 2) >> 2;
+
+    y0[2 * i] = luma(rgb);
+    y0[2 * i + 1] = luma(rgb + 3);
+    y1[2 * i] = luma(next);
+    y1[2 * i + 1] = luma(next + 3);
+    ry[i] = chroma_r(r, g, b);
+    by[i] = chroma_b(r, g, b);
+    rgb += 6;
+    next += 6;
+  }
+}
+
+/**
+ * Paint black pixels over an encoded line on white, luma only as for PD
+ * @param byte* dst - encoded group
+ * @param uint8_t line - line of the group
+ * @param uint16_t x - first pixel
+ * @param uint16_t n - pixels
+**/
+void Robot36Layout::black(byte* dst, uint8_t line, uint16_t x, uint16_t n){
+  memset(dst + (line ? 3 * SSTV_WIDTH / 2 : 0) + x, LUMA_BLACK, n);
+}
@@ -0,0 +1,141 @@
+#include "trace.h"
+
+struct trace_entry_t {
+  uint32_t at;                      // Cycle it started
+  uint32_t cycles;
+  uint8_t point;
+};
+
+struct trace_stat_t {
+  uint32_t count;
+  uint32_t worst;
+  uint64_t total;
+};
+
+static trace_entry_t ring[TRACE_ENTRIES];
+static volatile uint32_t head;      // Events recorded since trace_clear()
+static trace_stat_t stats[TRACE_POINTS];
+static const char* const names[TRACE_POINTS] = {
+  "ISR latency", "ISR", "DDS write", "SD read", "Group slack"
+};
+
+#ifdef SSTV_NATIVE
+static uint32_t histogram[TRACE_POINTS][TRACE_BUCKETS];
+#endif
+
+/**
+ * Start the cycle counter. Call once in setup().
+**/
+void trace_begin(){
+#ifndef SSTV_NATIVE
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CYCCNT = 0;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+#endif
+  trace_clear();
+}
+
+/**
+ * Forget every event, at the start of a frame
+**/
+void trace_clear(){
+  head = 0;
+  memset(stats, 0, sizeof(stats));
+#ifdef SSTV_NATIVE
+  memset(histogram, 0, sizeof(histogram));
+#endif
+}
+
+/**
+ * Record an event. Safe from the foreground and the interrupt.
+ * @param uint8_t point - TRACE_ISR...
+ * @param uint32_t cycles - what it took
+**/
+void trace_value(uint8_t point, uint32_t cycles){
+  uint32_t now = trace_now();
+
+#ifndef SSTV_NATIVE
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+#endif
+  trace_entry_t* e = &ring[head++ % TRACE_ENTRIES];
+  e->at = now - cycles;
+  e->cycles = cycles;
+  e->point = point;
+  trace_stat_t* s = &stats[point];
+  s->count++;
+  s->total += cycles;
+  if(cycles > s->worst){
+    s->worst = cycles;
+  }
+#ifndef SSTV_NATIVE
+  __set_PRIMASK(primask);
+#endif
+
+#ifdef SSTV_NATIVE
+  histogram[point][cycles ? 32 - __builtin_clz(cycles) : 0]++;
+#endif
+}
+
+/**
+ * Print the count, mean and worst of every point, then the ring of the last
+ * events (the histograms on the native build). Cycles are of the 84 MHz core.
+**/
+void trace_report(){
+  Serial.println("Trace (cycles): point count mean worst");
+  for(uint8_t p = 0; p < TRACE_POINTS; p++){
+    const trace_stat_t* s = &stats[p];
+    Serial.print(names[p]);
+    Serial.print(" ");
+    Serial.print(s->count);
+    Serial.print(" ");
+    Serial.print(s->count ? (uint32_t)(s->total / s->count) : 0);
+    Serial.print(" ");
+    Serial.println(s->worst);
+  }
+
+#ifdef SSTV_NATIVE
+  for(uint8_t p = 0; p < TRACE_POINTS; p++){
+    Serial.print(names[p]);
+    Serial.println(" histogram (cycles: events):");
+    for(uint8_t b = 0; b < TRACE_BUCKETS; b++){
+      if(histogram[p][b] > 0){
+        Serial.print("  < 2^");
+        Serial.print(b);
+        Serial.print(": ");
+        Serial.println(histogram[p][b]);
+      }
+    }
+  }
+#else
+  uint32_t n = head;
+  uint32_t first = n > TRACE_ENTRIES ? n - TRACE_ENTRIES : 0;
+  Serial.println("Trace ring: start point cycles");
+  for(uint32_t i = first; i < n; i++){
+    const trace_entry_t* e = &ring[i % TRACE_ENTRIES];
+    Serial.print(e->at);
+    Serial.print(" ");
+    Serial.print(e->point);
+    Serial.print(" ");
+    Serial.println(e->cycles);
+  }
+#endif
+}
+
+/**
+ * Events of a point since trace_clear()
+ * @param uint8_t point - TRACE_ISR...
+ * @return uint32_t - how many
+**/
+uint32_t trace_count(uint8_t point){
+  return stats[point].count;
+}
+
+/**
+ * Cycles of all events of a point since trace_clear()
+ * @param uint8_t point - TRACE_ISR...
+ * @return uint64_t - their sum
+**/
+uint64_t trace_total(uint8_t point){
+  return stats[point].total;
+}
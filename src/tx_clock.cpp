@@ -0,0 +1,132 @@
+#include "tx_clock.h"
+
+#ifdef DDS_DAC
+#include "dac_synth.h"
+#endif
+
+static void (*handler)() = 0;
+
+#ifdef DDS_DAC
+
+// The DAC sample clock counts the ticks and calls the handler as it
+// synthesizes the samples, see dac_synth.h
+
+void tx_clock_begin(void (*isr)()){
+  handler = isr;
+  dac_clock(isr);
+}
+
+uint32_t tx_clock_now(){
+  return dac_tick();
+}
+
+/**
+ * Interrupt at the DAC sample nearest to tick, on the next sample if it
+ * already passed
+ * @param uint32_t tick - absolute tick, wraps every 102 s
+**/
+void tx_clock_arm(uint32_t tick){
+  dac_arm(tick);
+}
+
+/**
+ * micros() at which the DAC converts the sample of tick. Samples are made
+ * ahead, the counter runs ahead of the output by what is queued.
+ * @param uint32_t tick - absolute tick
+**/
+unsigned long tx_clock_micros_at(uint32_t tick){
+  int32_t ahead = (int32_t)(tick - (dac_tick() - dac_queued() * DAC_SAMPLE_TICKS));
+  return micros() + (ahead > 0 ? ahead / TX_CLOCK_TICKS_PER_US : 0);
+}
+
+#elif defined(SSTV_NATIVE)
+
+static int sim_id = -1;
+
+static uint64_t now_ticks(){
+  return sim_now_ns() * TX_CLOCK_TICKS_PER_US / 1000;
+}
+
+void tx_clock_begin(void (*isr)()){
+  handler = isr;
+  if(sim_id < 0){
+    sim_id = sim_timer_add(isr);
+  }
+}
+
+uint32_t tx_clock_now(){
+  return (uint32_t)now_ticks();
+}
+
+/**
+ * Interrupt once the counter reaches tick, right away if it already has
+ * @param uint32_t tick - absolute tick, wraps every 102 s
+**/
+void tx_clock_arm(uint32_t tick){
+  uint64_t now = now_ticks();
+  int32_t ahead = (int32_t)(tick - (uint32_t)now);
+  if(ahead < 0){
+    ahead = 0;
+  }
+  // First nanosecond at which the counter reads tick
+  sim_timer_at(sim_id, ((now + ahead) * 1000 + TX_CLOCK_TICKS_PER_US - 1) / TX_CLOCK_TICKS_PER_US);
+}
+
+#else
+
+#define TX_TC TC0
+#define TX_CHANNEL 0
+#define TX_IRQ TC0_IRQn
+
+void tx_clock_begin(void (*isr)()){
+  handler = isr;
+
+  pmc_set_writeprotect(false);
+  pmc_enable_periph_clk(ID_TC0);
+  TC_Configure(TX_TC, TX_CHANNEL, TC_CMR_TCCLKS_TIMER_CLOCK1 | TC_CMR_WAVE | TC_CMR_WAVSEL_UP);
+  TX_TC->TC_CHANNEL[TX_CHANNEL].TC_IDR = 0xFFFFFFFF;
+  TC_Start(TX_TC, TX_CHANNEL);
+
+  NVIC_ClearPendingIRQ(TX_IRQ);
+  NVIC_SetPriority(TX_IRQ, 0);
+  NVIC_EnableIRQ(TX_IRQ);
+}
+
+uint32_t tx_clock_now(){
+  return TX_TC->TC_CHANNEL[TX_CHANNEL].TC_CV;
+}
+
+/**
+ * Interrupt once the counter reaches tick, right away if it already has
+ * @param uint32_t tick - absolute tick, wraps every 102 s
+**/
+void tx_clock_arm(uint32_t tick){
+  TcChannel* ch = &TX_TC->TC_CHANNEL[TX_CHANNEL];
+  ch->TC_RA = tick;
+  (void)ch->TC_SR;              // drop a compare from the previous deadline
+  ch->TC_IER = TC_IER_CPAS;
+  if((int32_t)(tick - ch->TC_CV) <= 0){
+    NVIC_SetPendingIRQ(TX_IRQ); // passed before RA was written
+  }
+}
+
+void TC0_Handler(){
+  TcChannel* ch = &TX_TC->TC_CHANNEL[TX_CHANNEL];
+  (void)ch->TC_SR;
+  ch->TC_IDR = TC_IDR_CPAS;     // one shot, the handler re-arms
+  handler();
+}
+
+#endif
+
+#ifndef DDS_DAC
+/**
+ * micros() at which the counter reaches tick, for foreground work that must
+ * be done before an edge
+ * @param uint32_t tick - absolute tick
+**/
+unsigned long tx_clock_micros_at(uint32_t tick){
+  int32_t ahead = (int32_t)(tick - tx_clock_now());
+  return micros() + (ahead > 0 ? ahead / TX_CLOCK_TICKS_PER_US : 0);
+}
+#endif
@@ -0,0 +1,438 @@
+#include "tx_engine.h"
+#include "line_ring.h"
+#include "tx_clock.h"
+#include "dds.h"
+#include "dds_stream.h"
+#include "trace.h"
+
+#ifdef SSTV_NATIVE
+#include "sim_demod.h"
+#endif
+
+/**
+ * Tone op
+ * @param uint16_t freq - Hz
+ * @param uint32_t us - duration in microseconds
+ * @param uint8_t flags - TX_ADVANCE
+**/
+constexpr tx_op_t tx_tone(uint16_t freq, uint32_t us, uint8_t flags = 0){
+  return tx_op_t{ TX_TONE, flags, 0, 0, DDS_WORD(freq), tx_span(us * 1000ULL) };
+}
+
+/**
+ * Scan op, timed as the whole run for the stream backend
+ * @param uint16_t offset - first byte in the slot
+ * @param uint16_t count - pixels
+ * @param uint8_t flags - TX_PREVIOUS
+**/
+constexpr tx_op_t tx_scan(uint16_t offset, uint16_t count, uint8_t flags = 0){
+  return tx_op_t{ TX_SCAN, flags, offset, count, 0, tx_span((uint64_t)count * Mode::pixelNs) };
+}
+
+constexpr tx_op_t tx_end(){
+  return tx_op_t{ TX_END, 0, 0, 0, 0, tx_span(0) };
+}
+
+// Pixel period of the bit-banged backend
+static constexpr tx_span_t pixelSpan = tx_span(Mode::pixelNs);
+
+// Ticks an edge can land off the schedule by rounding alone
+#ifdef DDS_DAC
+#define EDGE_GRAIN DAC_SAMPLE_TICKS   // Nearest DAC sample, half either way
+#else
+#define EDGE_GRAIN 1
+#endif
+
+// Op of a Tone / Scan segment
+template<class S> struct OpOf;
+template<uint16_t Freq, uint32_t Us, bool Read> struct OpOf<Tone<Freq, Us, Read>> {
+  static constexpr tx_op_t op(){ return tx_tone(Freq, Us, Read ? TX_ADVANCE : 0); }
+};
+template<uint16_t Offset, uint16_t Count, bool Previous> struct OpOf<Scan<Offset, Count, Previous>> {
+  static constexpr tx_op_t op(){ return tx_scan(Offset, Count, Previous ? TX_PREVIOUS : 0); }
+};
+
+// Op table of a segment list
+template<class List> struct Program;
+template<class... S> struct Program<Segments<S...>> {
+  static const tx_op_t ops[sizeof...(S) + 1];
+};
+template<class... S> const tx_op_t Program<Segments<S...>>::ops[sizeof...(S) + 1] = {
+  OpOf<S>::op()..., tx_end()
+};
+
+static const tx_op_t offOps[] = {
+  { TX_OFF, 0, 0, 0, DDS_WORD(2), tx_span(0) }
+};
+
+// Tables of a frame in order, each sent repeat times
+struct tx_part_t {
+  const tx_op_t* ops;
+  uint16_t repeat;
+};
+
+#define TX_LINE_PART 2
+
+static const tx_part_t parts[] = {
+  { Program<Mode::Header>::ops, 1 },
+  { Program<Mode::Preamble>::ops, 1 },
+  { Program<Mode::Line>::ops, TX_GROUPS },
+  { offOps, 1 }
+};
+
+// Position in the frame
+struct tx_cursor_t {
+  const tx_op_t* op;
+  uint8_t part;
+  uint16_t repeat;
+};
+
+/**
+ * Step over the ends of tables
+ * @return bool - true if a line group ended
+**/
+static bool skip_ends(tx_cursor_t* c){
+  bool line = false;
+  while(c->op->kind == TX_END){
+    line = line || c->part == TX_LINE_PART;
+    if(--c->repeat > 0){
+      c->op = parts[c->part].ops;
+    } else {
+      c->part++;
+      c->op = parts[c->part].ops;
+      c->repeat = parts[c->part].repeat;
+    }
+  }
+  return line;
+}
+
+static void cursor_reset(tx_cursor_t* c){
+  c->part = 0;
+  c->op = parts[0].ops;
+  c->repeat = parts[0].repeat;
+  skip_ends(c);
+}
+
+static bool cursor_next(tx_cursor_t* c){
+  c->op++;
+  return skip_ends(c);
+}
+
+// Line groups come from the line ring
+static const byte* cur;            // Group being sent
+static const byte* prev;           // Group sent before it
+
+// Sender
+static tx_cursor_t isr;            // Next op
+static tx_deadline_t at;           // Next edge on the schedule
+static tx_deadline_t armed;        // Deadline the clock is armed for
+static volatile uint32_t armedTick;
+static volatile bool busy = false;
+static unsigned long startedAt;    // micros() of the first edge
+static int32_t edgeError;          // Last edge vs the schedule, 1/1000 tick
+static int32_t lineError[TX_GROUPS];
+static volatile uint16_t lines;
+static uint32_t publishedAt[LINE_RING_SLOTS];  // trace_now() each slot was queued
+
+#ifdef DDS_STREAM
+// Scans are encoded ahead by tx_service(), one in flight and one waiting
+static dds_stream_entry_t encBuf[2][DDS_STREAM_ENTRIES(Mode::maxScan)];
+static volatile uint16_t encoded;  // Scans encoded
+static volatile uint16_t started;  // Scans the interrupt has reached
+static volatile uint16_t missed;   // Scans reached before they were encoded
+static tx_cursor_t enc;            // Next op for the encoder
+static uint32_t streamLead;        // Ticks from stream start to the first word latched
+#else
+static const byte* scanBuf;
+static uint16_t scanLen;
+static uint16_t tp;                // Index of pixel while transmitting
+#endif
+
+/**
+ * Move to the next group in the line ring. Past the last group only scans of
+ * the previous one are left; with nothing published the current group is sent
+ * again (the ring counts it as an underrun).
+**/
+static void take_group(){
+  prev = cur;
+  if(line_ring_taken() >= TX_GROUPS){
+    return;
+  }
+  const byte* next = line_ring_take();
+  if(next != 0){
+    cur = next;
+    trace_span(TRACE_SLACK, publishedAt[(line_ring_taken() - 1) % LINE_RING_SLOTS]);
+  }
+}
+
+/**
+ * Arm the clock for the next edge. A stream is started one word early, as
+ * its first word only latches after a full word period.
+**/
+static void arm_next(){
+  armed = at;
+#ifdef DDS_STREAM
+  if(isr.op->kind == TX_SCAN){
+    armed.tick -= streamLead;
+  }
+#endif
+  armedTick = armed.tick;
+  tx_clock_arm(armed.tick);
+}
+
+static void next_op(){
+  if(cursor_next(&isr) && lines < TX_GROUPS){
+    lineError[lines++] = edgeError;
+  }
+}
+
+/**
+ * Send the edge that is due and arm the next one from the schedule rather
+ * than from now
+**/
+static void send_edge(){
+#ifndef DDS_STREAM
+  if(tp < scanLen){  // Transmitting pixels
+    dds_write(dds_lut[scanBuf[tp++]]);
+    tx_deadline_add(&at, pixelSpan);
+    arm_next();
+    return;
+  }
+#endif
+
+  const tx_op_t* op = isr.op;
+  if(op->kind == TX_TONE){
+#ifndef DDS_STREAM
+    if(op->flags & TX_ADVANCE){
+      take_group();
+    }
+#endif
+    dds_write(op->word);
+    next_op();
+    tx_deadline_add(&at, op->span);
+    arm_next();
+  } else if(op->kind == TX_SCAN){
+#ifdef DDS_STREAM
+    if(encoded > started){
+      dds_stream_start(encBuf[started & 1], op->count);
+    } else {
+      missed++;
+    }
+    started++;
+    next_op();
+    tx_deadline_add(&at, op->span);
+    arm_next();
+#else
+    scanBuf = (op->flags & TX_PREVIOUS ? prev : cur) + op->offset;
+    scanLen = op->count;
+    tp = 0;
+    dds_write(dds_lut[scanBuf[tp++]]);
+    next_op();
+    tx_deadline_add(&at, pixelSpan);
+    arm_next();
+#endif
+  } else {           // TX_OFF
+    dds_write(op->word);
+    busy = false;
+  }
+}
+
+/**
+ * Transmit clock deadline: how late it was taken, then the edge, both traced
+**/
+static void tx_interrupt(){
+  uint32_t start = trace_now();
+  if(!busy){
+    return;
+  }
+  edgeError = tx_deadline_error(&armed, tx_clock_now());
+  trace_value(TRACE_ISR_LATENCY, edgeError > 0 ? edgeError / (1000 * TX_CLOCK_TICKS_PER_US / TRACE_CPU_MHZ) : 0);
+  send_edge();
+  trace_span(TRACE_ISR, start);
+}
+
+/**
+ * Set up the transmit clock (and the SPI stream backend)
+**/
+void tx_begin(){
+  tx_clock_begin(tx_interrupt);
+#ifdef DDS_STREAM
+  dds_stream_begin(Mode::pixelNs / 1000.0);  // One AD9850 word per pixel period
+  streamLead = (uint32_t)(dds_stream_period_us() * TX_CLOCK_TICKS_PER_US + 0.5);
+#endif
+}
+
+/**
+ * Start a frame 1 ms from now. Lines are taken from the queue as the
+ * interrupt reaches them; tx_busy() turns false once the DDS is silent.
+**/
+void tx_start(){
+  static const byte blank[Mode::Layout::bytes] = { 0 };
+
+  line_ring_reset();
+  trace_clear();
+  cur = prev = blank;
+#ifdef SSTV_NATIVE
+  sim_frame_begin(Mode::vis, Mode::Layout::lines, Mode::Layout::bytes);
+#endif
+  lines = 0;
+#ifdef DDS_STREAM
+  encoded = 0;
+  started = 0;
+  missed = 0;
+#else
+  scanLen = 0;
+  tp = 0;
+#endif
+
+  cursor_reset(&isr);
+#ifdef DDS_STREAM
+  enc = isr;
+#endif
+
+  at.tick = tx_clock_now() + 1000 * TX_CLOCK_TICKS_PER_US;
+  at.frac = 0;
+  startedAt = tx_clock_micros_at(at.tick);
+  busy = true;
+  arm_next();
+}
+
+bool tx_busy(){
+  return busy;
+}
+
+/**
+ * When the frame started by tx_start() sends its first tone
+ * @return unsigned long - micros() of the first edge
+**/
+unsigned long tx_started_at(){
+  return startedAt;
+}
+
+/**
+ * Free line ring slot for the next line group
+ * @return byte* - Mode::Layout::bytes to fill, 0 if the ring is full or the
+ *                 whole frame is queued
+**/
+byte* tx_queue_slot(){
+  if(line_ring_published() >= TX_GROUPS){
+    return 0;
+  }
+  return line_ring_claim();
+}
+
+/**
+ * Groups queued that the sender has not taken yet. At 0 it is sending the
+ * last group queued and needs the next one within a group time.
+**/
+uint16_t tx_queue_depth(){
+  return line_ring_published() - line_ring_taken();
+}
+
+/**
+ * Hand the slot returned by tx_queue_slot() to the sender
+**/
+void tx_queue_push(){
+  publishedAt[line_ring_published() % LINE_RING_SLOTS] = trace_now();
+  line_ring_publish();
+}
+
+/**
+ * Encode the upcoming scans for the SPI stream backend, following the frame
+ * one scan ahead of the interrupt. Groups are taken here rather than in the
+ * interrupt, as this is where their pixels are read. Nothing to do when the
+ * interrupt sends the pixels itself.
+**/
+void tx_service(){
+#ifdef DDS_STREAM
+  while(busy){
+    const tx_op_t* op = enc.op;
+    if(op->kind == TX_OFF){
+      return;
+    }
+    if(op->kind == TX_TONE){
+      if(op->flags & TX_ADVANCE){
+        // Wait for the producer while the interrupt is not past this point
+        uint16_t t = line_ring_taken();
+        if(t < TX_GROUPS && line_ring_published() == t && encoded >= started){
+          return;
+        }
+        take_group();
+      }
+      cursor_next(&enc);
+      continue;
+    }
+
+    uint16_t s = started;
+    if(encoded > s){          // One in flight, the next one waiting
+      return;
+    }
+    if(encoded >= s){        // Not passed already
+      const byte* src = (op->flags & TX_PREVIOUS ? prev : cur) + op->offset;
+      dds_stream_encode(encBuf[encoded & 1], src, op->count);
+#ifdef SSTV_NATIVE
+      if(dds_stream_verify(encBuf[encoded & 1], src, op->count, SSTV_BLACK_FREQ, SSTV_COLOR_STEP) != 0){
+        Serial.println("DDS stream does not match setfreq()");
+      }
+#endif
+    }
+    encoded++;
+    cursor_next(&enc);
+  }
+#endif
+}
+
+/**
+ * micros() until which SPI0 is free for the SD card. With the stream backend
+ * every edge uses the bus, otherwise it is never taken.
+**/
+unsigned long tx_bus_free_until(){
+#ifdef DDS_STREAM
+  if(busy){
+    if(dds_stream_busy()){
+      return micros();
+    }
+    return tx_clock_micros_at(armedTick);
+  }
+#endif
+  return micros() + 0x40000000UL;
+}
+
+/**
+ * Print how far one edge of every line landed from the schedule. Slant is
+ * the drift between the first and the last line; lines that were late are
+ * counted apart, the schedule catches up after them.
+**/
+void tx_report(){
+  uint16_t n = lines;
+  if(n == 0){
+    return;
+  }
+
+  int32_t first = lineError[0];
+  uint16_t late = 0;
+
+  Serial.println("Line error (1/1000 tick of 42 MHz):");
+  for(uint16_t g = 0; g < n; g++){
+    Serial.print(g * Mode::Layout::lines);
+    Serial.print(" ");
+    Serial.println(lineError[g]);
+    if(lineError[g] - first >= 1000 * EDGE_GRAIN){
+      late++;
+    }
+  }
+
+  double slant = (lineError[n - 1] - first) / 1000.0;
+  Serial.print("Slant: ");
+  Serial.print(slant, 3);
+  Serial.print(" ticks over the frame, late lines: ");
+  Serial.println(late);
+  line_ring_report();
+#ifdef DDS_STREAM
+  Serial.print("Scans not encoded in time: ");
+  Serial.println(missed);
+#endif
+#ifdef DDS_DAC
+  dac_report();
+#endif
+}